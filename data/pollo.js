@@ -0,0 +1,27 @@
+function showMessage(text) {
+  var message = document.getElementById('message');
+  message.textContent = text;
+  message.hidden = false;
+}
+
+//Run door buttons in place: the action answers with JSON, so there is no redirect or page render
+document.querySelectorAll('a[data-action]').forEach(function (link) {
+  link.addEventListener('click', function (event) {
+    event.preventDefault();
+    fetch(link.getAttribute('href') + '?format=json')
+      .then(function (response) {
+        if (!response.ok) {
+          throw new Error(response.statusText);
+        }
+        return response.json();
+      })
+      .then(function (result) {
+        document.getElementById('state').textContent = result.state;
+        showMessage(result.message);
+      })
+      .catch(function (error) {
+        //Not retried: the command may still have been queued
+        showMessage('Not sent: ' + error.message);
+      });
+  });
+});
@@ -0,0 +1,177 @@
+#include <AssetCache.h>
+
+AssetCache::AssetCache(size_t pBudget, size_t pMaxAsset) {
+  _fs = NULL;
+  _budget = pBudget;
+  _maxAsset = pMaxAsset;
+  _used = 0;
+  _clock = 0;
+  _hits = 0;
+  _misses = 0;
+  _evictions = 0;
+  _wanted[0] = 0;
+  for (uint8_t i = 0; i < ASSETCACHE_ENTRIES; i++) {
+    _entries[i].path[0] = 0;
+    _entries[i].data = NULL;
+    _entries[i].length = 0;
+    _entries[i].gzipped = false;
+    _entries[i].pins = 0;
+    _entries[i].kept = false;
+    _entries[i].lastUsed = 0;
+  }
+}
+
+void AssetCache::begin(FS &pFS) {
+  _fs = &pFS;
+}
+
+//Pinned asset for pPath. NULL on a miss; serve it from the filesystem instead, and service() will
+//load it if it fits
+cachedAsset *AssetCache::get(const char *pPath) {
+  cachedAsset *asset = find(pPath);
+  if (asset == NULL) {
+    _misses++;
+    if (strlen(pPath) < ASSETCACHE_PATH_LENGTH) {
+      strcpy(_wanted, pPath);
+    }
+    return NULL;
+  }
+  _hits++;
+  asset->lastUsed = ++_clock;
+  asset->pins++;
+  return asset;
+}
+
+void AssetCache::release(cachedAsset *pAsset) {
+  if (pAsset != NULL && pAsset->pins > 0) {
+    pAsset->pins--;
+  }
+}
+
+//Load ahead of the first request and keep it. Only the budget limits its size. Doesn't count as a miss
+bool AssetCache::warm(const char *pPath) {
+  cachedAsset *asset = find(pPath);
+  if (asset == NULL) {
+    asset = load(pPath, _budget);
+  }
+  if (asset == NULL) {
+    return false;
+  }
+  asset->kept = true;
+  asset->lastUsed = ++_clock;
+  return true;
+}
+
+//Load the last asset missed, if it is still wanted. Called from loop()
+void AssetCache::service() {
+  if (_wanted[0] == 0) {
+    return;
+  }
+  if (find(_wanted) == NULL) {
+    load(_wanted, _maxAsset);
+  }
+  _wanted[0] = 0;
+}
+
+cachedAsset *AssetCache::find(const char *pPath) {
+  for (uint8_t i = 0; i < ASSETCACHE_ENTRIES; i++) {
+    if (_entries[i].data != NULL && strcmp(_entries[i].path, pPath) == 0) {
+      return &_entries[i];
+    }
+  }
+  return NULL;
+}
+
+cachedAsset *AssetCache::load(const char *pPath, size_t pMaxAsset) {
+  char gzPath[ASSETCACHE_PATH_LENGTH + 3];
+  cachedAsset *asset = NULL;
+  bool gzipped;
+  size_t length;
+  File file;
+
+  if (_fs == NULL || strlen(pPath) >= ASSETCACHE_PATH_LENGTH) {
+    return NULL;
+  }
+  snprintf(gzPath, sizeof(gzPath), "%s.gz", pPath);
+  gzipped = _fs->exists(gzPath);
+  file = _fs->open(gzipped ? gzPath : pPath, "r");
+  if (!file) {
+    return NULL;
+  }
+  length = file.size();
+  if (length == 0 || length > pMaxAsset || length > _budget || !makeRoom(length)) {
+    file.close();
+    return NULL;
+  }
+  for (uint8_t i = 0; i < ASSETCACHE_ENTRIES && asset == NULL; i++) {
+    if (_entries[i].data == NULL) {
+      asset = &_entries[i];
+    }
+  }
+  asset->data = (uint8_t*)malloc(length);
+  if (asset->data == NULL || file.read(asset->data, length) != length) {
+    free(asset->data);
+    asset->data = NULL;
+    file.close();
+    return NULL;
+  }
+  file.close();
+  strcpy(asset->path, pPath);
+  asset->length = length;
+  asset->gzipped = gzipped;
+  asset->pins = 0;
+  asset->kept = false;
+  asset->lastUsed = ++_clock;
+  _used += length;
+  return asset;
+}
+
+//Evict least recently used assets, never pinned or kept ones, until pLength more bytes and a free entry fit
+bool AssetCache::makeRoom(size_t pLength) {
+  bool freeEntry;
+  cachedAsset *oldest;
+  for (;;) {
+    freeEntry = false;
+    oldest = NULL;
+    for (uint8_t i = 0; i < ASSETCACHE_ENTRIES; i++) {
+      if (_entries[i].data == NULL) {
+        freeEntry = true;
+      }
+      else if (_entries[i].pins == 0 && !_entries[i].kept && (oldest == NULL || _entries[i].lastUsed < oldest->lastUsed)) {
+        oldest = &_entries[i];
+      }
+    }
+    if (freeEntry && _used + pLength <= _budget) {
+      return true;
+    }
+    if (oldest == NULL) {
+      return false;
+    }
+    free(oldest->data);
+    oldest->data = NULL;
+    _used -= oldest->length;
+    oldest->length = 0;
+    _evictions++;
+  }
+}
+
+uint32_t AssetCache::hits() {
+  return _hits;
+}
+
+uint32_t AssetCache::misses() {
+  return _misses;
+}
+
+uint32_t AssetCache::evictions() {
+  return _evictions;
+}
+
+//Bytes held
+size_t AssetCache::used() {
+  return _used;
+}
+
+size_t AssetCache::budget() {
+  return _budget;
+}
@@ -0,0 +1,58 @@
+#ifndef __ASSETCACHE_H__
+#define __ASSETCACHE_H__
+
+
+#include <Arduino.h>
+#include <FS.h>
+
+//Sizing. The byte budget and the largest asset loaded on a miss are set by the owner
+const uint8_t ASSETCACHE_ENTRIES = 12;
+const uint8_t ASSETCACHE_PATH_LENGTH = 24;
+
+//A file held in RAM. A precompressed <path>.gz is preferred over <path> when there is one
+struct cachedAsset {
+  char path[ASSETCACHE_PATH_LENGTH];
+  uint8_t *data;
+  size_t length;
+  bool gzipped;
+  uint8_t pins;
+  bool kept;
+  uint32_t lastUsed;
+};
+
+//Least recently used cache of small read-only files. Assets warmed at boot are kept for good, so
+//the big blocks are allocated before the heap fragments. A miss never touches the filesystem from
+//get(): the caller serves the file itself and service() loads it later, outside the web server's
+//callbacks. get() pins an asset until release(), so one being sent is never evicted. Files are
+//assumed not to change while running; a new filesystem image comes with a restart
+class AssetCache {
+  public:
+    AssetCache(size_t pBudget, size_t pMaxAsset);
+    void begin(FS &pFS);
+    cachedAsset *get(const char *pPath);
+    void release(cachedAsset *pAsset);
+    bool warm(const char *pPath);
+    void service();
+    uint32_t hits();
+    uint32_t misses();
+    uint32_t evictions();
+    size_t used();
+    size_t budget();
+  private:
+    cachedAsset *find(const char *pPath);
+    cachedAsset *load(const char *pPath, size_t pMaxAsset);
+    bool makeRoom(size_t pLength);
+    FS *_fs;
+    cachedAsset _entries[ASSETCACHE_ENTRIES];
+    size_t _budget;
+    size_t _maxAsset;
+    size_t _used;
+    char _wanted[ASSETCACHE_PATH_LENGTH];
+    uint32_t _clock;
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _evictions;
+};
+
+
+#endif // __ASSETCACHE_H__
@@ -0,0 +1,246 @@
+#include <Console.h>
+#include <stdarg.h>
+
+Console::Console(Stream &pStream, const consoleCommand *pCommands, uint8_t pCount) : _stream(pStream) {
+  _commands = pCommands;
+  _count = pCount;
+  _length = 0;
+  _overflow = false;
+  _txHead = 0;
+  _txCount = 0;
+  _lines = 0;
+  _errors = 0;
+  _dropped = 0;
+}
+
+//Send what the UART has room for, then take what has arrived, up to CONSOLE_BYTES_PER_SERVICE
+//bytes, running each line as it ends. CR, LF and CRLF all end a line, and backspace rubs out
+void Console::service() {
+  send();
+  for (uint8_t i = 0; i < CONSOLE_BYTES_PER_SERVICE && _txCount == 0 && _stream.available() > 0; i++) {
+    int c = _stream.read();
+    if (c == '\r' || c == '\n') {
+      if (_overflow) {
+        error("line too long");
+      } else if (_length > 0) {
+        _line[_length] = '\0';
+        runLine();
+        send();
+      }
+      _length = 0;
+      _overflow = false;
+    } else if (c == '\b' || c == 0x7F) {
+      if (_length > 0 && !_overflow) {
+        _length--;
+      }
+    } else if (c < ' ' || c > '~') {
+      continue;
+    } else if (_length < CONSOLE_LINE_LENGTH - 1) {
+      _line[_length++] = c;
+    } else {
+      _overflow = true;
+    }
+  }
+}
+
+//Formatted into a buffer on the stack, then queued for send(). Longer lines are cut at CONSOLE_OUTPUT_LENGTH
+void Console::printf(const char *pFormat, ...) {
+  char out[CONSOLE_OUTPUT_LENGTH];
+  va_list args;
+  va_start(args, pFormat);
+  int length = vsnprintf(out, sizeof(out), pFormat, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+  if (length >= (int)sizeof(out)) {
+    length = sizeof(out) - 1;
+  }
+  for (int i = 0; i < length; i++) {
+    if (_txCount == CONSOLE_TX_LENGTH) {
+      _dropped += length - i;
+      return;
+    }
+    _tx[(_txHead + _txCount++) % CONSOLE_TX_LENGTH] = out[i];
+  }
+}
+
+void Console::ok(const char *pMessage) {
+  printf("OK %s\r\n", pMessage);
+}
+
+void Console::error(const char *pMessage) {
+  _errors++;
+  printf("ERR %s\r\n", pMessage);
+}
+
+//One line per command, with its arguments. Optional ones are in brackets
+void Console::help() {
+  consoleCommand command;
+  argField field;
+  for (uint8_t c = 0; c < _count; c++) {
+    memcpy_P(&command, &_commands[c], sizeof(command));
+    printf("%s", command.name);
+    for (uint8_t f = 0; f < command.fieldCount; f++) {
+      memcpy_P(&field, &command.fields[f], sizeof(field));
+      printf((field.type & ARG_REQUIRED) != 0 ? " %s" : " [%s]", field.name);
+    }
+    printf("\r\n");
+  }
+}
+
+uint32_t Console::lines() {
+  return _lines;
+}
+
+uint32_t Console::errors() {
+  return _errors;
+}
+
+//Reply bytes that didn't fit CONSOLE_TX_LENGTH
+uint32_t Console::dropped() {
+  return _dropped;
+}
+
+//As much of the queued reply as the stream takes without waiting
+void Console::send() {
+  int room = _stream.availableForWrite();
+  while (_txCount > 0 && room > 0) {
+    uint16_t run = CONSOLE_TX_LENGTH - _txHead;
+    if (run > _txCount) {
+      run = _txCount;
+    }
+    if (run > room) {
+      run = room;
+    }
+    _stream.write((const uint8_t*)_tx + _txHead, run);
+    _txHead = (_txHead + run) % CONSOLE_TX_LENGTH;
+    _txCount -= run;
+    room -= run;
+  }
+}
+
+void Console::runLine() {
+  char *tokens[CONSOLE_MAX_TOKENS];
+  consoleCommand command;
+  uint8_t count = split(tokens);
+  uint8_t words = 0;
+  uint8_t c;
+
+  _lines++;
+  if (count == 0) {
+    return;
+  }
+  if (count > CONSOLE_MAX_TOKENS) {
+    error("too many words");
+    return;
+  }
+  for (c = 0; c < _count && words == 0; c++) {
+    memcpy_P(&command, &_commands[c], sizeof(command));
+    words = match(command.name, tokens, count);
+  }
+  if (words == 0) {
+    printf("ERR unknown command %s, try help\r\n", tokens[0]);
+    _errors++;
+    return;
+  }
+  if (!parse(command, tokens + words, count - words)) {
+    return;
+  }
+  command.onCommand(*this, command.fieldCount > 0 ? _args : NULL);
+}
+
+//Cut the line into words in place. Returns CONSOLE_MAX_TOKENS + 1 if there are too many
+uint8_t Console::split(char **pTokens) {
+  uint8_t count = 0;
+  char *p = _line;
+  while (true) {
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '\0') {
+      return count;
+    }
+    if (count == CONSOLE_MAX_TOKENS) {
+      return count + 1;
+    }
+    pTokens[count++] = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') {
+      p++;
+    }
+    if (*p != '\0') {
+      *p++ = '\0';
+    }
+  }
+}
+
+//Number of words of pName that start pTokens, or 0 if they don't all match
+uint8_t Console::match(const char *pName, char **pTokens, uint8_t pCount) {
+  uint8_t words = 0;
+  while (*pName != '\0') {
+    size_t length = strcspn(pName, " ");
+    if (words >= pCount || words >= CONSOLE_MAX_TOKENS || strlen(pTokens[words]) != length || strncmp(pTokens[words], pName, length) != 0) {
+      return 0;
+    }
+    words++;
+    pName += length;
+    while (*pName == ' ') {
+      pName++;
+    }
+  }
+  return words;
+}
+
+//Like parseArgs(), with values by position rather than by name
+bool Console::parse(const consoleCommand &pCommand, char **pValues, uint8_t pCount) {
+  argField field;
+  memset(_args, 0, sizeof(_args));
+  if (pCount > pCommand.fieldCount) {
+    error("too many arguments");
+    return false;
+  }
+  for (uint8_t f = 0; f < pCommand.fieldCount; f++) {
+    memcpy_P(&field, &pCommand.fields[f], sizeof(field));
+    uint8_t *target = (uint8_t*)_args + field.offset;
+    if (field.offset + field.size > sizeof(_args)) {
+      error("arguments too big");
+      return false;
+    }
+    if (f >= pCount) {
+      if ((field.type & ARG_REQUIRED) != 0) {
+        printf("ERR %s is required\r\n", field.name);
+        _errors++;
+        return false;
+      }
+      continue;
+    }
+    const char *value = pValues[f];
+    size_t length = strlen(value);
+    if ((field.type & ~ARG_REQUIRED) == ARG_TEXT) {
+      if ((int32_t)length < field.min || (int32_t)length > field.max || length >= field.size) {
+        printf("ERR %s must be %d to %d characters\r\n", field.name, (int)field.min, (int)field.max);
+        _errors++;
+        return false;
+      }
+      memcpy(target, value, length);
+      continue;
+    }
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (*end != '\0' || number < field.min || number > field.max) {
+      printf("ERR %s must be a number from %d to %d\r\n", field.name, (int)field.min, (int)field.max);
+      _errors++;
+      return false;
+    }
+    if (field.size == 1) {
+      *target = (uint8_t)number;
+    } else if (field.size == 2) {
+      uint16_t narrow = (uint16_t)number;
+      memcpy(target, &narrow, sizeof(narrow));
+    } else {
+      int32_t wide = (int32_t)number;
+      memcpy(target, &wide, sizeof(wide));
+    }
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+
+#include <Arduino.h>
+#include <Router.h>
+
+//Sizing. A line longer than CONSOLE_LINE_LENGTH - 1 is thrown away whole. Arguments are parsed into
+//CONSOLE_ARGS_SIZE bytes, so a command's argument struct must fit
+const uint8_t CONSOLE_LINE_LENGTH = 64;
+const uint8_t CONSOLE_MAX_TOKENS = 8;
+const uint8_t CONSOLE_ARGS_SIZE = 48;
+const uint8_t CONSOLE_OUTPUT_LENGTH = 96;
+//Bytes taken from the stream per service()
+const uint8_t CONSOLE_BYTES_PER_SERVICE = 32;
+//Replies wait here and go out as the UART has room, so a long one never blocks. The longest, help
+//or a dump, must fit; past that the rest of a reply is dropped
+const uint16_t CONSOLE_TX_LENGTH = 1024;
+
+class Console;
+
+//A command typed as its name (one or two words) then its arguments in the order of fields, which are
+//the same parseArgs() tables the web pages use. pArgs is NULL for a command with no fields
+struct consoleCommand {
+  const char *name;
+  const argField *fields;
+  uint8_t fieldCount;
+  void (*onCommand)(Console &pConsole, void *pArgs);
+};
+
+//Line oriented commands over a Stream, with no heap use. service() takes what has arrived without
+//waiting for the rest, and runs a command once its line ends. Replies start "OK" or "ERR". The
+//next line isn't read until the last reply has gone
+class Console {
+  public:
+    Console(Stream &pStream, const consoleCommand *pCommands, uint8_t pCount);
+    void service();
+    void printf(const char *pFormat, ...) __attribute__((format(printf, 2, 3)));
+    void ok(const char *pMessage);
+    void error(const char *pMessage);
+    void help();
+    uint32_t lines();
+    uint32_t errors();
+    uint32_t dropped();
+  private:
+    void send();
+    void runLine();
+    uint8_t split(char **pTokens);
+    uint8_t match(const char *pName, char **pTokens, uint8_t pCount);
+    bool parse(const consoleCommand &pCommand, char **pValues, uint8_t pCount);
+    Stream &_stream;
+    const consoleCommand *_commands;
+    uint8_t _count;
+    char _line[CONSOLE_LINE_LENGTH];
+    uint8_t _length;
+    bool _overflow;
+    uint32_t _args[CONSOLE_ARGS_SIZE / sizeof(uint32_t)];
+    char _tx[CONSOLE_TX_LENGTH];
+    uint16_t _txHead;
+    uint16_t _txCount;
+    uint32_t _lines;
+    uint32_t _errors;
+    uint32_t _dropped;
+};
+
+
+#endif // __CONSOLE_H__
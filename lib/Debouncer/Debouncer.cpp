@@ -0,0 +1,139 @@
+#include <Debouncer.h>
+
+Debouncer::Debouncer(unsigned long pTickMillis) {
+  _tickMillis = pTickMillis;
+  _lastTick = 0;
+  _mask = 0;
+  _invert = 0;
+  _state = 0;
+  for (uint8_t i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    _counter[i] = 0;
+    _preset[i] = 0;
+  }
+  for (uint8_t i = 0; i < 32; i++) {
+    _samples[i] = 0;
+  }
+  _edgeHead = 0;
+  _edgeCount = 0;
+  _dropped = 0;
+}
+
+//Debounce a GPIO. The timeout is rounded up to whole ticks and capped at DEBOUNCER_MAX_SAMPLES
+void Debouncer::attach(uint8_t pPin, unsigned long pDebounceMillis, bool pActiveLow) {
+  uint32_t bit = (uint32_t)1 << pPin;
+  unsigned long samples = (pDebounceMillis + _tickMillis - 1) / _tickMillis;
+  if (samples < 1) {
+    samples = 1;
+  }
+  if (samples > DEBOUNCER_MAX_SAMPLES) {
+    samples = DEBOUNCER_MAX_SAMPLES;
+  }
+  _samples[pPin] = samples;
+  _mask |= bit;
+  if (pActiveLow) {
+    _invert |= bit;
+  }
+  else {
+    _invert &= ~bit;
+  }
+  //The counter counts down from samples - 1 and the input changes on the sample after it reaches 0
+  for (uint8_t i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    if ((samples - 1) & (1 << i)) {
+      _preset[i] |= bit;
+    }
+    else {
+      _preset[i] &= ~bit;
+    }
+    _counter[i] = (_counter[i] & ~bit) | (_preset[i] & bit);
+  }
+}
+
+//Take the current levels as settled, without raising edges
+void Debouncer::begin(uint32_t pLevels, unsigned long pMillis) {
+  _state = (pLevels ^ _invert) & _mask;
+  for (uint8_t i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    _counter[i] = _preset[i];
+  }
+  _lastTick = pMillis;
+}
+
+//Tick if a tick is due. Call as often as you like
+bool Debouncer::update(uint32_t pLevels, unsigned long pMillis) {
+  if (pMillis - _lastTick < _tickMillis) {
+    return false;
+  }
+  tick(pLevels, pMillis);
+  return true;
+}
+
+void Debouncer::tick(uint32_t pLevels, unsigned long pMillis) {
+  uint32_t sample = (pLevels ^ _invert) & _mask;
+  uint32_t delta = sample ^ _state;
+  uint32_t zero = delta;
+  uint32_t borrow;
+  uint32_t reload;
+  uint32_t next;
+  uint8_t i;
+
+  _lastTick = pMillis;
+  //Inputs still disagreeing with their counter at zero change now, the rest count down
+  for (i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    zero &= ~_counter[i];
+  }
+  borrow = delta & ~zero;
+  for (i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    next = _counter[i] ^ borrow;
+    borrow &= ~_counter[i];
+    _counter[i] = next;
+  }
+  _state ^= zero;
+  //Inputs that agree with their debounced level, including any that just changed, start again
+  reload = ~delta | zero;
+  for (i = 0; i < DEBOUNCER_COUNTER_BITS; i++) {
+    _counter[i] = (_counter[i] & ~reload) | (_preset[i] & reload);
+  }
+  if (zero != 0) {
+    queueEdges(zero, pMillis);
+  }
+}
+
+//Only changed inputs cost anything here. Their new level started samples - 1 ticks ago
+void Debouncer::queueEdges(uint32_t pChanged, unsigned long pMillis) {
+  while (pChanged != 0) {
+    uint8_t pin = __builtin_ctz(pChanged);
+    pChanged &= pChanged - 1;
+    if (_edgeCount == DEBOUNCER_EDGES) {
+      _edgeHead = (_edgeHead + 1) % DEBOUNCER_EDGES;
+      _edgeCount--;
+      _dropped++;
+    }
+    switchEdge &edge = _edges[(_edgeHead + _edgeCount) % DEBOUNCER_EDGES];
+    edge.time = pMillis - (_samples[pin] - 1) * _tickMillis;
+    edge.pin = pin;
+    edge.pressed = (_state >> pin) & 1;
+    _edgeCount++;
+  }
+}
+
+bool Debouncer::isPressed(uint8_t pPin) {
+  return (_state >> pPin) & 1;
+}
+
+uint32_t Debouncer::pressed() {
+  return _state;
+}
+
+//Oldest edge first. Returns false when there are none left
+bool Debouncer::nextEdge(switchEdge &pEdge) {
+  if (_edgeCount == 0) {
+    return false;
+  }
+  pEdge = _edges[_edgeHead];
+  _edgeHead = (_edgeHead + 1) % DEBOUNCER_EDGES;
+  _edgeCount--;
+  return true;
+}
+
+uint32_t Debouncer::droppedEdges() {
+  return _dropped;
+}
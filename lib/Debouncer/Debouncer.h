@@ -0,0 +1,50 @@
+#ifndef __DEBOUNCER_H__
+#define __DEBOUNCER_H__
+
+
+#include <Arduino.h>
+
+//Sizing. Each input needs up to DEBOUNCER_MAX_SAMPLES agreeing samples before it changes
+const uint8_t DEBOUNCER_COUNTER_BITS = 4;
+const uint8_t DEBOUNCER_MAX_SAMPLES = 1 << DEBOUNCER_COUNTER_BITS;
+const uint8_t DEBOUNCER_EDGES = 16;
+
+//A debounced change on one input. time is when the new level was first seen
+struct switchEdge {
+  uint32_t time;
+  uint8_t pin;
+  bool pressed;
+};
+
+//Debounces up to 32 inputs from one sample of the GPIO input register.
+//Every input has its own down counter, stored as bit planes (a vertical counter), so a tick is
+//the same handful of word operations however many inputs are attached
+class Debouncer {
+  public:
+    Debouncer(unsigned long pTickMillis);
+    void attach(uint8_t pPin, unsigned long pDebounceMillis, bool pActiveLow);
+    void begin(uint32_t pLevels, unsigned long pMillis);
+    bool update(uint32_t pLevels, unsigned long pMillis);
+    void tick(uint32_t pLevels, unsigned long pMillis);
+    bool isPressed(uint8_t pPin);
+    uint32_t pressed();
+    bool nextEdge(switchEdge &pEdge);
+    uint32_t droppedEdges();
+  private:
+    void queueEdges(uint32_t pChanged, unsigned long pMillis);
+    unsigned long _tickMillis;
+    unsigned long _lastTick;
+    uint32_t _mask;
+    uint32_t _invert;
+    uint32_t _state;
+    uint32_t _counter[DEBOUNCER_COUNTER_BITS];
+    uint32_t _preset[DEBOUNCER_COUNTER_BITS];
+    uint8_t _samples[32];
+    switchEdge _edges[DEBOUNCER_EDGES];
+    uint8_t _edgeHead;
+    uint8_t _edgeCount;
+    uint32_t _dropped;
+};
+
+
+#endif // __DEBOUNCER_H__
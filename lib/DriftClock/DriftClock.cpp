@@ -0,0 +1,120 @@
+#include <DriftClock.h>
+
+DriftClock::DriftClock() {
+  _lastMillis = 0;
+  _elapsed = 0;
+  _syncs = 0;
+  reset();
+}
+
+//Forget the drift estimate, e.g. after the RTC has been set. The next syncDue() is true
+void DriftClock::reset() {
+  _synced = false;
+  _anchorTime = 0;
+  _anchorError = 0;
+  _anchorElapsed = 0;
+  _hasBaseline = false;
+  _baseRTC = 0;
+  _baseElapsed = 0;
+  _drift = 0;
+  _uncertainty = DRIFTCLOCK_DEFAULT_UNCERTAINTY;
+}
+
+//Extend millis() to 64 bits. Must be called at least once per 49 days
+uint64_t DriftClock::elapsed(unsigned long pMillis) {
+  _elapsed += (uint32_t)(pMillis - _lastMillis);
+  _lastMillis = pMillis;
+  return _elapsed;
+}
+
+//Anchor to an RTC reading. The RTC truncates, so a reading only says the true time is somewhere in
+//[pRTC, pRTC + 1). That window is intersected with the prediction and its error bounds, so readings
+//that land at different points in the second narrow down where the second starts.
+//Drift is measured over the whole run since the first reading, so its error shrinks as 1/baseline.
+//It is only used once that beats the crystal tolerance
+void DriftClock::sync(uint32_t pRTC, unsigned long pMillis) {
+  uint64_t elapsedNow = elapsed(pMillis);
+  uint64_t low = (uint64_t)pRTC * 1000;
+  uint64_t high = low + 1000;
+  uint64_t predicted;
+  uint64_t spread;
+  uint64_t baseline;
+  int64_t rtcMillis;
+  uint64_t uncertaintyNow;
+
+  if (_synced) {
+    predicted = nowMillis(pMillis);
+    spread = predictedError(pMillis);
+    if (predicted > low + spread) {
+      low = predicted - spread;
+    }
+    if (predicted + spread < high) {
+      high = predicted + spread;
+    }
+    //No overlap means the prediction was wrong. Start again from the reading
+    if (low >= high) {
+      low = (uint64_t)pRTC * 1000;
+      high = low + 1000;
+    }
+  }
+  _anchorTime = (low + high) / 2;
+  _anchorError = (high - low) / 2;
+  _anchorElapsed = elapsedNow;
+
+  if (!_hasBaseline) {
+    _baseRTC = pRTC;
+    _baseElapsed = elapsedNow;
+    _hasBaseline = true;
+  }
+  else {
+    baseline = elapsedNow - _baseElapsed;
+    //Two truncated readings: up to a second either way over the baseline
+    uncertaintyNow = baseline > 0 ? 1000000000000ULL / baseline : DRIFTCLOCK_DEFAULT_UNCERTAINTY;
+    if (uncertaintyNow < DRIFTCLOCK_DEFAULT_UNCERTAINTY) {
+      rtcMillis = (int64_t)(pRTC - _baseRTC) * 1000;
+      _drift = (int32_t)((rtcMillis - (int64_t)baseline) * 1000000000LL / (int64_t)baseline);
+      _uncertainty = uncertaintyNow > DRIFTCLOCK_MIN_UNCERTAINTY ? uncertaintyNow : DRIFTCLOCK_MIN_UNCERTAINTY;
+    }
+  }
+  _synced = true;
+  _syncs++;
+}
+
+bool DriftClock::syncDue(unsigned long pMillis) {
+  return !_synced || predictedError(pMillis) > DRIFTCLOCK_MAX_ERROR;
+}
+
+//Worst case error in milliseconds: the anchor's own error plus drift uncertainty since then
+uint32_t DriftClock::predictedError(unsigned long pMillis) {
+  uint64_t since = elapsed(pMillis) - _anchorElapsed;
+  return _anchorError + (uint32_t)(since * _uncertainty / 1000000000ULL);
+}
+
+uint64_t DriftClock::nowMillis(unsigned long pMillis) {
+  uint64_t since = elapsed(pMillis) - _anchorElapsed;
+  int64_t corrected = (int64_t)since + (int64_t)since * _drift / 1000000000LL;
+  return _anchorTime + corrected;
+}
+
+//Unix time in whole seconds, so it agrees with millisecond()
+uint32_t DriftClock::now(unsigned long pMillis) {
+  return (uint32_t)(nowMillis(pMillis) / 1000);
+}
+
+//Milliseconds into the current second
+uint16_t DriftClock::millisecond(unsigned long pMillis) {
+  return nowMillis(pMillis) % 1000;
+}
+
+//RTC seconds gained per ESP second, in parts per billion. Positive when millis() runs slow
+int32_t DriftClock::drift() {
+  return _drift;
+}
+
+uint32_t DriftClock::uncertainty() {
+  return _uncertainty;
+}
+
+uint32_t DriftClock::syncs() {
+  return _syncs;
+}
@@ -0,0 +1,46 @@
+#ifndef __DRIFTCLOCK_H__
+#define __DRIFTCLOCK_H__
+
+
+#include <Arduino.h>
+
+//Error budget in milliseconds. The RTC is read again when the predicted error passes this
+const uint32_t DRIFTCLOCK_MAX_ERROR = 1000;
+//Drift uncertainty in parts per billion: crystal tolerance before any estimate, temperature after
+const uint32_t DRIFTCLOCK_DEFAULT_UNCERTAINTY = 100000;
+const uint32_t DRIFTCLOCK_MIN_UNCERTAINTY = 10000;
+
+//Software clock disciplined against the RTC.
+//Time runs off millis(), corrected by the drift measured between RTC reads. The RTC is only read
+//again when the predicted error grows past DRIFTCLOCK_MAX_ERROR
+class DriftClock {
+  public:
+    DriftClock();
+    void reset();
+    void sync(uint32_t pRTC, unsigned long pMillis);
+    bool syncDue(unsigned long pMillis);
+    uint32_t now(unsigned long pMillis);
+    uint16_t millisecond(unsigned long pMillis);
+    uint32_t predictedError(unsigned long pMillis);
+    int32_t drift();
+    uint32_t uncertainty();
+    uint32_t syncs();
+  private:
+    uint64_t elapsed(unsigned long pMillis);
+    uint64_t nowMillis(unsigned long pMillis);
+    unsigned long _lastMillis;
+    uint64_t _elapsed;
+    bool _synced;
+    uint64_t _anchorTime;
+    uint32_t _anchorError;
+    uint64_t _anchorElapsed;
+    bool _hasBaseline;
+    uint32_t _baseRTC;
+    uint64_t _baseElapsed;
+    int32_t _drift;
+    uint32_t _uncertainty;
+    uint32_t _syncs;
+};
+
+
+#endif // __DRIFTCLOCK_H__
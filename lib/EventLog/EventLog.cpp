@@ -0,0 +1,196 @@
+#include <EventLog.h>
+
+EventLog::EventLog() {
+  _fs = NULL;
+  _head = 0;
+  _count = 0;
+  _flushedSeq = 0;
+  _nextSeq = 0;
+  _dropped = 0;
+  _lastFlush = 0;
+  for (uint8_t i = 0; i < EVENTLOG_FILES; i++) {
+    _fileFirstSeq[i] = 0;
+    _fileRecords[i] = 0;
+  }
+}
+
+//Find where the files on flash left off. File 0 is the newest
+bool EventLog::begin(FS &pFS) {
+  char path[16];
+  eventRecord record;
+  _fs = &pFS;
+  _flushedSeq = 0;
+  for (int i = EVENTLOG_FILES - 1; i >= 0; i--) {
+    _fileFirstSeq[i] = _flushedSeq;
+    _fileRecords[i] = 0;
+    filePath(i, path);
+    File file = _fs->open(path, "r");
+    if (!file) {
+      continue;
+    }
+    _fileRecords[i] = file.size() / sizeof(eventRecord);
+    if (_fileRecords[i] > 0 && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record)) {
+      _fileFirstSeq[i] = record.seq;
+      _flushedSeq = record.seq + _fileRecords[i];
+    }
+    file.close();
+  }
+  //Anything logged before the files were found carries on from them
+  for (uint16_t i = 0; i < _count; i++) {
+    _ring[(_head + i) % EVENTLOG_RAM_RECORDS].seq = _flushedSeq + i;
+  }
+  _nextSeq = _flushedSeq + _count;
+  return true;
+}
+
+//Buffer a record in RAM and return its sequence number. When the buffer is full the oldest
+//unflushed record is dropped, and its number with it
+uint32_t EventLog::append(uint32_t pTime, uint8_t pType, uint8_t pCode, uint8_t pDetail, int32_t pValue) {
+  if (_count == EVENTLOG_RAM_RECORDS) {
+    _head = (_head + 1) % EVENTLOG_RAM_RECORDS;
+    _count--;
+    _dropped++;
+  }
+  eventRecord &record = _ring[(_head + _count) % EVENTLOG_RAM_RECORDS];
+  record.seq = _nextSeq++;
+  record.time = pTime;
+  record.type = pType;
+  record.code = pCode;
+  record.detail = pDetail;
+  record.reserved = 0;
+  record.value = pValue;
+  _count++;
+  return record.seq;
+}
+
+bool EventLog::flushDue(unsigned long pMillis) {
+  if (_fs == NULL || _count == 0) {
+    return false;
+  }
+  return _count >= EVENTLOG_FLUSH_RECORDS || pMillis - _lastFlush >= EVENTLOG_FLUSH_INTERVAL;
+}
+
+//Write every pending record to file 0, rotating when it fills
+void EventLog::flush(unsigned long pMillis) {
+  char path[16];
+  _lastFlush = pMillis;
+  if (_fs == NULL) {
+    return;
+  }
+  filePath(0, path);
+  while (_count > 0) {
+    //A gap from dropped records starts a new file, so each file stays contiguous
+    if (_ring[_head].seq != _flushedSeq) {
+      _flushedSeq = _ring[_head].seq;
+      if (_fileRecords[0] > 0) {
+        rotate();
+      }
+    }
+    if (_fileRecords[0] >= EVENTLOG_FILE_RECORDS) {
+      rotate();
+    }
+    uint32_t room = EVENTLOG_FILE_RECORDS - _fileRecords[0];
+    uint16_t run = EVENTLOG_RAM_RECORDS - _head;
+    if (run > _count) {
+      run = _count;
+    }
+    if (run > room) {
+      run = room;
+    }
+    File file = _fs->open(path, "a");
+    if (!file) {
+      return;
+    }
+    size_t written = file.write((const uint8_t*)&_ring[_head], run * sizeof(eventRecord));
+    file.close();
+    if (written != run * sizeof(eventRecord)) {
+      return;
+    }
+    if (_fileRecords[0] == 0) {
+      _fileFirstSeq[0] = _flushedSeq;
+    }
+    _fileRecords[0] += run;
+    _flushedSeq += run;
+    _head = (_head + run) % EVENTLOG_RAM_RECORDS;
+    _count -= run;
+  }
+}
+
+//Read up to pMax consecutive records starting at pSeq, or at the first after it when pSeq fell in a
+//gap. Returns 0 past the newest record
+size_t EventLog::read(uint32_t pSeq, eventRecord *pRecords, size_t pMax) {
+  for (int i = EVENTLOG_FILES - 1; i >= 0; i--) {
+    if (_fileRecords[i] > 0 && pSeq < _fileFirstSeq[i] + _fileRecords[i]) {
+      return readFile(i, pSeq > _fileFirstSeq[i] ? pSeq : _fileFirstSeq[i], pRecords, pMax);
+    }
+  }
+  size_t n = 0;
+  uint32_t offset = _count > 0 && pSeq > _ring[_head].seq ? pSeq - _ring[_head].seq : 0;
+  while (n < pMax && offset + n < _count) {
+    pRecords[n] = _ring[(_head + offset + n) % EVENTLOG_RAM_RECORDS];
+    n++;
+  }
+  return n;
+}
+
+uint32_t EventLog::firstSeq() {
+  for (int i = EVENTLOG_FILES - 1; i >= 0; i--) {
+    if (_fileRecords[i] > 0) {
+      return _fileFirstSeq[i];
+    }
+  }
+  return _flushedSeq;
+}
+
+uint32_t EventLog::nextSeq() {
+  return _nextSeq;
+}
+
+uint16_t EventLog::pending() {
+  return _count;
+}
+
+uint32_t EventLog::dropped() {
+  return _dropped;
+}
+
+void EventLog::filePath(uint8_t pFile, char *pPath) {
+  snprintf(pPath, 16, "/log/%u.bin", pFile);
+}
+
+//Drop the oldest file and shift the rest along
+void EventLog::rotate() {
+  char fromPath[16];
+  char toPath[16];
+  filePath(EVENTLOG_FILES - 1, toPath);
+  _fs->remove(toPath);
+  for (int i = EVENTLOG_FILES - 1; i > 0; i--) {
+    filePath(i - 1, fromPath);
+    filePath(i, toPath);
+    _fs->rename(fromPath, toPath);
+    _fileFirstSeq[i] = _fileFirstSeq[i - 1];
+    _fileRecords[i] = _fileRecords[i - 1];
+  }
+  _fileFirstSeq[0] = _flushedSeq;
+  _fileRecords[0] = 0;
+}
+
+size_t EventLog::readFile(uint8_t pFile, uint32_t pSeq, eventRecord *pRecords, size_t pMax) {
+  char path[16];
+  uint32_t index = pSeq - _fileFirstSeq[pFile];
+  if (index >= _fileRecords[pFile]) {
+    return 0;
+  }
+  if (pMax > _fileRecords[pFile] - index) {
+    pMax = _fileRecords[pFile] - index;
+  }
+  filePath(pFile, path);
+  File file = _fs->open(path, "r");
+  if (!file) {
+    return 0;
+  }
+  file.seek(index * sizeof(eventRecord), SeekSet);
+  size_t bytes = file.read((uint8_t*)pRecords, pMax * sizeof(eventRecord));
+  file.close();
+  return bytes / sizeof(eventRecord);
+}
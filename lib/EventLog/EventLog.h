@@ -0,0 +1,65 @@
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+
+#include <Arduino.h>
+#include <FS.h>
+
+//Event types
+const uint8_t EVENT_BOOT = 1;
+const uint8_t EVENT_DOOR = 2;
+const uint8_t EVENT_ALARM = 3;
+const uint8_t EVENT_OVERRIDE = 4;
+const uint8_t EVENT_CONFIG = 5;
+const char* const EVENT_TYPE_NAME[6] = { "none", "boot", "door", "alarm", "override", "config" };
+
+//Sizing. Records are buffered in RAM and written in batches to rotating files
+const uint16_t EVENTLOG_RAM_RECORDS = 32;
+const uint16_t EVENTLOG_FLUSH_RECORDS = 16;
+const unsigned long EVENTLOG_FLUSH_INTERVAL = 60000;
+const uint32_t EVENTLOG_FILE_RECORDS = 256;
+const uint8_t EVENTLOG_FILES = 4;
+
+//Fixed size record as stored on flash. Sequence numbers are given on append and contiguous within a
+//file. Records dropped before they reached flash leave a gap, and the file after it starts afresh
+struct eventRecord {
+  uint32_t seq;
+  uint32_t time;
+  uint8_t type;
+  uint8_t code;
+  uint8_t detail;
+  uint8_t reserved;
+  int32_t value;
+};
+static_assert(sizeof(eventRecord) == 16, "eventRecord must stay 16 bytes");
+
+class EventLog {
+  public:
+    EventLog();
+    bool begin(FS &pFS);
+    uint32_t append(uint32_t pTime, uint8_t pType, uint8_t pCode, uint8_t pDetail, int32_t pValue);
+    bool flushDue(unsigned long pMillis);
+    void flush(unsigned long pMillis);
+    size_t read(uint32_t pSeq, eventRecord *pRecords, size_t pMax);
+    uint32_t firstSeq();
+    uint32_t nextSeq();
+    uint16_t pending();
+    uint32_t dropped();
+  private:
+    void filePath(uint8_t pFile, char *pPath);
+    void rotate();
+    size_t readFile(uint8_t pFile, uint32_t pSeq, eventRecord *pRecords, size_t pMax);
+    FS *_fs;
+    eventRecord _ring[EVENTLOG_RAM_RECORDS];
+    uint16_t _head;
+    uint16_t _count;
+    uint32_t _flushedSeq;
+    uint32_t _nextSeq;
+    uint32_t _fileFirstSeq[EVENTLOG_FILES];
+    uint32_t _fileRecords[EVENTLOG_FILES];
+    uint32_t _dropped;
+    unsigned long _lastFlush;
+};
+
+
+#endif // __EVENTLOG_H__
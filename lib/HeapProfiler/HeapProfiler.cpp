@@ -0,0 +1,230 @@
+#include <HeapProfiler.h>
+
+namespace {
+  heapCounters counters = { 0, 0, 0, 0 };
+
+  uint16_t clamp16(uint32_t pValue) {
+    return pValue > 0xFFFF ? 0xFFFF : pValue;
+  }
+}
+
+void heapCountAlloc(size_t pBytes, bool pAllocated) {
+  if (!pAllocated) {
+    counters.failed++;
+    return;
+  }
+  counters.allocs++;
+  counters.bytes += pBytes;
+}
+
+void heapCountFree() {
+  counters.frees++;
+}
+
+void heapCounts(heapCounters &pCounts) {
+  pCounts = counters;
+}
+
+//The hooks. Link with -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc and build with
+//HEAP_PROFILER_WRAP to route every allocation in the sketch and the core through them. Without
+//them the sites see no allocations, but the heap is still watched
+#if defined(HEAP_PROFILER_WRAP) && !defined(HEAP_PROFILER_DISABLED)
+extern "C" {
+  void *__real_malloc(size_t pSize);
+  void *__real_calloc(size_t pCount, size_t pSize);
+  void *__real_realloc(void *pPointer, size_t pSize);
+  void __real_free(void *pPointer);
+
+  void *__wrap_malloc(size_t pSize) {
+    void *allocated = __real_malloc(pSize);
+    heapCountAlloc(pSize, allocated != NULL);
+    return allocated;
+  }
+
+  void *__wrap_calloc(size_t pCount, size_t pSize) {
+    void *allocated = __real_calloc(pCount, pSize);
+    heapCountAlloc(pCount * pSize, allocated != NULL);
+    return allocated;
+  }
+
+  //A resize counts as a new block for the old one, moved or not
+  void *__wrap_realloc(void *pPointer, size_t pSize) {
+    void *allocated = __real_realloc(pPointer, pSize);
+    if (pPointer != NULL && pSize == 0) {
+      heapCountFree();
+      return allocated;
+    }
+    heapCountAlloc(pSize, allocated != NULL);
+    if (pPointer != NULL && allocated != NULL) {
+      heapCountFree();
+    }
+    return allocated;
+  }
+
+  void __wrap_free(void *pPointer) {
+    if (pPointer != NULL) {
+      heapCountFree();
+    }
+    __real_free(pPointer);
+  }
+}
+#endif
+
+//The heap is looked at every pCheckInterval milliseconds from service(), and the worst of every
+//pSampleInterval is kept
+HeapProfiler::HeapProfiler(unsigned long pCheckInterval, unsigned long pSampleInterval) {
+  _siteCount = 0;
+  _nextSample = 0;
+  _windowOpen = false;
+  _windowStart = 0;
+  _checkInterval = pCheckInterval;
+  _sampleInterval = pSampleInterval;
+  //The first service() looks straight away
+  _checkedAt = 0 - pCheckInterval;
+  _minFree = UINT32_MAX;
+  _minLargest = UINT32_MAX;
+  _maxFragmentation = 0;
+  _overBudget = 0;
+  _untracked = 0;
+}
+
+//Charge what happened between two heapCounts() to pName
+void HeapProfiler::record(const char *pName, const heapCounters &pStart, const heapCounters &pEnd) {
+  heapSite *site = find(pName);
+  uint32_t allocs = pEnd.allocs - pStart.allocs;
+  uint32_t frees = pEnd.frees - pStart.frees;
+  uint32_t bytes = pEnd.bytes - pStart.bytes;
+  if (site == NULL) {
+    _untracked++;
+    return;
+  }
+  site->calls++;
+  site->allocs += allocs;
+  site->bytes += bytes;
+  if (allocs > frees) {
+    site->kept += allocs - frees;
+  }
+  if (allocs > site->maxAllocs) {
+    site->maxAllocs = allocs;
+  }
+  if (bytes > site->maxBytes) {
+    site->maxBytes = bytes;
+  }
+  if ((site->budgetAllocs > 0 && allocs > site->budgetAllocs) || (site->budgetBytes > 0 && bytes > site->budgetBytes)) {
+    site->overBudget++;
+    _overBudget++;
+  }
+}
+
+//Most allocations and bytes one call to pName should make. 0 is unlimited. False if there is no room for the site
+bool HeapProfiler::setBudget(const char *pName, uint32_t pAllocs, uint32_t pBytes) {
+  heapSite *site = find(pName);
+  if (site == NULL) {
+    return false;
+  }
+  site->budgetAllocs = pAllocs;
+  site->budgetBytes = pBytes;
+  return true;
+}
+
+void HeapProfiler::service(unsigned long pNow) {
+  if (pNow - _checkedAt < _checkInterval) {
+    return;
+  }
+  _checkedAt = pNow;
+  check(pNow);
+}
+
+size_t HeapProfiler::sites() {
+  return _siteCount;
+}
+
+const heapSite &HeapProfiler::site(size_t pIndex) {
+  return _sites[pIndex];
+}
+
+size_t HeapProfiler::samples() {
+  return _nextSample < HEAP_SAMPLES ? _nextSample : HEAP_SAMPLES;
+}
+
+//Oldest first
+const heapSample &HeapProfiler::sample(size_t pIndex) {
+  return _ring[(_nextSample - samples() + pIndex) % HEAP_SAMPLES];
+}
+
+//Low water marks since boot
+uint32_t HeapProfiler::minFree() {
+  return _minFree;
+}
+
+uint32_t HeapProfiler::minLargest() {
+  return _minLargest;
+}
+
+uint8_t HeapProfiler::maxFragmentation() {
+  return _maxFragmentation;
+}
+
+//Calls that went over their budget, over all sites
+uint32_t HeapProfiler::overBudget() {
+  return _overBudget;
+}
+
+//Calls not recorded because every site was taken
+uint32_t HeapProfiler::untracked() {
+  return _untracked;
+}
+
+//The site named pName, added if it is new and there is room
+heapSite *HeapProfiler::find(const char *pName) {
+  for (uint8_t i = 0; i < _siteCount; i++) {
+    if (_sites[i].name == pName || strcmp(_sites[i].name, pName) == 0) {
+      return &_sites[i];
+    }
+  }
+  if (_siteCount >= HEAP_SITES) {
+    return NULL;
+  }
+  heapSite &site = _sites[_siteCount++];
+  memset(&site, 0, sizeof(site));
+  site.name = pName;
+  return &site;
+}
+
+//Fold one look at the heap into the low water marks and the current window
+void HeapProfiler::check(unsigned long pNow) {
+  uint32_t available = ESP.getFreeHeap();
+  uint32_t largest = ESP.getMaxFreeBlockSize();
+  uint8_t fragmentation = ESP.getHeapFragmentation();
+  if (available < _minFree) {
+    _minFree = available;
+  }
+  if (largest < _minLargest) {
+    _minLargest = largest;
+  }
+  if (fragmentation > _maxFragmentation) {
+    _maxFragmentation = fragmentation;
+  }
+  if (!_windowOpen) {
+    _windowOpen = true;
+    _windowStart = pNow;
+    _window.free = clamp16(available);
+    _window.largest = clamp16(largest);
+    _window.fragmentation = fragmentation;
+  }
+  if (available < _window.free) {
+    _window.free = available;
+  }
+  if (largest < _window.largest) {
+    _window.largest = largest;
+  }
+  if (fragmentation > _window.fragmentation) {
+    _window.fragmentation = fragmentation;
+  }
+  if (pNow - _windowStart >= _sampleInterval) {
+    _window.uptime = pNow / 1000;
+    _ring[_nextSample % HEAP_SAMPLES] = _window;
+    _nextSample++;
+    _windowOpen = false;
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef __HEAP_PROFILER_H__
+#define __HEAP_PROFILER_H__
+
+
+#include <Arduino.h>
+
+//Sizing. Sites past HEAP_SITES are counted as untracked. The ring holds HEAP_SAMPLES windows
+const uint8_t HEAP_SITES = 32;
+const uint8_t HEAP_SAMPLES = 48;
+
+//Running totals kept by the allocator hooks. Bytes are as asked for, not as the allocator rounds them
+struct heapCounters {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t bytes;
+  uint32_t failed;
+};
+
+void heapCountAlloc(size_t pBytes, bool pAllocated);
+void heapCountFree();
+void heapCounts(heapCounters &pCounts);
+
+//What one named scope allocated. Maxima are per call; kept is allocations not freed before it ended
+struct heapSite {
+  const char *name;
+  uint32_t calls;
+  uint32_t allocs;
+  uint32_t bytes;
+  uint32_t kept;
+  uint32_t maxAllocs;
+  uint32_t maxBytes;
+  uint32_t budgetAllocs;
+  uint32_t budgetBytes;
+  uint32_t overBudget;
+};
+
+//The worst of one window: least free heap, smallest largest block, most fragmentation
+struct heapSample {
+  uint32_t uptime;
+  uint16_t free;
+  uint16_t largest;
+  uint8_t fragmentation;
+};
+
+//Attributes allocations to named scopes, holding each to an optional per call budget, and watches
+//free heap and the largest free block for the slow fragmentation that String churn leaves behind.
+//Names are string literals, so only the pointer is kept
+class HeapProfiler {
+  public:
+    HeapProfiler(unsigned long pCheckInterval, unsigned long pSampleInterval);
+    void record(const char *pName, const heapCounters &pStart, const heapCounters &pEnd);
+    bool setBudget(const char *pName, uint32_t pAllocs, uint32_t pBytes);
+    void service(unsigned long pNow);
+    size_t sites();
+    const heapSite &site(size_t pIndex);
+    size_t samples();
+    const heapSample &sample(size_t pIndex);
+    uint32_t minFree();
+    uint32_t minLargest();
+    uint8_t maxFragmentation();
+    uint32_t overBudget();
+    uint32_t untracked();
+  private:
+    heapSite *find(const char *pName);
+    void check(unsigned long pNow);
+    heapSite _sites[HEAP_SITES];
+    uint8_t _siteCount;
+    heapSample _ring[HEAP_SAMPLES];
+    uint32_t _nextSample;
+    heapSample _window;
+    bool _windowOpen;
+    unsigned long _windowStart;
+    unsigned long _checkInterval;
+    unsigned long _sampleInterval;
+    unsigned long _checkedAt;
+    uint32_t _minFree;
+    uint32_t _minLargest;
+    uint8_t _maxFragmentation;
+    uint32_t _overBudget;
+    uint32_t _untracked;
+};
+
+//Counts the allocations made in the enclosing scope. Use through HEAP_SCOPE so it can be compiled out
+class heapScope {
+  public:
+#ifndef HEAP_PROFILER_DISABLED
+    heapScope(HeapProfiler &pProfiler, const char *pName) : _profiler(pProfiler), _name(pName) {
+      heapCounts(_start);
+    }
+    ~heapScope() {
+      heapCounters end;
+      heapCounts(end);
+      _profiler.record(_name, _start, end);
+    }
+  private:
+    HeapProfiler &_profiler;
+    const char *_name;
+    heapCounters _start;
+#else
+    heapScope(HeapProfiler &pProfiler, const char *pName) {}
+#endif
+};
+
+//HEAP_SCOPE(profiler, "name") counts allocations from here to the end of the block. Build with
+//HEAP_PROFILER_DISABLED to leave no code behind
+#define HEAP_JOIN2(a, b) a##b
+#define HEAP_JOIN(a, b) HEAP_JOIN2(a, b)
+#ifndef HEAP_PROFILER_DISABLED
+#define HEAP_SCOPE(profiler, name) heapScope HEAP_JOIN(_heapScope, __LINE__)(profiler, name)
+#else
+#define HEAP_SCOPE(profiler, name)
+#endif
+
+
+#endif // __HEAP_PROFILER_H__
@@ -0,0 +1,115 @@
+#include <RateLimiter.h>
+
+RateLimiter::RateLimiter() {
+  _count = 0;
+  _refillAllMillis = 0;
+  _evictions = 0;
+  _shared = 0;
+  _overflow.ip = 0;
+  _overflow.lastSeen = 0;
+  for (uint8_t i = 0; i < RATELIMIT_CLASSES; i++) {
+    _budgets[i].burst = 0;
+    _budgets[i].refillMillis = 0;
+    _admitted[i] = 0;
+    _limited[i] = 0;
+    _overflow.tokens[i] = 0;
+    _overflow.refilledAt[i] = 0;
+  }
+}
+
+//A class with no burst is not limited
+void RateLimiter::setBudget(uint8_t pClass, uint16_t pBurst, unsigned long pRefillMillis) {
+  if (pClass >= RATELIMIT_CLASSES) {
+    return;
+  }
+  _budgets[pClass].burst = pBurst;
+  _budgets[pClass].refillMillis = pRefillMillis;
+  _overflow.tokens[pClass] = pBurst;
+  _refillAllMillis = 0;
+  for (uint8_t i = 0; i < RATELIMIT_CLASSES; i++) {
+    if (_budgets[i].burst * _budgets[i].refillMillis > _refillAllMillis) {
+      _refillAllMillis = _budgets[i].burst * _budgets[i].refillMillis;
+    }
+  }
+}
+
+//Spend one of pIP's tokens for pClass. Returns 0 if there was one, else milliseconds until there will be
+unsigned long RateLimiter::take(uint32_t pIP, uint8_t pClass, unsigned long pMillis) {
+  if (pClass >= RATELIMIT_CLASSES || _budgets[pClass].burst == 0) {
+    return 0;
+  }
+  const rateBudget &budget = _budgets[pClass];
+  rateClient *client = find(pIP, pMillis);
+  unsigned long elapsed = pMillis - client->refilledAt[pClass];
+  if (client->tokens[pClass] >= budget.burst) {
+    client->refilledAt[pClass] = pMillis;
+  } else if (elapsed >= budget.refillMillis) {
+    unsigned long earned = elapsed / budget.refillMillis;
+    if (client->tokens[pClass] + earned >= budget.burst) {
+      client->tokens[pClass] = budget.burst;
+      client->refilledAt[pClass] = pMillis;
+    } else {
+      client->tokens[pClass] += earned;
+      client->refilledAt[pClass] += earned * budget.refillMillis;
+    }
+  }
+  if (client->tokens[pClass] == 0) {
+    _limited[pClass]++;
+    return budget.refillMillis - (pMillis - client->refilledAt[pClass]);
+  }
+  client->tokens[pClass]--;
+  _admitted[pClass]++;
+  return 0;
+}
+
+uint32_t RateLimiter::admitted(uint8_t pClass) {
+  return pClass < RATELIMIT_CLASSES ? _admitted[pClass] : 0;
+}
+
+uint32_t RateLimiter::limited(uint8_t pClass) {
+  return pClass < RATELIMIT_CLASSES ? _limited[pClass] : 0;
+}
+
+uint32_t RateLimiter::evictions() {
+  return _evictions;
+}
+
+//Requests charged to the overflow bucket because every slot was busy
+uint32_t RateLimiter::shared() {
+  return _shared;
+}
+
+uint8_t RateLimiter::clients() {
+  return _count;
+}
+
+//pIP's buckets. A new client starts with full buckets, in place of the quietest if the table is full
+//and that one's buckets would have refilled by now anyway. Otherwise it draws on the overflow
+//bucket, so a flood from rotating addresses gets no more than one client's budget past the table
+rateClient *RateLimiter::find(uint32_t pIP, unsigned long pMillis) {
+  rateClient *client = NULL;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_clients[i].ip == pIP) {
+      _clients[i].lastSeen = pMillis;
+      return &_clients[i];
+    }
+    if (client == NULL || pMillis - _clients[i].lastSeen > pMillis - client->lastSeen) {
+      client = &_clients[i];
+    }
+  }
+  if (_count < RATELIMIT_CLIENTS) {
+    client = &_clients[_count++];
+  } else if (pMillis - client->lastSeen >= _refillAllMillis) {
+    _evictions++;
+  } else {
+    _shared++;
+    return &_overflow;
+  }
+  client->ip = pIP;
+  client->lastSeen = pMillis;
+  for (uint8_t i = 0; i < RATELIMIT_CLASSES; i++) {
+    client->tokens[i] = _budgets[i].burst;
+    client->refilledAt[i] = pMillis;
+  }
+  return client;
+}
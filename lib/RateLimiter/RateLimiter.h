@@ -0,0 +1,53 @@
+#ifndef __RATELIMITER_H__
+#define __RATELIMITER_H__
+
+
+#include <Arduino.h>
+
+//Sizing. A client beyond RATELIMIT_CLIENTS takes the slot of the one heard from least recently,
+//once that one has been quiet long enough to refill, and otherwise shares one overflow bucket
+const uint8_t RATELIMIT_CLIENTS = 8;
+const uint8_t RATELIMIT_CLASSES = 2;
+//Class of a request that is never limited
+const uint8_t RATELIMIT_NONE = 0xFF;
+
+//Up to burst requests at once, then one more every refillMillis
+struct rateBudget {
+  uint16_t burst;
+  unsigned long refillMillis;
+};
+
+struct rateClient {
+  uint32_t ip;
+  unsigned long lastSeen;
+  uint16_t tokens[RATELIMIT_CLASSES];
+  unsigned long refilledAt[RATELIMIT_CLASSES];
+};
+
+//Token bucket per client IP and request class. Whole tokens and millis() only, so the same
+//requests at the same times always get the same answers
+class RateLimiter {
+  public:
+    RateLimiter();
+    void setBudget(uint8_t pClass, uint16_t pBurst, unsigned long pRefillMillis);
+    unsigned long take(uint32_t pIP, uint8_t pClass, unsigned long pMillis);
+    uint32_t admitted(uint8_t pClass);
+    uint32_t limited(uint8_t pClass);
+    uint32_t evictions();
+    uint32_t shared();
+    uint8_t clients();
+  private:
+    rateClient *find(uint32_t pIP, unsigned long pMillis);
+    rateBudget _budgets[RATELIMIT_CLASSES];
+    rateClient _clients[RATELIMIT_CLIENTS];
+    rateClient _overflow;
+    uint8_t _count;
+    unsigned long _refillAllMillis;
+    uint32_t _admitted[RATELIMIT_CLASSES];
+    uint32_t _limited[RATELIMIT_CLASSES];
+    uint32_t _evictions;
+    uint32_t _shared;
+};
+
+
+#endif // __RATELIMITER_H__
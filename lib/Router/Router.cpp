@@ -0,0 +1,162 @@
+#include <Router.h>
+
+Router::Router(const route *pRoutes, const routeIndex *pIndex) {
+  _routes = pRoutes;
+  _index = pIndex;
+  _seed = pgm_read_dword(&pIndex->seed);
+  _limiter = NULL;
+  _profiler = NULL;
+  _fallbackClass = RATELIMIT_NONE;
+  _fallback = NULL;
+  _upload = NULL;
+  _uploadWait = 0;
+}
+
+void Router::setLimiter(RateLimiter *pLimiter) {
+  _limiter = pLimiter;
+}
+
+//Allocations made by each handler are charged to its path
+void Router::setProfiler(HeapProfiler *pProfiler) {
+  _profiler = pProfiler;
+}
+
+//Paths not in the table, charged to pRateClass and profiled together as ROUTER_FALLBACK_SITE
+void Router::setFallback(uint8_t pRateClass, void (*pOnRequest)(AsyncWebServerRequest *request)) {
+  _fallbackClass = pRateClass;
+  _fallback = pOnRequest;
+}
+
+bool Router::canHandle(AsyncWebServerRequest *request) {
+  route found;
+  return find(request, found) || _fallback != NULL;
+}
+
+void Router::handleRequest(AsyncWebServerRequest *request) {
+  route found;
+  unsigned long wait = 0;
+  if (!find(request, found)) {
+    if (_fallback == NULL) {
+      return;
+    }
+    found.path = ROUTER_FALLBACK_SITE;
+    found.rateClass = _fallbackClass;
+    found.onRequest = _fallback;
+    found.onUpload = NULL;
+  }
+  if (found.onRequest == NULL) {
+    return;
+  }
+  if (request == _upload) {
+    wait = _uploadWait;
+    _upload = NULL;
+  } else if (_limiter != NULL && found.rateClass != RATELIMIT_NONE) {
+    wait = _limiter->take(request->client()->remoteIP(), found.rateClass, millis());
+  }
+  if (wait > 0) {
+    AsyncWebServerResponse *response = request->beginResponse(429, "text/plain", "Too Many Requests");
+    response->addHeader("Retry-After", String((wait + 999) / 1000));
+    request->send(response);
+    return;
+  }
+  if (_profiler != NULL) {
+    heapScope scope(*_profiler, found.path);
+    found.onRequest(request);
+    return;
+  }
+  found.onRequest(request);
+}
+
+//An upload is charged as it starts, before anything is written, and a refused one goes no further.
+//Its request then answers with that wait rather than taking another token
+void Router::handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {
+  route found;
+  if (!find(request, found) || found.onUpload == NULL) {
+    return;
+  }
+  if (index == 0) {
+    _upload = request;
+    _uploadWait = 0;
+    if (_limiter != NULL && found.rateClass != RATELIMIT_NONE) {
+      _uploadWait = _limiter->take(request->client()->remoteIP(), found.rateClass, millis());
+    }
+  }
+  if (request == _upload && _uploadWait > 0) {
+    return;
+  }
+  found.onUpload(request, filename, index, data, len, final);
+}
+
+//Routed requests all have a handler that reads their arguments
+bool Router::isRequestHandlerTrivial() {
+  return false;
+}
+
+//The only route the path can be is the one in its slot
+bool Router::find(AsyncWebServerRequest *request, route &pRoute) {
+  uint8_t i = pgm_read_byte(&_index->slot[routeSlot(request->url().c_str(), _seed)]);
+  if (i == ROUTER_EMPTY) {
+    return false;
+  }
+  memcpy_P(&pRoute, &_routes[i], sizeof(route));
+  return strcmp(pRoute.path, request->url().c_str()) == 0 && (pRoute.method & request->method()) != 0;
+}
+
+//Read every argument named in pFields into pArgs in one pass over the request. Unnamed arguments
+//are ignored and fields not given keep what pArgs already held. On a missing or bad argument
+//pError says which and false is returned, with pArgs part filled
+bool parseArgs(AsyncWebServerRequest *request, const argField *pFields, uint8_t pCount, void *pArgs, String &pError) {
+  argField field;
+  uint32_t seen = 0;
+  for (size_t i = 0; i < request->params(); i++) {
+    AsyncWebParameter *param = request->getParam(i);
+    uint8_t f;
+    if (param->isFile()) {
+      continue;
+    }
+    for (f = 0; f < pCount; f++) {
+      memcpy_P(&field, &pFields[f], sizeof(field));
+      if (param->name() == field.name) {
+        break;
+      }
+    }
+    if (f == pCount) {
+      continue;
+    }
+    seen |= 1UL << f;
+    const String &value = param->value();
+    uint8_t *target = (uint8_t*)pArgs + field.offset;
+    if ((field.type & ~ARG_REQUIRED) == ARG_TEXT) {
+      if ((int32_t)value.length() < field.min || (int32_t)value.length() > field.max || value.length() >= field.size) {
+        pError = String(field.name) + " must be " + field.min + " to " + field.max + " characters";
+        return false;
+      }
+      memset(target, 0, field.size);
+      memcpy(target, value.c_str(), value.length());
+      continue;
+    }
+    char *end;
+    long number = strtol(value.c_str(), &end, 10);
+    if (value.length() == 0 || *end != '\0' || number < field.min || number > field.max) {
+      pError = String(field.name) + " must be a number from " + field.min + " to " + field.max;
+      return false;
+    }
+    if (field.size == 1) {
+      *target = (uint8_t)number;
+    } else if (field.size == 2) {
+      uint16_t narrow = (uint16_t)number;
+      memcpy(target, &narrow, sizeof(narrow));
+    } else {
+      int32_t wide = (int32_t)number;
+      memcpy(target, &wide, sizeof(wide));
+    }
+  }
+  for (uint8_t f = 0; f < pCount; f++) {
+    memcpy_P(&field, &pFields[f], sizeof(field));
+    if ((field.type & ARG_REQUIRED) != 0 && (seen & (1UL << f)) == 0) {
+      pError = String(field.name) + " is required";
+      return false;
+    }
+  }
+  return true;
+}
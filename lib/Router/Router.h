@@ -0,0 +1,121 @@
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <RateLimiter.h>
+#include <HeapProfiler.h>
+#include <stddef.h>
+
+//Sizing. There are plenty more slots than routes, so a perfect hash seed turns up quickly
+const uint8_t ROUTER_SLOT_BITS = 6;
+const uint8_t ROUTER_SLOTS = 1 << ROUTER_SLOT_BITS;
+const uint8_t ROUTER_EMPTY = 0xFF;
+const uint32_t ROUTER_SEEDS = 4096;
+const uint32_t ROUTER_NO_SEED = 0xFFFFFFFF;
+//Heap profiler site of requests for paths not in the table
+const char ROUTER_FALLBACK_SITE[] = "files";
+
+//A page or action. Paths are matched exactly. rateClass is the RateLimiter class it draws on
+struct route {
+  const char *path;
+  WebRequestMethodComposite method;
+  uint8_t rateClass;
+  void (*onRequest)(AsyncWebServerRequest *request);
+  void (*onUpload)(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
+};
+
+//Slot to route, found at compile time by indexRoutes()
+struct routeIndex {
+  uint32_t seed;
+  uint8_t slot[ROUTER_SLOTS];
+};
+
+//FNV-1a, seeded
+constexpr uint32_t routeHash(const char *pPath, uint32_t pSeed) {
+  uint32_t hash = 2166136261u ^ pSeed;
+  for (; *pPath != '\0'; pPath++) {
+    hash = (hash ^ (uint8_t)*pPath) * 16777619u;
+  }
+  return hash;
+}
+
+//The low bits of FNV only ever see the low bits of the seed, so slots come from the top
+constexpr uint8_t routeSlot(const char *pPath, uint32_t pSeed) {
+  return routeHash(pPath, pSeed) >> (32 - ROUTER_SLOT_BITS);
+}
+
+//Try seeds until every path lands in a slot of its own. The seed is ROUTER_NO_SEED if none does
+template <size_t N>
+constexpr routeIndex indexRoutes(const route (&pRoutes)[N]) {
+  static_assert(N < ROUTER_EMPTY && N <= ROUTER_SLOTS, "Too many routes for ROUTER_SLOTS");
+  routeIndex index = { ROUTER_NO_SEED, {} };
+  for (uint32_t seed = 0; seed < ROUTER_SEEDS; seed++) {
+    bool clash = false;
+    for (uint8_t i = 0; i < ROUTER_SLOTS; i++) {
+      index.slot[i] = ROUTER_EMPTY;
+    }
+    for (uint8_t i = 0; i < N && !clash; i++) {
+      uint8_t slot = routeSlot(pRoutes[i].path, seed);
+      clash = index.slot[slot] != ROUTER_EMPTY;
+      index.slot[slot] = i;
+    }
+    if (!clash) {
+      index.seed = seed;
+      return index;
+    }
+  }
+  return index;
+}
+
+//Dispatches every routed request with one hash and one string compare, in place of a handler per
+//route that the server asks in turn. The route table and its index live in flash.
+//With a limiter, a client out of tokens gets a 429 and the handler never runs. A fallback takes every
+//other request, drawing on its own class, so no path escapes the limiter
+class Router : public AsyncWebHandler {
+  public:
+    Router(const route *pRoutes, const routeIndex *pIndex);
+    void setLimiter(RateLimiter *pLimiter);
+    void setProfiler(HeapProfiler *pProfiler);
+    void setFallback(uint8_t pRateClass, void (*pOnRequest)(AsyncWebServerRequest *request));
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) override;
+    bool isRequestHandlerTrivial() override;
+  private:
+    bool find(AsyncWebServerRequest *request, route &pRoute);
+    const route *_routes;
+    const routeIndex *_index;
+    uint32_t _seed;
+    RateLimiter *_limiter;
+    HeapProfiler *_profiler;
+    uint8_t _fallbackClass;
+    void (*_fallback)(AsyncWebServerRequest *request);
+    //The upload last started, and what its client was told to wait
+    AsyncWebServerRequest *_upload;
+    unsigned long _uploadWait;
+};
+
+//Argument types for parseArgs(). Numbers are range checked, text is length checked
+const uint8_t ARG_NUMBER = 1;
+const uint8_t ARG_TEXT = 2;
+const uint8_t ARG_REQUIRED = 0x80;
+
+//Where one query argument goes in an argument struct. Numbers fill a 1, 2 or 4 byte integer
+struct argField {
+  const char *name;
+  uint8_t type;
+  uint16_t offset;
+  uint16_t size;
+  int32_t min;
+  int32_t max;
+};
+
+#define ARG_FIELD(pStruct, pMember, pName, pType, pMin, pMax) \
+  { pName, pType, offsetof(pStruct, pMember), sizeof(((pStruct*)0)->pMember), pMin, pMax }
+
+bool parseArgs(AsyncWebServerRequest *request, const argField *pFields, uint8_t pCount, void *pArgs, String &pError);
+
+
+#endif // __ROUTER_H__
@@ -0,0 +1,108 @@
+#include <Scheduler.h>
+
+//Tasks past SCHEDULER_TASKS are never run. pTickBudget is how long one tick keeps starting
+//non-critical tasks; the first always starts, so every tick makes progress
+Scheduler::Scheduler(const schedulerTask *pTasks, uint8_t pCount, uint32_t pTickBudget) {
+  _tasks = pTasks;
+  _count = pCount < SCHEDULER_TASKS ? pCount : SCHEDULER_TASKS;
+  _tickBudget = pTickBudget;
+  _ticks = 0;
+  memset(_stats, 0, sizeof(_stats));
+}
+
+//One pass, called from loop(). Returning lets the SDK in, so the budget bounds the network's wait too
+void Scheduler::tick() {
+  uint32_t start = micros();
+  uint32_t ran = 0;
+  int8_t pick;
+  _ticks++;
+  runCritical(true);
+  while ((pick = next(ran, micros())) >= 0) {
+    if (ran != 0 && (uint32_t)micros() - start >= _tickBudget) {
+      break;
+    }
+    run(pick);
+    ran |= 1UL << pick;
+    runCritical(false);
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((ran & (1UL << i)) != 0) {
+      _stats[i].skips = 0;
+    } else if (_tasks[i].priority != TASK_CRITICAL && due(i, micros()) && _stats[i].skips < SCHEDULER_MAX_SKIPS) {
+      _stats[i].skips++;
+    }
+  }
+}
+
+uint8_t Scheduler::count() {
+  return _count;
+}
+
+const schedulerTask &Scheduler::task(uint8_t pIndex) {
+  return _tasks[pIndex];
+}
+
+const taskStats &Scheduler::stats(uint8_t pIndex) {
+  return _stats[pIndex];
+}
+
+uint32_t Scheduler::ticks() {
+  return _ticks;
+}
+
+//Start the stats again, e.g. once booting is over. Gaps are measured from the next run
+void Scheduler::resetStats() {
+  memset(_stats, 0, sizeof(_stats));
+  _ticks = 0;
+}
+
+void Scheduler::run(uint8_t pIndex) {
+  taskStats &stats = _stats[pIndex];
+  uint32_t start = micros();
+  if (stats.runs > 0 && start - stats.endedAt > stats.worstGap) {
+    stats.worstGap = start - stats.endedAt;
+  }
+  stats.startedAt = start;
+  _tasks[pIndex].run();
+  stats.endedAt = micros();
+  uint32_t took = stats.endedAt - start;
+  stats.runs++;
+  stats.micros += took;
+  if (took > stats.longest) {
+    stats.longest = took;
+  }
+  if (_tasks[pIndex].budget > 0 && took > _tasks[pIndex].budget) {
+    stats.overruns++;
+  }
+}
+
+//Every critical task, or only those whose period is up
+void Scheduler::runCritical(bool pAll) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_tasks[i].priority == TASK_CRITICAL && (pAll || due(i, micros()))) {
+      run(i);
+    }
+  }
+}
+
+//The due task to run next: one passed over too often, else the lowest priority number, else the
+//first in the table. -1 when nothing not yet run this tick is due
+int8_t Scheduler::next(uint32_t pRan, uint32_t pNow) {
+  int8_t pick = -1;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_tasks[i].priority == TASK_CRITICAL || (pRan & (1UL << i)) != 0 || !due(i, pNow)) {
+      continue;
+    }
+    if (_stats[i].skips >= SCHEDULER_MAX_SKIPS) {
+      return i;
+    }
+    if (pick < 0 || _tasks[i].priority < _tasks[pick].priority) {
+      pick = i;
+    }
+  }
+  return pick;
+}
+
+bool Scheduler::due(uint8_t pIndex, uint32_t pNow) {
+  return _stats[pIndex].runs == 0 || pNow - _stats[pIndex].startedAt >= _tasks[pIndex].period;
+}
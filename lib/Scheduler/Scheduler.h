@@ -0,0 +1,61 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+
+#include <Arduino.h>
+
+//Sizing. A due task passed over for SCHEDULER_MAX_SKIPS ticks in a row goes first in the next one
+const uint8_t SCHEDULER_TASKS = 16;
+const uint8_t SCHEDULER_MAX_SKIPS = 8;
+
+//Critical tasks run at the start of every tick and again between other tasks once their period is up.
+//Everything else runs in priority order, lowest number first, while the tick's budget lasts
+const uint8_t TASK_CRITICAL = 0;
+
+//A task is one step of a resumable service function: it does a bounded piece of work and returns.
+//Times are microseconds. A period of 0 is every tick. Runs longer than budget are counted, not cut short
+struct schedulerTask {
+  const char *name;
+  uint8_t priority;
+  uint32_t period;
+  uint32_t budget;
+  void (*run)();
+};
+
+//Worst gap is the longest a task waited from the end of one run to the start of the next
+struct taskStats {
+  uint32_t runs;
+  uint64_t micros;
+  uint32_t longest;
+  uint32_t overruns;
+  uint32_t worstGap;
+  uint32_t startedAt;
+  uint32_t endedAt;
+  uint8_t skips;
+};
+
+//Runs a fixed task table cooperatively from loop(). Nothing is preempted, so the longest a critical
+//task can wait is its period plus the longest single run of any other task, which the stats show
+class Scheduler {
+  public:
+    Scheduler(const schedulerTask *pTasks, uint8_t pCount, uint32_t pTickBudget);
+    void tick();
+    uint8_t count();
+    const schedulerTask &task(uint8_t pIndex);
+    const taskStats &stats(uint8_t pIndex);
+    uint32_t ticks();
+    void resetStats();
+  private:
+    void run(uint8_t pIndex);
+    void runCritical(bool pAll);
+    int8_t next(uint32_t pRan, uint32_t pNow);
+    bool due(uint8_t pIndex, uint32_t pNow);
+    const schedulerTask *_tasks;
+    uint8_t _count;
+    uint32_t _tickBudget;
+    taskStats _stats[SCHEDULER_TASKS];
+    uint32_t _ticks;
+};
+
+
+#endif // __SCHEDULER_H__
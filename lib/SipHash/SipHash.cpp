@@ -0,0 +1,110 @@
+#include <SipHash.h>
+
+namespace {
+  inline uint64_t rotate(uint64_t pValue, uint8_t pBits) {
+    return (pValue << pBits) | (pValue >> (64 - pBits));
+  }
+
+  inline uint64_t readLE(const uint8_t *pBytes, uint8_t pLength) {
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < pLength; i++) {
+      value |= (uint64_t)pBytes[i] << (8 * i);
+    }
+    return value;
+  }
+
+  inline void sipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+    v0 += v1;
+    v1 = rotate(v1, 13);
+    v1 ^= v0;
+    v0 = rotate(v0, 32);
+    v2 += v3;
+    v3 = rotate(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotate(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotate(v1, 17);
+    v1 ^= v2;
+    v2 = rotate(v2, 32);
+  }
+
+  //One message word, with SipHash-2-4's two rounds
+  inline void compress(sipState &pState, uint64_t pWord) {
+    pState.v3 ^= pWord;
+    sipRound(pState.v0, pState.v1, pState.v2, pState.v3);
+    sipRound(pState.v0, pState.v1, pState.v2, pState.v3);
+    pState.v0 ^= pWord;
+  }
+
+  //Compares every byte whatever the first difference, so timing says nothing about the tag
+  bool tagsMatch(uint64_t pExpected, const uint8_t *pTag) {
+    uint8_t difference = 0;
+    for (uint8_t i = 0; i < SIPHASH_TAG_LENGTH; i++) {
+      difference |= (uint8_t)(pExpected >> (8 * i)) ^ pTag[i];
+    }
+    return difference == 0;
+  }
+}
+
+uint64_t sipHash(const uint8_t *pKey, const uint8_t *pData, size_t pLength) {
+  sipState state;
+  sipBegin(state, pKey);
+  sipAdd(state, pData, pLength);
+  return sipFinish(state);
+}
+
+void sipTag(const uint8_t *pKey, const uint8_t *pData, size_t pLength, uint8_t *pTag) {
+  uint64_t tag = sipHash(pKey, pData, pLength);
+  for (uint8_t i = 0; i < SIPHASH_TAG_LENGTH; i++) {
+    pTag[i] = tag >> (8 * i);
+  }
+}
+
+bool sipVerify(const uint8_t *pKey, const uint8_t *pData, size_t pLength, const uint8_t *pTag) {
+  return tagsMatch(sipHash(pKey, pData, pLength), pTag);
+}
+
+void sipBegin(sipState &pState, const uint8_t *pKey) {
+  uint64_t k0 = readLE(pKey, 8);
+  uint64_t k1 = readLE(pKey + 8, 8);
+  pState.v0 = k0 ^ 0x736f6d6570736575ULL;
+  pState.v1 = k1 ^ 0x646f72616e646f6dULL;
+  pState.v2 = k0 ^ 0x6c7967656e657261ULL;
+  pState.v3 = k1 ^ 0x7465646279746573ULL;
+  pState.tailLength = 0;
+  pState.length = 0;
+}
+
+//Whole words go straight through; a partial one waits in tail for the next piece
+void sipAdd(sipState &pState, const uint8_t *pData, size_t pLength) {
+  size_t i = 0;
+  pState.length += (uint8_t)pLength;
+  while (pState.tailLength > 0 && pState.tailLength < 8 && i < pLength) {
+    pState.tail[pState.tailLength++] = pData[i++];
+  }
+  if (pState.tailLength == 8) {
+    compress(pState, readLE(pState.tail, 8));
+    pState.tailLength = 0;
+  }
+  for (; i + 8 <= pLength; i += 8) {
+    compress(pState, readLE(pData + i, 8));
+  }
+  for (; i < pLength; i++) {
+    pState.tail[pState.tailLength++] = pData[i];
+  }
+}
+
+uint64_t sipFinish(sipState &pState) {
+  compress(pState, readLE(pState.tail, pState.tailLength) | ((uint64_t)pState.length << 56));
+  pState.v2 ^= 0xFF;
+  for (uint8_t i = 0; i < 4; i++) {
+    sipRound(pState.v0, pState.v1, pState.v2, pState.v3);
+  }
+  return pState.v0 ^ pState.v1 ^ pState.v2 ^ pState.v3;
+}
+
+bool sipFinishVerify(sipState &pState, const uint8_t *pTag) {
+  return tagsMatch(sipFinish(pState), pTag);
+}
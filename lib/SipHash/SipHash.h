@@ -0,0 +1,36 @@
+#ifndef __SIPHASH_H__
+#define __SIPHASH_H__
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Sizing
+const uint8_t SIPHASH_KEY_LENGTH = 16;
+const uint8_t SIPHASH_TAG_LENGTH = 8;
+
+//SipHash-2-4: a keyed 64 bit tag, cheap enough to check every datagram on the ESP8266.
+//The tag is written and compared little-endian, as sent on the wire
+uint64_t sipHash(const uint8_t *pKey, const uint8_t *pData, size_t pLength);
+void sipTag(const uint8_t *pKey, const uint8_t *pData, size_t pLength, uint8_t *pTag);
+bool sipVerify(const uint8_t *pKey, const uint8_t *pData, size_t pLength, const uint8_t *pTag);
+
+//The same tag over data that arrives in pieces, such as an upload: sipBegin(), sipAdd() for each
+//piece, then sipFinish() or sipFinishVerify()
+struct sipState {
+  uint64_t v0;
+  uint64_t v1;
+  uint64_t v2;
+  uint64_t v3;
+  uint8_t tail[8];
+  uint8_t tailLength;
+  uint8_t length;
+};
+
+void sipBegin(sipState &pState, const uint8_t *pKey);
+void sipAdd(sipState &pState, const uint8_t *pData, size_t pLength);
+uint64_t sipFinish(sipState &pState);
+bool sipFinishVerify(sipState &pState, const uint8_t *pTag);
+
+
+#endif // __SIPHASH_H__
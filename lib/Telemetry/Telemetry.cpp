@@ -0,0 +1,235 @@
+#include <Telemetry.h>
+
+Telemetry::Telemetry(AsyncMqttClient &pClient) : _client(pClient) {
+  _prefix[0] = '\0';
+  _eventTopic[0] = '\0';
+  _onlineTopic[0] = '\0';
+  _host[0] = '\0';
+  _statusCount = 0;
+  _head = 0;
+  _count = 0;
+  _oldestAt = 0;
+  _batchId = 0;
+  _batchCount = 0;
+  _backlog = false;
+  _connecting = false;
+  _lost = false;
+  _leaving = false;
+  _retryAt = 0;
+  _backoff = TELEMETRY_BACKOFF_MIN;
+  _published = 0;
+  _dropped = 0;
+  _attempts = 0;
+}
+
+//Topics all hang off pPrefix, which doubles as the client id. The broker marks us offline if we vanish
+void Telemetry::begin(const char *pPrefix) {
+  strncpy(_prefix, pPrefix, sizeof(_prefix) - 1);
+  _prefix[sizeof(_prefix) - 1] = '\0';
+  snprintf(_eventTopic, sizeof(_eventTopic), "%s/events", _prefix);
+  snprintf(_onlineTopic, sizeof(_onlineTopic), "%s/online", _prefix);
+  _statusCount = 0;
+  _client.setClientId(_prefix);
+  _client.setWill(_onlineTopic, 1, true, "false");
+  _client.onConnect([this](bool pSessionPresent) { connected(pSessionPresent); });
+  _client.onDisconnect([this](AsyncMqttClientDisconnectReason) { disconnected(); });
+  _client.onPublish([this](uint16_t pPacketId) { acked(pPacketId); });
+}
+
+//An empty host turns telemetry off. A new broker is tried straight away
+void Telemetry::setBroker(const char *pHost, uint16_t pPort) {
+  strncpy(_host, pHost, sizeof(_host) - 1);
+  _host[sizeof(_host) - 1] = '\0';
+  _client.setServer(_host, pPort);
+  _backoff = TELEMETRY_BACKOFF_MIN;
+  _retryAt = millis();
+  if (_client.connected()) {
+    _leaving = true;
+    _client.disconnect();
+  }
+  if (!enabled()) {
+    _head = 0;
+    _count = 0;
+    _batchId = 0;
+  }
+}
+
+//Returns the slot to pass to setStatus()
+uint8_t Telemetry::addStatus(const char *pName) {
+  if (_statusCount == TELEMETRY_STATUS_TOPICS) {
+    return TELEMETRY_STATUS_TOPICS - 1;
+  }
+  telemetryStatus &status = _status[_statusCount];
+  snprintf(status.topic, sizeof(status.topic), "%s/%s", _prefix, pName);
+  status.value = "";
+  status.dirty = false;
+  status.packetId = 0;
+  return _statusCount++;
+}
+
+void Telemetry::setStatus(uint8_t pStatus, const String &pValue) {
+  if (pStatus >= _statusCount || _status[pStatus].value == pValue) {
+    return;
+  }
+  _status[pStatus].value = pValue;
+  _status[pStatus].dirty = true;
+}
+
+//Queue an event for the next batch. When the queue is full the new event is dropped,
+//so the batch in flight at the head is never disturbed
+void Telemetry::queueEvent(const eventRecord &pRecord) {
+  if (!enabled()) {
+    return;
+  }
+  if (_count == TELEMETRY_QUEUE) {
+    _dropped++;
+    return;
+  }
+  if (_count == 0) {
+    _oldestAt = millis();
+  }
+  _queue[(_head + _count) % TELEMETRY_QUEUE] = pRecord;
+  _count++;
+}
+
+//Call every loop. Only ever starts work the client does in the background
+void Telemetry::service(unsigned long pMillis) {
+  if (!enabled()) {
+    return;
+  }
+  if (_lost) {
+    _lost = false;
+    _retryAt = pMillis + _backoff;
+    _backoff = _backoff * 2 > TELEMETRY_BACKOFF_MAX ? TELEMETRY_BACKOFF_MAX : _backoff * 2;
+  }
+  if (!_client.connected()) {
+    if (!_connecting && (long)(pMillis - _retryAt) >= 0) {
+      _connecting = true;
+      _attempts++;
+      _client.connect();
+    }
+    return;
+  }
+  publishStatus();
+  publishEvents(pMillis);
+}
+
+bool Telemetry::enabled() {
+  return _host[0] != '\0';
+}
+
+bool Telemetry::connected() {
+  return _client.connected();
+}
+
+uint16_t Telemetry::queued() {
+  return _count;
+}
+
+uint32_t Telemetry::published() {
+  return _published;
+}
+
+uint32_t Telemetry::dropped() {
+  return _dropped;
+}
+
+uint32_t Telemetry::attempts() {
+  return _attempts;
+}
+
+unsigned long Telemetry::backoff() {
+  return _backoff;
+}
+
+//Anything that was in flight went with the old session, so start over
+void Telemetry::connected(bool) {
+  _connecting = false;
+  _backoff = TELEMETRY_BACKOFF_MIN;
+  _batchId = 0;
+  _backlog = _count > 0;
+  for (uint8_t i = 0; i < _statusCount; i++) {
+    _status[i].dirty = _status[i].value.length() > 0;
+    _status[i].packetId = 0;
+  }
+  _client.publish(_onlineTopic, 1, true, "true");
+}
+
+//Covers both a failed connect and a lost connection. The retry is scheduled from service(), except
+//after leaving the old broker in setBroker(), which has already asked for one straight away
+void Telemetry::disconnected() {
+  _connecting = false;
+  _lost = !_leaving;
+  _leaving = false;
+  _batchId = 0;
+}
+
+void Telemetry::acked(uint16_t pPacketId) {
+  if (pPacketId == _batchId) {
+    _head = (_head + _batchCount) % TELEMETRY_QUEUE;
+    _count -= _batchCount;
+    _published += _batchCount;
+    _batchId = 0;
+    _backlog = _count > 0;
+    return;
+  }
+  for (uint8_t i = 0; i < _statusCount; i++) {
+    if (_status[i].packetId == pPacketId) {
+      _status[i].packetId = 0;
+    }
+  }
+}
+
+//A topic still in flight waits for its ack, so only the latest of several changes goes out
+void Telemetry::publishStatus() {
+  for (uint8_t i = 0; i < _statusCount; i++) {
+    telemetryStatus &status = _status[i];
+    if (!status.dirty || status.packetId != 0) {
+      continue;
+    }
+    uint16_t packetId = _client.publish(status.topic, 1, true, status.value.c_str(), status.value.length());
+    if (packetId == 0) {
+      return;
+    }
+    status.packetId = packetId;
+    status.dirty = false;
+  }
+}
+
+//Send the head of the queue as one JSON array once a batch has filled or waited long enough
+void Telemetry::publishEvents(unsigned long pMillis) {
+  char payload[TELEMETRY_BATCH * TELEMETRY_EVENT_LENGTH + 2];
+  size_t length = 0;
+  uint16_t n;
+  if (_batchId != 0 || _count == 0) {
+    return;
+  }
+  if (_count < TELEMETRY_BATCH && !_backlog && pMillis - _oldestAt < TELEMETRY_BATCH_MILLIS) {
+    return;
+  }
+  payload[length++] = '[';
+  for (n = 0; n < _count && n < TELEMETRY_BATCH; n++) {
+    const eventRecord &record = _queue[(_head + n) % TELEMETRY_QUEUE];
+    int written = snprintf(payload + length, TELEMETRY_EVENT_LENGTH,
+      "%s{\"seq\":%u,\"time\":%u,\"type\":\"%s\",\"code\":%u,\"detail\":%u,\"value\":%d}", n > 0 ? "," : "",
+      record.seq, record.time, record.type <= EVENT_CONFIG ? EVENT_TYPE_NAME[record.type] : "unknown",
+      record.code, record.detail, record.value);
+    //An event that didn't fit waits for the next batch
+    if (written < 0 || (size_t)written >= TELEMETRY_EVENT_LENGTH) {
+      break;
+    }
+    length += written;
+  }
+  if (n == 0) {
+    return;
+  }
+  payload[length++] = ']';
+  payload[length] = '\0';
+  uint16_t packetId = _client.publish(_eventTopic, 1, false, payload, length);
+  if (packetId == 0) {
+    return;
+  }
+  _batchId = packetId;
+  _batchCount = n;
+  _backlog = false;
+}
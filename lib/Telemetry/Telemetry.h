@@ -0,0 +1,83 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+
+#include <Arduino.h>
+#include <AsyncMqttClient.h>
+#include <EventLog.h>
+
+//Sizing. Events wait in a bounded queue and go out TELEMETRY_BATCH to a message
+const uint8_t TELEMETRY_QUEUE = 32;
+const uint8_t TELEMETRY_BATCH = 8;
+const uint8_t TELEMETRY_STATUS_TOPICS = 5;
+const uint8_t TELEMETRY_PREFIX_LENGTH = 24;
+const uint8_t TELEMETRY_TOPIC_LENGTH = 48;
+const uint8_t TELEMETRY_HOST_LENGTH = 32;
+//Longest event in a batch, comma included. Every field at its widest comes to 99 characters
+const size_t TELEMETRY_EVENT_LENGTH = 104;
+//A part filled batch goes once its oldest event has waited this long
+const unsigned long TELEMETRY_BATCH_MILLIS = 2000;
+//Reconnect delay doubles from MIN to MAX while the broker can't be reached
+const unsigned long TELEMETRY_BACKOFF_MIN = 1000;
+const unsigned long TELEMETRY_BACKOFF_MAX = 300000;
+
+//A retained topic. Only the latest value matters, so changes while one is in flight coalesce
+struct telemetryStatus {
+  char topic[TELEMETRY_TOPIC_LENGTH];
+  String value;
+  bool dirty;
+  uint16_t packetId;
+};
+
+//Publishes retained status topics and batches of events to an MQTT broker without ever waiting on it.
+//Everything goes at QoS 1. One event batch is in flight at a time and leaves the queue only when
+//the broker acks it, so a dropped connection resends rather than loses it. A publish the client
+//has no room for is retried on a later service()
+class Telemetry {
+  public:
+    Telemetry(AsyncMqttClient &pClient);
+    void begin(const char *pPrefix);
+    void setBroker(const char *pHost, uint16_t pPort);
+    uint8_t addStatus(const char *pName);
+    void setStatus(uint8_t pStatus, const String &pValue);
+    void queueEvent(const eventRecord &pRecord);
+    void service(unsigned long pMillis);
+    bool enabled();
+    bool connected();
+    uint16_t queued();
+    uint32_t published();
+    uint32_t dropped();
+    uint32_t attempts();
+    unsigned long backoff();
+  private:
+    void connected(bool pSessionPresent);
+    void disconnected();
+    void acked(uint16_t pPacketId);
+    void publishStatus();
+    void publishEvents(unsigned long pMillis);
+    AsyncMqttClient &_client;
+    char _prefix[TELEMETRY_PREFIX_LENGTH];
+    char _eventTopic[TELEMETRY_TOPIC_LENGTH];
+    char _onlineTopic[TELEMETRY_TOPIC_LENGTH];
+    char _host[TELEMETRY_HOST_LENGTH];
+    telemetryStatus _status[TELEMETRY_STATUS_TOPICS];
+    uint8_t _statusCount;
+    eventRecord _queue[TELEMETRY_QUEUE];
+    uint16_t _head;
+    uint16_t _count;
+    unsigned long _oldestAt;
+    uint16_t _batchId;
+    uint16_t _batchCount;
+    bool _backlog;
+    bool _connecting;
+    bool _lost;
+    bool _leaving;
+    unsigned long _retryAt;
+    unsigned long _backoff;
+    uint32_t _published;
+    uint32_t _dropped;
+    uint32_t _attempts;
+};
+
+
+#endif // __TELEMETRY_H__
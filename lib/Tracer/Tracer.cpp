@@ -0,0 +1,74 @@
+#include <Tracer.h>
+
+Tracer::Tracer() {
+  _nextSeq = 0;
+  _stallMicros = 0;
+  _freezeSeq = 0;
+  _freezing = false;
+  _stalls = 0;
+  _longest = 0;
+}
+
+//Keep a finished span. Nothing is kept while frozen
+void Tracer::record(const char *pName, uint32_t pStart, uint32_t pEnd) {
+  uint32_t duration = pEnd - pStart;
+  if (frozen()) {
+    return;
+  }
+  traceSpan &span = _ring[_nextSeq % TRACER_SPANS];
+  span.name = pName;
+  span.start = pStart;
+  span.duration = duration;
+  _nextSeq++;
+  if (duration > _longest) {
+    _longest = duration;
+  }
+  if (_stallMicros > 0 && duration >= _stallMicros && !_freezing) {
+    _stalls++;
+    _freezing = true;
+    _freezeSeq = _nextSeq + TRACER_SPANS / 2;
+  }
+}
+
+//0 never freezes
+void Tracer::setStallThreshold(uint32_t pMicros) {
+  _stallMicros = pMicros;
+}
+
+bool Tracer::frozen() {
+  return _freezing && _nextSeq >= _freezeSeq;
+}
+
+void Tracer::resume() {
+  _freezing = false;
+}
+
+//Copy spans from pSeq on. Spans already overwritten are skipped; start from firstSeq()
+size_t Tracer::read(uint32_t pSeq, traceSpan *pSpans, size_t pMax) {
+  size_t n = 0;
+  if (pSeq < firstSeq()) {
+    pSeq = firstSeq();
+  }
+  while (pSeq < _nextSeq && n < pMax) {
+    pSpans[n++] = _ring[pSeq % TRACER_SPANS];
+    pSeq++;
+  }
+  return n;
+}
+
+uint32_t Tracer::firstSeq() {
+  return _nextSeq > TRACER_SPANS ? _nextSeq - TRACER_SPANS : 0;
+}
+
+uint32_t Tracer::nextSeq() {
+  return _nextSeq;
+}
+
+uint32_t Tracer::stalls() {
+  return _stalls;
+}
+
+//Longest span seen, in microseconds
+uint32_t Tracer::longest() {
+  return _longest;
+}
@@ -0,0 +1,66 @@
+#ifndef __TRACER_H__
+#define __TRACER_H__
+
+
+#include <Arduino.h>
+
+//Sizing. Spans live in RAM only, the newest overwriting the oldest
+const uint16_t TRACER_SPANS = 128;
+
+//A finished span. Names are string literals, so only the pointer is kept
+struct traceSpan {
+  const char *name;
+  uint32_t start;
+  uint32_t duration;
+};
+
+//Records timed spans into a ring, numbered like the event log so a reader can tell what it missed.
+//A span at least as long as the stall threshold freezes the ring half a ring later, keeping what
+//led up to the stall and what followed it until resume()
+class Tracer {
+  public:
+    Tracer();
+    void record(const char *pName, uint32_t pStart, uint32_t pEnd);
+    void setStallThreshold(uint32_t pMicros);
+    bool frozen();
+    void resume();
+    size_t read(uint32_t pSeq, traceSpan *pSpans, size_t pMax);
+    uint32_t firstSeq();
+    uint32_t nextSeq();
+    uint32_t stalls();
+    uint32_t longest();
+  private:
+    traceSpan _ring[TRACER_SPANS];
+    uint32_t _nextSeq;
+    uint32_t _stallMicros;
+    uint32_t _freezeSeq;
+    bool _freezing;
+    uint32_t _stalls;
+    uint32_t _longest;
+};
+
+//Times the enclosing scope. Use through TRACE_SPAN so it can be compiled out
+class traceScope {
+  public:
+    traceScope(Tracer &pTracer, const char *pName) : _tracer(pTracer), _name(pName), _start(micros()) {}
+    ~traceScope() {
+      _tracer.record(_name, _start, micros());
+    }
+  private:
+    Tracer &_tracer;
+    const char *_name;
+    uint32_t _start;
+};
+
+//TRACE_SPAN(tracer, "name") times from here to the end of the block. Build with TRACER_DISABLED
+//to leave no code behind
+#define TRACER_JOIN2(a, b) a##b
+#define TRACER_JOIN(a, b) TRACER_JOIN2(a, b)
+#ifndef TRACER_DISABLED
+#define TRACE_SPAN(tracer, name) traceScope TRACER_JOIN(_traceSpan, __LINE__)(tracer, name)
+#else
+#define TRACE_SPAN(tracer, name)
+#endif
+
+
+#endif // __TRACER_H__
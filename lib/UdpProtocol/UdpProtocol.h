@@ -0,0 +1,60 @@
+#ifndef __UDPPROTOCOL_H__
+#define __UDPPROTOCOL_H__
+
+
+#include <stdint.h>
+#include <SipHash.h>
+
+//UDP status and control. One fixed size little-endian request, one reply, both tagged with
+//SipHash-2-4 under the door's key, which only dump config on the console shows. Bad tags get no
+//reply at all.
+//Shared by the firmware and the gateway in tools/gateway, so it needs nothing from Arduino
+const uint16_t UDP_PORT = 4210;
+const char UDP_MAGIC[2] = { 'C', 'D' };
+const uint8_t UDP_VERSION = 1;
+const uint8_t UDP_STATUS = 1;
+const uint8_t UDP_OPEN = 2;
+const uint8_t UDP_CLOSE = 3;
+const uint8_t UDP_STOP = 4;
+//Set in a reply's type
+const uint8_t UDP_REPLY = 0x80;
+//Reply results. A command's seq must be above the last command's, so a replayed one is stale
+const uint8_t UDP_OK = 0;
+const uint8_t UDP_STALE = 1;
+const uint8_t UDP_BUSY = 2;
+const uint8_t UDP_UNKNOWN = 3;
+//Door states a reply can carry: unknown, open, closed, opening, closing, stopped opening, stopped closing
+const uint8_t UDP_DOOR_STATES = 7;
+
+struct udpRequest {
+  char magic[2];
+  uint8_t version;
+  uint8_t type;
+  uint32_t seq;
+  uint8_t tag[SIPHASH_TAG_LENGTH];
+};
+static_assert(sizeof(udpRequest) == 16, "udpRequest must stay 16 bytes");
+
+//Times are UTC unix seconds; drift is in tenths of a ppm
+struct udpStatus {
+  char magic[2];
+  uint8_t version;
+  uint8_t type;
+  uint32_t seq;
+  uint8_t result;
+  uint8_t doorState;
+  int8_t rssi;
+  uint8_t reserved;
+  uint16_t overRun;
+  int16_t drift;
+  uint32_t time;
+  uint32_t openAt;
+  uint32_t closeAt;
+  uint32_t uptime;
+  uint32_t freeHeap;
+  uint8_t tag[SIPHASH_TAG_LENGTH];
+};
+static_assert(sizeof(udpStatus) == 44, "udpStatus must stay 44 bytes");
+
+
+#endif // __UDPPROTOCOL_H__
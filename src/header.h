@@ -6,48 +6,74 @@
 #include <TimeLib.h>
 #include <Timezone.h>
 #include <TimeAlarms.h>
-#include <RBD_Button.h>
 #include <RTClib.h>
 #include <SoftwareSerial.h>
 #include <EEPROM.h>
 #include <ESP8266WiFi.h>
-#include <WiFiClient.h>
-#include <ESP8266WebServer.h>
+#include <ESPAsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <FS.h>
 #include <LittleFS.h>
 #include <ESP8266mDNS.h>
+#include <Updater.h>
+#include <EventLog.h>
+#include <Debouncer.h>
+#include <DriftClock.h>
+#include <Tracer.h>
+#include <AssetCache.h>
+#include <AsyncMqttClient.h>
+#include <Telemetry.h>
+#include <Router.h>
+#include <WiFiUdp.h>
+#include <SipHash.h>
+#include <UdpProtocol.h>
+#include <Console.h>
+#include <HeapProfiler.h>
+#include <Scheduler.h>
 
 
 char* string2char(String command);
 void connectToWifi(String ssid, String password);
 void createAccessPoint();
 void setupWifi();
-void setWifi ();
-void setRTCTime();
 String padInteger(int pUnPadded);
 String timeToString(time_t inputTime);
 String dateToString(time_t inputTime);
 time_t getSunTimes(int calculationType, time_t inputDate, int zenithType);
 time_t syncProvider();
+void serviceClock();
 String getAlarmTime (int pAlarm, int pFormat, bool pUTC);
 String getTime(int pFormat, bool pUTC);
 String getSunriseTime(int pFormat, bool pUTC);
 String getSunsetTime(int pFormat, bool pUTC);
-void handleRoot();
-void loadCSS();
-void loadHeaderImage();
-void loadDateImage();
-void loadDoorImage();
-void loadSunriseImage();
-void loadSunsetImage();
-void loadTimeImage();
-void redirectHome(String message);
+void handleRoot(AsyncWebServerRequest *request);
+void loadScript(AsyncWebServerRequest *request);
+void loadCSS(AsyncWebServerRequest *request);
+void loadHeaderImage(AsyncWebServerRequest *request);
+void loadDateImage(AsyncWebServerRequest *request);
+void loadDoorImage(AsyncWebServerRequest *request);
+void loadSunriseImage(AsyncWebServerRequest *request);
+void loadSunsetImage(AsyncWebServerRequest *request);
+void loadTimeImage(AsyncWebServerRequest *request);
+void sendAsset(AsyncWebServerRequest *request, const char *pPath, const char *pContentType);
+void sendFile(AsyncWebServerRequest *request, const char *pPath, const char *pContentType);
+void redirectHome(AsyncWebServerRequest *request, String message);
 void setupServer();
+void handleOpen(AsyncWebServerRequest *request);
+void handleClose(AsyncWebServerRequest *request);
+void handleOverride(AsyncWebServerRequest *request);
+void handleStopOpened(AsyncWebServerRequest *request);
+void handleStopClosed(AsyncWebServerRequest *request);
+void handleSetWifi(AsyncWebServerRequest *request);
+void handleClearWifi(AsyncWebServerRequest *request);
+void handleSetTime(AsyncWebServerRequest *request);
+void handleSetOverRun(AsyncWebServerRequest *request);
+void handleReset(AsyncWebServerRequest *request);
+void handleSettings(AsyncWebServerRequest *request);
 void clearWifiCredentials();
 int getOverRun();
-void setOverRun();
-void handleReset ();
-void handleSettings();
+void setOverRun(int pOverRun);
+void setRTCTime(time_t pNewTimeUTC);
 void motorForward();
 void motorReverse();
 void motorStop();
@@ -61,13 +87,76 @@ String getDoorState();
 void checkDoorState();
 void alterDoorState();
 void checkManualOverideButton();
+void setupSwitches();
+uint32_t readSwitches();
+void serviceSwitches();
+void runDoorAction(uint8_t pAction);
+void startOpening();
+void startClosing();
+void arriveOpen();
+void arriveClosed();
+void startOverrun(int pStoppedState);
+void serviceOverrun();
+void haltOpening();
+void haltClosing();
+void markOpen();
 void setSunAlarms();
+void alarmOpenDoor();
+void alarmCloseDoor();
+void overrideDoor();
+void logEvent(uint8_t pType, uint8_t pCode, uint8_t pDetail, int32_t pValue);
+void flushEventLog();
+void handleLog(AsyncWebServerRequest *request);
+void handleUpdate(AsyncWebServerRequest *request);
+void handleFile(AsyncWebServerRequest *request);
+void handleUpdateUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
+void checkOtaBoot();
+void checkRollbackImage();
+void serviceOta();
+void serviceWebCommands();
+void handleSetMqtt(AsyncWebServerRequest *request);
+void serviceTelemetry();
+void publishHealth();
+void serviceUdp();
+void handleUdpPacket();
+void handleNewUdpKey(AsyncWebServerRequest *request);
+void newUdpKey();
+void loadUdpKey();
+void saveUdpCommandSeq(uint32_t pSeq);
+bool udpKeySet();
+void haltDoor();
+void serviceConsole();
+void consoleHelp(Console &pConsole, void *pArgs);
+void consoleStatus(Console &pConsole, void *pArgs);
+void consoleOpen(Console &pConsole, void *pArgs);
+void consoleClose(Console &pConsole, void *pArgs);
+void consoleStop(Console &pConsole, void *pArgs);
+void consoleOverride(Console &pConsole, void *pArgs);
+void consoleSetTime(Console &pConsole, void *pArgs);
+void consoleSetOverRun(Console &pConsole, void *pArgs);
+void consoleSetWifi(Console &pConsole, void *pArgs);
+void consoleDumpConfig(Console &pConsole, void *pArgs);
+void consoleDumpMetrics(Console &pConsole, void *pArgs);
+void consoleDoorState(int pState, char *pName, size_t pSize);
+void handleHeap(AsyncWebServerRequest *request);
+void serviceDoor();
+void serviceAlarms();
+void serviceMdns();
+void serviceHeap();
+void serviceAssets();
+void handleTasks(AsyncWebServerRequest *request);
+void consoleDumpTasks(Console &pConsole, void *pArgs);
 
 //Set up switch pins
 const int MANUAL_OVERIDE_PIN = D6;
 const int DOOR_OPEN_PIN = D4;
 const int DOOR_CLOSED_PIN = D5;
 
+//Switch debounce, in milliseconds
+const unsigned long SWITCH_TICK = 10;
+const unsigned long OVERRIDE_DEBOUNCE = 150;
+const unsigned long LIMIT_SWITCH_DEBOUNCE = 50;
+
 // Set up motor pins
 int MOTOR_INPUT_1 = D7;
 int MOTOR_INPUT_2 = D8;
@@ -85,7 +174,6 @@ const float LATITUDE = -38.07164;
 const float LONGITUDE = 142.803125;
 
 //Door State
-const String DOOR_STATE_NAME[7] = { "Unknown", "Open", "Closed", "Opening", "Closing", "Stopped-Opening", "Stopped-Closing" };
 const int DOOR_STATE_UNKNOWN = 0;
 const int DOOR_STATE_OPEN = 1;
 const int DOOR_STATE_CLOSED = 2;
@@ -93,17 +181,279 @@ const int DOOR_STATE_OPENING = 3;
 const int DOOR_STATE_CLOSING = 4;
 const int DOOR_STATE_STOPPED_OPENING = 5;
 const int DOOR_STATE_STOPPED_CLOSING = 6;
+const int DOOR_STATE_COUNT = 7;
+static_assert(DOOR_STATE_COUNT == UDP_DOOR_STATES, "UDP replies carry the door state");
+
+//Door actions, run by runDoorAction()
+const uint8_t DOOR_ACTION_NONE = 0;
+const uint8_t DOOR_ACTION_OPEN = 1;
+const uint8_t DOOR_ACTION_CLOSE = 2;
+const uint8_t DOOR_ACTION_ARRIVE_OPEN = 3;
+const uint8_t DOOR_ACTION_ARRIVE_CLOSED = 4;
+const uint8_t DOOR_ACTION_HALT_OPENING = 5;
+const uint8_t DOOR_ACTION_HALT_CLOSING = 6;
+const uint8_t DOOR_ACTION_MARK_OPEN = 7;
+const uint8_t DOOR_ACTION_COUNT = 8;
+
+//Limit switch a state watches in checkDoorState()
+const uint8_t DOOR_GUARD_NONE = 0;
+const uint8_t DOOR_GUARD_OPEN_SWITCH = 1;
+const uint8_t DOOR_GUARD_CLOSED_SWITCH = 2;
+
+struct doorStateRow {
+  const char *name;
+  uint8_t guard;
+  uint8_t onPressed;
+  uint8_t onReleased;
+  uint8_t onOverride;
+};
+
+//State names stay in flash
+const char DOOR_STATE_NAME_UNKNOWN[] PROGMEM = "Unknown";
+const char DOOR_STATE_NAME_OPEN[] PROGMEM = "Open";
+const char DOOR_STATE_NAME_CLOSED[] PROGMEM = "Closed";
+const char DOOR_STATE_NAME_OPENING[] PROGMEM = "Opening";
+const char DOOR_STATE_NAME_CLOSING[] PROGMEM = "Closing";
+const char DOOR_STATE_NAME_STOPPED_OPENING[] PROGMEM = "Stopped-Opening";
+const char DOOR_STATE_NAME_STOPPED_CLOSING[] PROGMEM = "Stopped-Closing";
+
+//Door state machine, indexed by DOOR_STATE_*. Guarded states act on their limit switch every loop,
+//every state acts on the override button
+constexpr doorStateRow DOOR_STATE_TABLE[DOOR_STATE_COUNT] PROGMEM = {
+  { DOOR_STATE_NAME_UNKNOWN, DOOR_GUARD_OPEN_SWITCH, DOOR_ACTION_MARK_OPEN, DOOR_ACTION_OPEN, DOOR_ACTION_OPEN },
+  { DOOR_STATE_NAME_OPEN, DOOR_GUARD_NONE, DOOR_ACTION_NONE, DOOR_ACTION_NONE, DOOR_ACTION_CLOSE },
+  { DOOR_STATE_NAME_CLOSED, DOOR_GUARD_NONE, DOOR_ACTION_NONE, DOOR_ACTION_NONE, DOOR_ACTION_OPEN },
+  { DOOR_STATE_NAME_OPENING, DOOR_GUARD_OPEN_SWITCH, DOOR_ACTION_ARRIVE_OPEN, DOOR_ACTION_NONE, DOOR_ACTION_HALT_OPENING },
+  { DOOR_STATE_NAME_CLOSING, DOOR_GUARD_CLOSED_SWITCH, DOOR_ACTION_ARRIVE_CLOSED, DOOR_ACTION_NONE, DOOR_ACTION_HALT_CLOSING },
+  { DOOR_STATE_NAME_STOPPED_OPENING, DOOR_GUARD_NONE, DOOR_ACTION_NONE, DOOR_ACTION_NONE, DOOR_ACTION_CLOSE },
+  { DOOR_STATE_NAME_STOPPED_CLOSING, DOOR_GUARD_NONE, DOOR_ACTION_NONE, DOOR_ACTION_NONE, DOOR_ACTION_OPEN }
+};
+
+//State each action leaves the door in. Opening/closing settle straight to open/closed at a made switch
+constexpr int DOOR_ACTION_TARGET[DOOR_ACTION_COUNT] = {
+  -1,
+  DOOR_STATE_OPENING,
+  DOOR_STATE_CLOSING,
+  DOOR_STATE_OPEN,
+  DOOR_STATE_CLOSED,
+  DOOR_STATE_STOPPED_OPENING,
+  DOOR_STATE_STOPPED_CLOSING,
+  DOOR_STATE_OPEN
+};
+
+void (*const DOOR_ACTION_FUNCTION[DOOR_ACTION_COUNT])() = {
+  NULL,
+  startOpening,
+  startClosing,
+  arriveOpen,
+  arriveClosed,
+  haltOpening,
+  haltClosing,
+  markOpen
+};
+
+constexpr bool doorRowValid(int pState) {
+  return DOOR_STATE_TABLE[pState].name != NULL
+    && DOOR_STATE_TABLE[pState].guard <= DOOR_GUARD_CLOSED_SWITCH
+    && DOOR_STATE_TABLE[pState].onPressed < DOOR_ACTION_COUNT
+    && DOOR_STATE_TABLE[pState].onReleased < DOOR_ACTION_COUNT
+    && DOOR_STATE_TABLE[pState].onOverride < DOOR_ACTION_COUNT
+    //Unguarded states never act on a switch
+    && (DOOR_STATE_TABLE[pState].guard != DOOR_GUARD_NONE
+      || (DOOR_STATE_TABLE[pState].onPressed == DOOR_ACTION_NONE && DOOR_STATE_TABLE[pState].onReleased == DOOR_ACTION_NONE))
+    //The override button always moves the door somewhere else
+    && DOOR_STATE_TABLE[pState].onOverride != DOOR_ACTION_NONE
+    && DOOR_ACTION_TARGET[DOOR_STATE_TABLE[pState].onOverride] != pState;
+}
+
+constexpr bool doorTableValid() {
+  for (int state = 0; state < DOOR_STATE_COUNT; state++) {
+    if (!doorRowValid(state)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static_assert(doorTableValid(), "DOOR_STATE_TABLE has an invalid row");
+static_assert(DOOR_STATE_TABLE[DOOR_STATE_OPENING].onPressed == DOOR_ACTION_ARRIVE_OPEN, "Opening must stop at the open switch");
+static_assert(DOOR_STATE_TABLE[DOOR_STATE_CLOSING].onPressed == DOOR_ACTION_ARRIVE_CLOSED, "Closing must stop at the closed switch");
+static_assert(DOOR_STATE_TABLE[DOOR_STATE_OPENING].guard == DOOR_GUARD_OPEN_SWITCH, "Opening watches the open switch");
+static_assert(DOOR_STATE_TABLE[DOOR_STATE_CLOSING].guard == DOOR_GUARD_CLOSED_SWITCH, "Closing watches the closed switch");
+static_assert(DOOR_ACTION_TARGET[DOOR_STATE_TABLE[DOOR_STATE_OPENING].onOverride] == DOOR_STATE_STOPPED_OPENING, "Override stops an opening door");
+static_assert(DOOR_ACTION_TARGET[DOOR_STATE_TABLE[DOOR_STATE_CLOSING].onOverride] == DOOR_STATE_STOPPED_CLOSING, "Override stops a closing door");
+static_assert(DOOR_ACTION_TARGET[DOOR_STATE_TABLE[DOOR_STATE_STOPPED_OPENING].onOverride] == DOOR_STATE_CLOSING, "Override reverses a stopped door");
+static_assert(DOOR_ACTION_TARGET[DOOR_STATE_TABLE[DOOR_STATE_STOPPED_CLOSING].onOverride] == DOOR_STATE_OPENING, "Override reverses a stopped door");
+static_assert(DOOR_STATE_TABLE[DOOR_STATE_UNKNOWN].onReleased == DOOR_ACTION_OPEN, "An unknown door opens until the open switch is made");
 
 //What time to update open/close alarms (UTC)
 const int ALARM_UPDATE_HOUR = 15;
 const int ALARM_UPDATE_MINUTE = 0;
 const int ALARM_UPDATE_SECOND = 0;
 
+//TimeLib is set from rtcClock just after one of its second boundaries, so both tick together.
+//The sync provider is the fallback if loop() misses the window for CLOCK_SYNC_INTERVAL seconds
+const unsigned long CLOCK_ALIGN_INTERVAL = 10000;
+const uint16_t CLOCK_ALIGN_WINDOW = 20;
+const time_t CLOCK_SYNC_INTERVAL = 60;
+
 //Alarm types
 const int ALARM_OPEN = 1;
 const int ALARM_CLOSE = 2;
 const int ALARM_UPDATE = 3;
 
+//Alarm event details
+const uint8_t ALARM_FIRED = 0;
+const uint8_t ALARM_SCHEDULED = 1;
+
+//Override sources
+const uint8_t OVERRIDE_BUTTON = 1;
+const uint8_t OVERRIDE_WEB = 2;
+
+//Config change types
+const uint8_t CONFIG_WIFI = 1;
+const uint8_t CONFIG_CLEAR_WIFI = 2;
+const uint8_t CONFIG_TIME = 3;
+const uint8_t CONFIG_OVERRUN = 4;
+const uint8_t CONFIG_FIRMWARE = 5;
+const uint8_t CONFIG_FILESYSTEM = 6;
+const uint8_t CONFIG_MQTT = 7;
+const uint8_t CONFIG_UDP_KEY = 8;
+
+//Records per /log read batch
+const size_t LOG_STREAM_RECORDS = 8;
+//Longest CSV line written by /log
+const size_t LOG_LINE_LENGTH = 64;
+const char LOG_CSV_HEADER[] = "seq,time,type,code,detail,value\n";
+
+//Spans per /trace read batch
+const size_t TRACE_STREAM_SPANS = 8;
+//Longest trace event written by /trace
+const size_t TRACE_EVENT_LENGTH = 112;
+//A span this long (microseconds) freezes the trace around it until /trace has been read
+const uint32_t TRACE_STALL_MICROS = 100000;
+
+//Room reserved for the home page before it is built. The page is about 1.2 KB; the rest covers the
+//message passed back by redirectHome()
+const size_t ROOT_PAGE_LENGTH = 1536;
+
+//Room reserved for the /settings page before it is built, so it grows without reallocating. The page
+//is about 7.4 KB; the rest covers the longest SSID, password, broker and counters
+const size_t SETTINGS_PAGE_LENGTH = 8192;
+
+//Small static assets held in RAM. pollo.js (under 0.5 KB gzipped) is kept from boot and the rest
+//of the budget is for the PNGs, loaded on a miss. pollo.css carries the page images inline and is
+//about 15.5 KB gzipped, too much of the heap to hold for good, so it is streamed from LittleFS
+const size_t ASSET_CACHE_BUDGET = 4096;
+const size_t ASSET_CACHE_MAX_ASSET = 1024;
+const char* const ASSET_CACHE_WARM[] = { "/pollo.js" };
+
+//Web commands, queued by request handlers and run from loop()
+const uint8_t WEB_COMMAND_OPEN = 1;
+const uint8_t WEB_COMMAND_CLOSE = 2;
+const uint8_t WEB_COMMAND_OVERRIDE = 3;
+const uint8_t WEB_COMMAND_STOP_OPENED = 4;
+const uint8_t WEB_COMMAND_STOP_CLOSED = 5;
+const uint8_t WEB_COMMAND_SET_WIFI = 6;
+const uint8_t WEB_COMMAND_CLEAR_WIFI = 7;
+const uint8_t WEB_COMMAND_SET_TIME = 8;
+const uint8_t WEB_COMMAND_SET_OVERRUN = 9;
+const uint8_t WEB_COMMAND_RESET = 10;
+const uint8_t WEB_COMMAND_APPLY_UPDATE = 11;
+const uint8_t WEB_COMMAND_SET_MQTT = 12;
+const uint8_t WEB_COMMAND_STOP = 13;
+const uint8_t WEB_COMMAND_NEW_UDP_KEY = 14;
+const uint8_t WEB_COMMAND_QUEUE = 8;
+//Microseconds of queued work run per loop()
+const unsigned long WEB_COMMAND_BUDGET = 2000;
+//A queued door command that would start the motor waits this long after it last stopped
+const unsigned long MOTOR_REST_MILLIS = 1000;
+
+//Request budgets per client IP, checked by the router before any handler runs.
+//Pages and streams draw on RATE_READ, anything that queues a command on RATE_CONTROL
+const uint8_t RATE_READ = 0;
+const uint8_t RATE_CONTROL = 1;
+const uint16_t RATE_READ_BURST = 30;
+const unsigned long RATE_READ_REFILL = 200;
+const uint16_t RATE_CONTROL_BURST = 4;
+const unsigned long RATE_CONTROL_REFILL = 2000;
+
+//OTA updates. Firmware is only accepted once the running sketch is saved for rollback.
+//A new firmware has OTA_TRIAL_BOOTS boots to run for OTA_CONFIRM_MILLIS, else the saved sketch goes back
+const char OTA_ROLLBACK_PATH[] = "/ota/rollback.bin";
+const char OTA_ROLLBACK_MD5_PATH[] = "/ota/rollback.md5";
+const size_t OTA_COPY_CHUNK = 512;
+const uint8_t OTA_TRIAL_BOOTS = 3;
+const unsigned long OTA_CONFIRM_MILLIS = 60000;
+const uint8_t OTA_CONFIRMED = 0;
+const uint8_t OTA_TRIAL = 1;
+const uint8_t OTA_ROLLED_BACK = 2;
+const uint8_t OTA_TYPE_FIRMWARE = 1;
+const uint8_t OTA_TYPE_FILESYSTEM = 2;
+//EEPROM address of the otaState
+const int OTA_STATE_ADDRESS = 52;
+
+//MQTT telemetry. An empty broker host leaves it off
+const int MQTT_SETTINGS_ADDRESS = 56;
+const uint16_t MQTT_DEFAULT_PORT = 1883;
+const char TELEMETRY_PREFIX[] = "chookdoor/%06x";
+const unsigned long TELEMETRY_HEALTH_INTERVAL = 60000;
+
+//UDP status and control, whose wire format is in UdpProtocol.h. Datagrams answered per loop()
+const uint8_t UDP_PACKETS_PER_LOOP = 4;
+//EEPROM address of the SipHash key, and of the highest command seq taken with it
+const int UDP_KEY_ADDRESS = 92;
+const int UDP_SEQ_ADDRESS = 108;
+
+//Serial console. The UART's FIFO holds 128 bytes and empties at about 11.5 a millisecond, so a
+//600 byte dump takes some 50 ms to go out. Console queues replies and sends them as it empties
+const unsigned long CONSOLE_BAUD = 115200;
+
+//Heap profiling. The heap is looked at every HEAP_CHECK_INTERVAL, and /heap keeps the worst of each
+//HEAP_SAMPLE_INTERVAL for a day
+const unsigned long HEAP_CHECK_INTERVAL = 1000;
+const unsigned long HEAP_SAMPLE_INTERVAL = 1800000;
+//Longest site or sample written by /heap
+const size_t HEAP_ELEMENT_LENGTH = 256;
+
+//Most allocations and bytes one call may make, by route or HEAP_SCOPE name. 0 is unlimited.
+//Over budget calls are counted on /heap, and fail the simulator's heap check
+struct heapBudget {
+  const char *site;
+  uint32_t allocs;
+  uint32_t bytes;
+};
+
+const heapBudget HEAP_BUDGETS[] = {
+  //The reserved page, the response's copy of it and the response
+  { "/", 4, ROOT_PAGE_LENGTH * 2 + 256 },
+  { "/settings", 4, SETTINGS_PAGE_LENGTH * 2 + 256 },
+  { "/heap", 8, 512 },
+  { "/override", 40, 1536 },
+  { "/stopopened", 40, 1536 },
+  { "padInteger", 1, 16 },
+  { "redirectHome", 6, 512 },
+  { "publishHealth", 24, 2560 }
+};
+
+//Tasks run by the scheduler from loop(). Door control is critical: it runs at the start of every tick
+//and again between other tasks every DOOR_PERIOD. The rest start in priority order until
+//SCHEDULER_TICK_BUDGET is spent, and one passed over SCHEDULER_MAX_SKIPS ticks goes first.
+//Times are microseconds; a budget is what one run should take
+const uint8_t TASK_DOOR = TASK_CRITICAL;
+const uint8_t TASK_HIGH = 1;
+const uint8_t TASK_NETWORK = 2;
+const uint8_t TASK_BACKGROUND = 3;
+const uint32_t DOOR_PERIOD = SWITCH_TICK * 1000;
+const uint32_t SCHEDULER_TICK_BUDGET = 5000;
+//Longest task written by /tasks
+const size_t TASK_ELEMENT_LENGTH = 192;
+
+//Longest limit switch overrun /setoverrun accepts, in milliseconds
+const int32_t OVERRUN_MAX = 10000;
+//Overrun used when EEPROM holds none, stopping at the limit switch itself
+const int32_t OVERRUN_DEFAULT = 0;
+
 //Time Date formats for string output
 const int GT_TIMEONLY = 1;
 const int GT_DATEONLY = 2;
@@ -114,25 +464,316 @@ struct wifiCredentials {
   char pwd[20];
 };
 
+struct mqttSettings {
+  char host[TELEMETRY_HOST_LENGTH];
+  uint16_t port;
+};
+
+struct webCommand {
+  uint8_t type;
+  int32_t value;
+  wifiCredentials creds;
+  mqttSettings mqtt;
+};
+
+struct otaState {
+  uint8_t phase;
+  uint8_t boots;
+};
+
+//The upload being written to flash. Only its owner may write
+struct otaUpload {
+  AsyncWebServerRequest *owner;
+  bool active;
+  bool verified;
+  uint8_t type;
+  char error[48];
+  //The image's tag under the device key, and the tag so far of what has arrived
+  uint8_t tag[SIPHASH_TAG_LENGTH];
+  sipState sip;
+};
+
+bool startUpdate(AsyncWebServerRequest *request);
+bool parseTag(const char *pHex, uint8_t *pTag);
+void failUpdate(const char *pError);
+void applyUpdate(uint8_t pType);
+void rollbackFirmware();
+void copyRollbackImage();
+
+//Position of a /log response between chunks
+struct logStream {
+  uint32_t seq;
+  uint32_t remaining;
+  uint32_t since;
+  bool binary;
+  bool headerSent;
+};
+
+//Position of a /trace response between chunks. Timestamps are relative to the first span
+struct traceStream {
+  uint32_t seq;
+  uint32_t end;
+  uint32_t base;
+  uint32_t sent;
+  bool headerSent;
+  bool footerSent;
+};
+
+//Position of a /heap response between chunks: the totals, each site, each sample, then the end.
+//Counts are taken when the request starts
+struct heapStream {
+  uint8_t index;
+  uint8_t sites;
+  uint8_t samples;
+};
+
+//Position of a /tasks response between chunks: the totals, each task, then the end
+struct taskStream {
+  uint8_t index;
+};
+
+bool queueWebCommand(uint8_t pType, int32_t pValue, const wifiCredentials *pCreds, const mqttSettings *pMqtt = NULL);
+void runWebCommand(const webCommand &pCommand);
+void consoleQueue(Console &pConsole, uint8_t pType, int32_t pValue, const wifiCredentials *pCreds);
+bool webCommandReady(const webCommand &pCommand);
+void queueAndRedirect(AsyncWebServerRequest *request, uint8_t pType, int32_t pValue, const wifiCredentials *pCreds, String message, const mqttSettings *pMqtt = NULL);
+int expectedDoorState(uint8_t pType);
+String jsonString(const String &pText);
+size_t fillLogStream(logStream &pStream, uint8_t *pBuffer, size_t pMaxLen);
+void handleTrace(AsyncWebServerRequest *request);
+size_t fillTraceStream(traceStream &pStream, uint8_t *pBuffer, size_t pMaxLen);
+size_t fillHeapStream(heapStream &pStream, uint8_t *pBuffer, size_t pMaxLen);
+size_t heapElement(const heapStream &pStream, char *pElement, size_t pSize);
+size_t fillTaskStream(taskStream &pStream, uint8_t *pBuffer, size_t pMaxLen);
+size_t taskElement(const taskStream &pStream, char *pElement, size_t pSize);
+void commitEEPROM();
+void setWifi(const wifiCredentials &pCreds);
+void sendArgError(AsyncWebServerRequest *request, const String &pError);
+void getMqttSettings(mqttSettings &pSettings);
+void setMqtt(const mqttSettings &pSettings);
+
+//Query arguments, each parsed in one pass by parseArgs() and range checked before anything is queued.
+//Times are local
+struct timeArgs {
+  int32_t year;
+  int32_t month;
+  int32_t day;
+  int32_t hour;
+  int32_t minute;
+  int32_t second;
+};
+
+struct overrunArgs {
+  int32_t overrun;
+};
+
+struct logArgs {
+  int32_t from;
+  int32_t count;
+  int32_t since;
+  char format[4];
+};
+
+struct updateArgs {
+  char type[12];
+  char md5[33];
+  char tag[17];
+};
+
+time_t timeArgsToUTC(const timeArgs &pArgs);
+
+const argField TIME_ARGS[] PROGMEM = {
+  ARG_FIELD(timeArgs, year, "year", ARG_NUMBER | ARG_REQUIRED, 2000, 2099),
+  ARG_FIELD(timeArgs, month, "month", ARG_NUMBER | ARG_REQUIRED, 1, 12),
+  ARG_FIELD(timeArgs, day, "day", ARG_NUMBER | ARG_REQUIRED, 1, 31),
+  ARG_FIELD(timeArgs, hour, "hour", ARG_NUMBER | ARG_REQUIRED, 0, 23),
+  ARG_FIELD(timeArgs, minute, "minute", ARG_NUMBER | ARG_REQUIRED, 0, 59),
+  ARG_FIELD(timeArgs, second, "second", ARG_NUMBER, 0, 59)
+};
+
+const argField OVERRUN_ARGS[] PROGMEM = {
+  ARG_FIELD(overrunArgs, overrun, "overrun", ARG_NUMBER | ARG_REQUIRED, 0, OVERRUN_MAX)
+};
+
+const argField WIFI_ARGS[] PROGMEM = {
+  ARG_FIELD(wifiCredentials, ssid, "ssid", ARG_TEXT | ARG_REQUIRED, 1, 19),
+  ARG_FIELD(wifiCredentials, pwd, "password", ARG_TEXT | ARG_REQUIRED, 1, 19)
+};
+
+const argField MQTT_ARGS[] PROGMEM = {
+  ARG_FIELD(mqttSettings, host, "host", ARG_TEXT | ARG_REQUIRED, 0, TELEMETRY_HOST_LENGTH - 1),
+  ARG_FIELD(mqttSettings, port, "port", ARG_NUMBER, 1, 65535)
+};
+
+const argField LOG_ARGS[] PROGMEM = {
+  ARG_FIELD(logArgs, from, "from", ARG_NUMBER, 0, INT32_MAX),
+  ARG_FIELD(logArgs, count, "count", ARG_NUMBER, 0, INT32_MAX),
+  ARG_FIELD(logArgs, since, "since", ARG_NUMBER, 0, INT32_MAX),
+  ARG_FIELD(logArgs, format, "format", ARG_TEXT, 0, 3)
+};
+
+const argField UPDATE_ARGS[] PROGMEM = {
+  ARG_FIELD(updateArgs, type, "type", ARG_TEXT, 8, 10),
+  ARG_FIELD(updateArgs, md5, "md5", ARG_TEXT | ARG_REQUIRED, 32, 32),
+  ARG_FIELD(updateArgs, tag, "tag", ARG_TEXT | ARG_REQUIRED, 16, 16)
+};
+
+//Every page and action, with the request budget it draws on. Anything else goes to handleFile(),
+//on the pages budget
+constexpr route ROUTES[] PROGMEM = {
+  { "/", HTTP_ANY, RATE_READ, handleRoot, NULL },
+  { "/open", HTTP_ANY, RATE_CONTROL, handleOpen, NULL },
+  { "/close", HTTP_ANY, RATE_CONTROL, handleClose, NULL },
+  { "/override", HTTP_ANY, RATE_CONTROL, handleOverride, NULL },
+  { "/stopopened", HTTP_ANY, RATE_CONTROL, handleStopOpened, NULL },
+  { "/stopclosed", HTTP_ANY, RATE_CONTROL, handleStopClosed, NULL },
+  { "/header.png", HTTP_ANY, RATE_READ, loadHeaderImage, NULL },
+  { "/date.png", HTTP_ANY, RATE_READ, loadDateImage, NULL },
+  { "/door.png", HTTP_ANY, RATE_READ, loadDoorImage, NULL },
+  { "/sunrise.png", HTTP_ANY, RATE_READ, loadSunriseImage, NULL },
+  { "/sunset.png", HTTP_ANY, RATE_READ, loadSunsetImage, NULL },
+  { "/time.png", HTTP_ANY, RATE_READ, loadTimeImage, NULL },
+  { "/pollo.css", HTTP_ANY, RATE_READ, loadCSS, NULL },
+  { "/pollo.js", HTTP_ANY, RATE_READ, loadScript, NULL },
+  { "/setwifi", HTTP_ANY, RATE_CONTROL, handleSetWifi, NULL },
+  { "/clearwifi", HTTP_ANY, RATE_CONTROL, handleClearWifi, NULL },
+  { "/settime", HTTP_ANY, RATE_CONTROL, handleSetTime, NULL },
+  { "/setoverrun", HTTP_ANY, RATE_CONTROL, handleSetOverRun, NULL },
+  { "/setmqtt", HTTP_ANY, RATE_CONTROL, handleSetMqtt, NULL },
+  { "/newudpkey", HTTP_ANY, RATE_CONTROL, handleNewUdpKey, NULL },
+  { "/settings", HTTP_ANY, RATE_READ, handleSettings, NULL },
+  { "/reset", HTTP_ANY, RATE_CONTROL, handleReset, NULL },
+  { "/log", HTTP_ANY, RATE_READ, handleLog, NULL },
+  { "/trace", HTTP_ANY, RATE_READ, handleTrace, NULL },
+  { "/heap", HTTP_ANY, RATE_READ, handleHeap, NULL },
+  { "/tasks", HTTP_ANY, RATE_READ, handleTasks, NULL },
+  { "/update", HTTP_POST, RATE_CONTROL, handleUpdate, handleUpdateUpload }
+};
+
+//Serial console commands. Arguments are typed in the order of their fields
+const consoleCommand CONSOLE_COMMANDS[] PROGMEM = {
+  { "help", NULL, 0, consoleHelp },
+  { "status", NULL, 0, consoleStatus },
+  { "open", NULL, 0, consoleOpen },
+  { "close", NULL, 0, consoleClose },
+  { "stop", NULL, 0, consoleStop },
+  { "override", NULL, 0, consoleOverride },
+  { "settime", TIME_ARGS, sizeof(TIME_ARGS) / sizeof(TIME_ARGS[0]), consoleSetTime },
+  { "setoverrun", OVERRUN_ARGS, sizeof(OVERRUN_ARGS) / sizeof(OVERRUN_ARGS[0]), consoleSetOverRun },
+  { "setwifi", WIFI_ARGS, sizeof(WIFI_ARGS) / sizeof(WIFI_ARGS[0]), consoleSetWifi },
+  { "dump config", NULL, 0, consoleDumpConfig },
+  { "dump metrics", NULL, 0, consoleDumpMetrics },
+  { "dump tasks", NULL, 0, consoleDumpTasks }
+};
+
+//Everything loop() does, door control first. Each task is a service function that does a bounded
+//step and returns. Kept in RAM, as the scheduler reads it every tick
+constexpr schedulerTask TASKS[] = {
+  { "door", TASK_DOOR, DOOR_PERIOD, 1000, serviceDoor },
+  { "webCommands", TASK_HIGH, 0, WEB_COMMAND_BUDGET, serviceWebCommands },
+  { "clock", TASK_HIGH, 0, 1000, serviceClock },
+  { "alarms", TASK_HIGH, 0, 1500, serviceAlarms },
+  { "udp", TASK_NETWORK, 0, 2000, serviceUdp },
+  { "console", TASK_NETWORK, 0, 2000, serviceConsole },
+  { "mdns", TASK_NETWORK, 0, 1000, serviceMdns },
+  { "events", TASK_BACKGROUND, 0, 5000, flushEventLog },
+  { "telemetry", TASK_BACKGROUND, 0, 2000, serviceTelemetry },
+  { "ota", TASK_BACKGROUND, 0, 5000, serviceOta },
+  { "heap", TASK_BACKGROUND, 0, 500, serviceHeap },
+  { "assets", TASK_BACKGROUND, 0, 5000, serviceAssets }
+};
+
+static_assert(sizeof(TASKS) / sizeof(TASKS[0]) <= SCHEDULER_TASKS, "Too many TASKS for the scheduler");
+static_assert(TASKS[0].priority == TASK_CRITICAL && TASKS[0].run == serviceDoor, "Door control must be the critical task");
+
+//Perfect hash of the route paths, worked out by the compiler
+constexpr routeIndex ROUTE_INDEX PROGMEM = indexRoutes(ROUTES);
+static_assert(ROUTE_INDEX.seed != ROUTER_NO_SEED, "No perfect hash seed for ROUTES, raise ROUTER_SLOT_BITS");
+
 int doorState;
 int overRun;
 
 //Setup Web Server
-ESP8266WebServer server(80);
+AsyncWebServer server(80);
+
+//Web command ring, filled by request handlers and drained by loop()
+webCommand webCommands[WEB_COMMAND_QUEUE];
+volatile uint8_t webCommandHead = 0;
+volatile uint8_t webCommandCount = 0;
+
+//When the motor last stopped, for MOTOR_REST_MILLIS
+unsigned long motorStoppedAt = 0;
+
+//A door run on past its limit switch, stopped in overrunStoppedState once overRun has passed
+bool overrunning = false;
+unsigned long overrunStartedAt = 0;
+int overrunStoppedState;
 
-//Set up buttons
-RBD::Button manualOveride(MANUAL_OVERIDE_PIN);
-RBD::Button doorOpenSwitch(DOOR_OPEN_PIN);
-RBD::Button doorClosedSwitch(DOOR_CLOSED_PIN);
+//Set up buttons and switches, debounced together from one GPIO read per tick
+Debouncer switches(SWITCH_TICK);
 
 //AlarmIDs
 AlarmID_t dailyAlarm;
 AlarmID_t openAlarm;
 AlarmID_t closeAlarm;
 
+//Door/alarm/config history
+EventLog eventLog;
+
+//Where loop() and the handlers spend their time
+Tracer tracer;
+
+//Runs TASKS from loop()
+Scheduler scheduler(TASKS, sizeof(TASKS) / sizeof(TASKS[0]), SCHEDULER_TICK_BUDGET);
+
+//What each route and HEAP_SCOPE allocates, and how the heap holds up over days
+HeapProfiler heapProfiler(HEAP_CHECK_INTERVAL, HEAP_SAMPLE_INTERVAL);
+
+//Small static files served without touching LittleFS
+AssetCache assets(ASSET_CACHE_BUDGET, ASSET_CACHE_MAX_ASSET);
+
+//Per client request budgets, shared by HTTP and UDP
+RateLimiter limiter;
+
+//UDP status and control
+WiFiUDP udp;
+uint8_t udpKey[SIPHASH_KEY_LENGTH];
+uint32_t udpCommandSeq = 0;
+uint32_t udpAnswered = 0;
+uint32_t udpRejected = 0;
+
+//Commands typed at the serial port, which work with or without the network
+Console console(Serial, CONSOLE_COMMANDS, sizeof(CONSOLE_COMMANDS) / sizeof(CONSOLE_COMMANDS[0]));
+
+//Next door alarms, UTC
+uint32_t openAtUTC = 0;
+uint32_t closeAtUTC = 0;
+
+//Telemetry to the MQTT broker, and its retained status topics
+AsyncMqttClient mqttClient;
+Telemetry telemetry(mqttClient);
+char telemetryPrefix[TELEMETRY_PREFIX_LENGTH];
+uint8_t telemetryState;
+uint8_t telemetryAlarms;
+uint8_t telemetryHealth;
+unsigned long telemetryHealthAt = 0;
+
+//OTA update and rollback state
+otaState ota;
+unsigned long otaBootMillis = 0;
+otaUpload upload = {};
+bool rollbackReady = false;
+bool rollbackFailed = false;
+File rollbackFile;
+uint32_t rollbackOffset = 0;
+
 //Initialise RTC
 RTC_DS1307 RTC;
 
+//System time between RTC reads
+DriftClock rtcClock;
+unsigned long clockSetAt = 0;
+
 //Mortlake DST settings
 TimeChangeRule auEDT = { "AEDT", First, Sun, Oct, 2, 660 };    //UTC + 11 hours
 TimeChangeRule auEST = { "AEST", First, Sun, Apr, 3, 600 };    //UTC + 10 hours
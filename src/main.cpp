@@ -3,14 +3,28 @@
 //Getting it all sorted
 void setup() {
 
-  //Begin Serial
-  Serial.begin(9600);
+  //Begin Serial, for the console
+  Serial.begin(CONSOLE_BAUD);
+
+  //Keep the trace around the first stall
+  tracer.setStallThreshold(TRACE_STALL_MICROS);
+
+  //Hold the handlers to their allocation budgets
+  for (size_t i = 0; i < sizeof(HEAP_BUDGETS) / sizeof(HEAP_BUDGETS[0]); i++) {
+    heapProfiler.setBudget(HEAP_BUDGETS[i].site, HEAP_BUDGETS[i].allocs, HEAP_BUDGETS[i].bytes);
+  }
 
   //Begin EEPROM
   EEPROM.begin(512);
 
+  //Count boots of newly updated firmware, rolling back if it keeps failing
+  checkOtaBoot();
+
+  //Set up buttons and switches
+  setupSwitches();
+
   //Clear wifi credentials from EEPROM if override button is pressed at startup
-  if (manualOveride.onPressed()) {
+  if (switches.isPressed(MANUAL_OVERIDE_PIN)) {
     clearWifiCredentials();
   }
 
@@ -22,18 +36,43 @@ void setup() {
   }
   // Add service to MDNS-SD
   MDNS.addService("http", "tcp", 80);
+  MDNS.addService("chookdoor", "udp", UDP_PORT);
+  MDNS.addServiceTxt("chookdoor", "udp", "version", String(UDP_VERSION).c_str());
+
+  //Answer UDP polls once there is a key
+  loadUdpKey();
+  udp.begin(UDP_PORT);
 
   //Setup request handlers
   setupServer();
 
-  //Begin SPIFFS
-  SPIFFS.begin();
+  //Telemetry starts connecting from loop() once a broker is set
+  mqttSettings mqtt;
+  snprintf(telemetryPrefix, sizeof(telemetryPrefix), TELEMETRY_PREFIX, ESP.getChipId());
+  telemetry.begin(telemetryPrefix);
+  telemetryState = telemetry.addStatus("state");
+  telemetryAlarms = telemetry.addStatus("alarms");
+  telemetryHealth = telemetry.addStatus("health");
+  getMqttSettings(mqtt);
+  telemetry.setBroker(mqtt.host, mqtt.port);
+
+  //Begin LittleFS and pick up the event log where it left off
+  LittleFS.begin();
+  eventLog.begin(LittleFS);
+  checkRollbackImage();
+
+  //Load the page assets into RAM while the heap is still in one piece
+  assets.begin(LittleFS);
+  for (size_t i = 0; i < sizeof(ASSET_CACHE_WARM) / sizeof(ASSET_CACHE_WARM[0]); i++) {
+    assets.warm(ASSET_CACHE_WARM[i]);
+  }
 
   //Begin Real Time Clock
   RTC.begin();
 
   //Set system clock (time) to sync with RTC
   setSyncProvider(syncProvider);
+  setSyncInterval(CLOCK_SYNC_INTERVAL);
 
   //Setup alarms to open/close door
   setSunAlarms();
@@ -43,134 +82,190 @@ void setup() {
 
   EEPROM.get(0, doorState);
   EEPROM.get(45, overRun);
+  if (doorState < 0 || doorState >= DOOR_STATE_COUNT) {
+    doorState = DOOR_STATE_UNKNOWN;
+  }
+  if (overRun < 0 || overRun > OVERRUN_MAX) {
+    overRun = OVERRUN_DEFAULT;
+  }
+  telemetry.setStatus(telemetryState, FPSTR(pgm_read_ptr(&DOOR_STATE_TABLE[doorState].name)));
 
-  //Button/Switch debounce
-  manualOveride.setDebounceTimeout(150);
-  doorOpenSwitch.setDebounceTimeout(50);
-  doorClosedSwitch.setDebounceTimeout(50);
+  logEvent(EVENT_BOOT, ESP.getResetInfoPtr()->reason, doorState, overRun);
 
   //Setup Motor Pins
   pinMode(MOTOR_INPUT_1, OUTPUT);
   pinMode(MOTOR_INPUT_2, OUTPUT);
 
-  //Button/Switch debounce
-  manualOveride.setDebounceTimeout(150);
-  doorOpenSwitch.setDebounceTimeout(50);
-  doorClosedSwitch.setDebounceTimeout(50);
-
 }
 
-//Just keeps on going
+//Just keeps on going, one scheduler tick at a time
 void loop() {
-  server.handleClient();
+  TRACE_SPAN(tracer, "loop");
+  HEAP_SCOPE(heapProfiler, "loop");
+  scheduler.tick();
+}
+
+//Limit switches, the door state machine and the override button, as one critical task
+void serviceDoor() {
+  serviceSwitches();
   checkDoorState();
+  serviceOverrun();
   checkManualOverideButton();
+}
+
+void serviceAlarms() {
+  TRACE_SPAN(tracer, "alarms");
   Alarm.delay(0);
 }
 
+void serviceMdns() {
+  TRACE_SPAN(tracer, "mdns");
+  MDNS.update();
+}
+
+void serviceHeap() {
+  heapProfiler.service(millis());
+}
+
+//Load an asset missed by sendAsset(), away from the web server's callbacks
+void serviceAssets() {
+  TRACE_SPAN(tracer, "serviceAssets");
+  assets.service();
+}
+
 //Check and action manual overide button
 void checkManualOverideButton() {
-  if (manualOveride.onPressed()) {
-    alterDoorState();
+  TRACE_SPAN(tracer, "checkManualOverideButton");
+  switchEdge edge;
+  while (switches.nextEdge(edge)) {
+    if (edge.pin == MANUAL_OVERIDE_PIN && edge.pressed) {
+      logEvent(EVENT_OVERRIDE, OVERRIDE_BUTTON, doorState, 0);
+      alterDoorState();
+    }
   }
 }
 
+//Buttons and switches pull to ground when made
+void setupSwitches() {
+  pinMode(MANUAL_OVERIDE_PIN, INPUT_PULLUP);
+  pinMode(DOOR_OPEN_PIN, INPUT_PULLUP);
+  pinMode(DOOR_CLOSED_PIN, INPUT_PULLUP);
+  switches.attach(MANUAL_OVERIDE_PIN, OVERRIDE_DEBOUNCE, true);
+  switches.attach(DOOR_OPEN_PIN, LIMIT_SWITCH_DEBOUNCE, true);
+  switches.attach(DOOR_CLOSED_PIN, LIMIT_SWITCH_DEBOUNCE, true);
+  switches.begin(readSwitches(), millis());
+}
+
+//GPIO0-15 from the input register, GPIO16 from the RTC block
+uint32_t readSwitches() {
+  return GPI | ((uint32_t)(GP16I & 1) << 16);
+}
+
+void serviceSwitches() {
+  TRACE_SPAN(tracer, "serviceSwitches");
+  switches.update(readSwitches(), millis());
+}
+
+//A new run ends any overrun, so its stop can't cut the new run short
 void motorForward() {
   digitalWrite(MOTOR_INPUT_1, LOW);
   digitalWrite(MOTOR_INPUT_2, HIGH);
+  overrunning = false;
 }
 
 void motorReverse() {
   digitalWrite(MOTOR_INPUT_1, HIGH);
   digitalWrite(MOTOR_INPUT_2, LOW);
+  overrunning = false;
 }
 
 void motorStop() {
   digitalWrite(MOTOR_INPUT_1, LOW);
   digitalWrite(MOTOR_INPUT_2, LOW);
+  motorStoppedAt = millis();
+  overrunning = false;
+}
+
+void commitEEPROM() {
+  TRACE_SPAN(tracer, "commitEEPROM");
+  EEPROM.commit();
 }
 
 void setDoorState(int pDoorState) {
+  logEvent(EVENT_DOOR, doorState, pDoorState, 0);
   doorState = pDoorState;
+  telemetry.setStatus(telemetryState, FPSTR(pgm_read_ptr(&DOOR_STATE_TABLE[doorState].name)));
   EEPROM.put(0, doorState);
-  EEPROM.commit();
+  commitEEPROM();
 }
 
 String getDoorState() {
-  return DOOR_STATE_NAME[doorState];
+  return String(FPSTR(pgm_read_ptr(&DOOR_STATE_TABLE[doorState].name)));
 }
 
 //Check if door is open/closed/in between
 void checkDoorState() {
-  switch (doorState) {
-    case DOOR_STATE_OPENING:
-      if (doorOpenSwitch.isPressed()) {
-        delay(overRun);
-        stopDoor(DOOR_STATE_OPEN);
-      }
-      break;
-    case DOOR_STATE_CLOSING:
-      if (doorClosedSwitch.isPressed()) {
-        delay(overRun);
-        stopDoor(DOOR_STATE_CLOSED);
-      }
-      break;
-    case DOOR_STATE_UNKNOWN:
-      if (doorOpenSwitch.isReleased()) {
-        openDoor();
-      }
-      else {
-        setDoorState(DOOR_STATE_OPEN);
-      }
-      break;
-    default:
-      break;
+  TRACE_SPAN(tracer, "checkDoorState");
+  uint8_t guard = pgm_read_byte(&DOOR_STATE_TABLE[doorState].guard);
+  bool pressed;
+  if (guard == DOOR_GUARD_NONE) {
+    return;
+  }
+  pressed = switches.isPressed(guard == DOOR_GUARD_OPEN_SWITCH ? DOOR_OPEN_PIN : DOOR_CLOSED_PIN);
+  if (pressed) {
+    runDoorAction(pgm_read_byte(&DOOR_STATE_TABLE[doorState].onPressed));
+  }
+  else {
+    runDoorAction(pgm_read_byte(&DOOR_STATE_TABLE[doorState].onReleased));
   }
 }
 
 void alterDoorState() {
-  switch (doorState) {
-    case DOOR_STATE_OPEN:
-      closeDoor();
-      break;
-    case DOOR_STATE_CLOSED:
-      openDoor();
-      break;
-    case DOOR_STATE_OPENING:
-      stopDoor(DOOR_STATE_STOPPED_OPENING);
-      break;
-    case DOOR_STATE_CLOSING:
-      stopDoor(DOOR_STATE_STOPPED_CLOSING);
-      break;
-    case DOOR_STATE_STOPPED_OPENING:
-      closeDoor();
-      break;
-    case DOOR_STATE_STOPPED_CLOSING:
-      openDoor();
-      break;
-    case DOOR_STATE_UNKNOWN:
-      openDoor();
-      break;
-    default:
-      break;
+  runDoorAction(pgm_read_byte(&DOOR_STATE_TABLE[doorState].onOverride));
+}
+
+void overrideDoor() {
+  logEvent(EVENT_OVERRIDE, OVERRIDE_WEB, doorState, 0);
+  alterDoorState();
+}
+
+//Stop a moving door where it is. A door that isn't moving is left alone
+void haltDoor() {
+  if (doorState == DOOR_STATE_OPENING) {
+    haltOpening();
+  }
+  else if (doorState == DOOR_STATE_CLOSING) {
+    haltClosing();
   }
-  redirectHome("Function: AlterDoorState");
 }
 
 void openDoor() {
+  startOpening();
+}
+
+void closeDoor() {
+  startClosing();
+}
+
+void runDoorAction(uint8_t pAction) {
+  if (pAction != DOOR_ACTION_NONE) {
+    DOOR_ACTION_FUNCTION[pAction]();
+  }
+}
+
+void startOpening() {
   setDoorState(DOOR_STATE_OPENING);
-  if (doorOpenSwitch.isReleased()) {
+  if (!switches.isPressed(DOOR_OPEN_PIN)) {
     motorForward();
   }
   else {
     setDoorState(DOOR_STATE_OPEN);
     motorStop();
   }
-  redirectHome("Function: OpenDoor");
 }
 
-void closeDoor() {
-  if (doorClosedSwitch.isReleased()) {
+void startClosing() {
+  if (!switches.isPressed(DOOR_CLOSED_PIN)) {
     setDoorState(DOOR_STATE_CLOSING);
     motorReverse();
   }
@@ -178,7 +273,42 @@ void closeDoor() {
     setDoorState(DOOR_STATE_CLOSED);
     motorStop();
   }
-  redirectHome("Function: CloseDoor");
+}
+
+//Limit switch made. Run on for the overrun time, then serviceOverrun() stops the door
+void arriveOpen() {
+  startOverrun(DOOR_STATE_OPEN);
+}
+
+void arriveClosed() {
+  startOverrun(DOOR_STATE_CLOSED);
+}
+
+void startOverrun(int pStoppedState) {
+  if (!overrunning) {
+    overrunning = true;
+    overrunStartedAt = millis();
+    overrunStoppedState = pStoppedState;
+  }
+}
+
+//Stop a door that has run on past its limit switch for the overrun time
+void serviceOverrun() {
+  if (overrunning && millis() - overrunStartedAt >= (unsigned long)overRun) {
+    stopDoor(overrunStoppedState);
+  }
+}
+
+void haltOpening() {
+  stopDoor(DOOR_STATE_STOPPED_OPENING);
+}
+
+void haltClosing() {
+  stopDoor(DOOR_STATE_STOPPED_CLOSING);
+}
+
+void markOpen() {
+  setDoorState(DOOR_STATE_OPEN);
 }
 
 void stopDoor(int stoppedState) {
@@ -189,31 +319,69 @@ void stopDoor(int stoppedState) {
 void stopDoorOpened() {
   setDoorState(DOOR_STATE_OPEN);
   motorStop();
-  redirectHome("Function: StopDoorOpened");
 }
 
 void stopDoorClosed() {
   setDoorState(DOOR_STATE_CLOSED);
   motorStop();
-  redirectHome("Function: StopDoorClosed");
 }
 
 //Set alarms to trigger door actions at sunrise/sunset
 void setSunAlarms() {
   time_t sunrise;
   time_t sunset;
+  String alarms;
   TimeElements sunsetElements;
   TimeElements sunriseElements;
   sunrise = getSunTimes(SUNCALC_SUNRISE, localTime.toLocal(now()), ZENITH_DEFAULT);
   sunset = getSunTimes(SUNCALC_SUNSET, localTime.toLocal(now()), ZENITH_NAUTICAL);
   breakTime(sunset, sunsetElements);
   breakTime(sunrise, sunriseElements);
-  closeAlarm = Alarm.alarmOnce(sunsetElements.Hour, sunsetElements.Minute, sunsetElements.Second, closeDoor);
-  openAlarm =  Alarm.alarmOnce(sunriseElements.Hour, sunriseElements.Minute, sunriseElements.Second, openDoor);
+  closeAlarm = Alarm.alarmOnce(sunsetElements.Hour, sunsetElements.Minute, sunsetElements.Second, alarmCloseDoor);
+  openAlarm =  Alarm.alarmOnce(sunriseElements.Hour, sunriseElements.Minute, sunriseElements.Second, alarmOpenDoor);
+  logEvent(EVENT_ALARM, ALARM_CLOSE, ALARM_SCHEDULED, sunset);
+  logEvent(EVENT_ALARM, ALARM_OPEN, ALARM_SCHEDULED, sunrise);
+  openAtUTC = localTime.toUTC(sunrise);
+  closeAtUTC = localTime.toUTC(sunset);
+  alarms = "{\"open\":";
+  alarms.concat(openAtUTC);
+  alarms.concat(",\"close\":");
+  alarms.concat(closeAtUTC);
+  alarms.concat("}");
+  telemetry.setStatus(telemetryAlarms, alarms);
+}
+
+void alarmOpenDoor() {
+  logEvent(EVENT_ALARM, ALARM_OPEN, ALARM_FIRED, 0);
+  openDoor();
+}
+
+void alarmCloseDoor() {
+  logEvent(EVENT_ALARM, ALARM_CLOSE, ALARM_FIRED, 0);
+  closeDoor();
+}
+
+//Buffer an event in RAM. It reaches flash on the next flushEventLog(), and the broker on a later serviceTelemetry()
+void logEvent(uint8_t pType, uint8_t pCode, uint8_t pDetail, int32_t pValue) {
+  eventRecord record = { 0, (uint32_t)now(), pType, pCode, pDetail, 0, pValue };
+  record.seq = eventLog.append(record.time, pType, pCode, pDetail, pValue);
+  telemetry.queueEvent(record);
+}
+
+//Write buffered events to flash, but never while the motor is running
+void flushEventLog() {
+  TRACE_SPAN(tracer, "flushEventLog");
+  if (doorState == DOOR_STATE_OPENING || doorState == DOOR_STATE_CLOSING || upload.active) {
+    return;
+  }
+  if (eventLog.flushDue(millis())) {
+    eventLog.flush(millis());
+  }
 }
 
 //Pad time elements with a leading zero for display
 String padInteger(int pUnPadded) {
+  HEAP_SCOPE(heapProfiler, "padInteger");
   String unPadded;
   String padded;
   if (pUnPadded < 10) {
@@ -247,6 +415,7 @@ String dateToString(time_t inputTime) {
 //Calculate sunrise and suset
 //void CalcSun(int calcType, int year, int month, int day, int zenithType, int *ptrHour, int *ptrMinute)
 time_t getSunTimes(int calculationType, time_t inputDate, int zenithType) {
+  TRACE_SPAN(tracer, "getSunTimes");
   TimeElements inputDateElements;
   TimeElements outputTimeElements;
   breakTime(inputDate, inputDateElements);
@@ -355,6 +524,7 @@ time_t getSunTimes(int calculationType, time_t inputDate, int zenithType) {
   }
   outputTimeElements.Hour = (int)calcHour;
   outputTimeElements.Minute = (int)calcMinute;
+  outputTimeElements.Second = 0;
   outputTimeElements.Day = inputDateElements.Day;
   outputTimeElements.Month = inputDateElements.Month;
   outputTimeElements.Year = inputDateElements.Year;
@@ -362,9 +532,25 @@ time_t getSunTimes(int calculationType, time_t inputDate, int zenithType) {
   return makeTime(outputTimeElements);
 }
 
-//Sync system time with RTC
+//Sync system time with the drift corrected clock, reading the RTC only when its error could be too large
 time_t syncProvider() {
-  return RTC.now().unixtime();
+  unsigned long ms = millis();
+  if (rtcClock.syncDue(ms)) {
+    rtcClock.sync(RTC.now().unixtime(), ms);
+  }
+  return rtcClock.now(ms);
+}
+
+void serviceClock() {
+  TRACE_SPAN(tracer, "serviceClock");
+  unsigned long ms = millis();
+  if (rtcClock.syncDue(ms)) {
+    rtcClock.sync(RTC.now().unixtime(), ms);
+  }
+  if (ms - clockSetAt >= CLOCK_ALIGN_INTERVAL && rtcClock.millisecond(ms) < CLOCK_ALIGN_WINDOW) {
+    setTime(rtcClock.now(ms));
+    clockSetAt = ms;
+  }
 }
 
 String getAlarmTime (int pAlarm, int pFormat, bool pUTC) {
@@ -496,6 +682,8 @@ String getSunsetTime(int pFormat, bool pUTC) {
 }
 
 void setupWifi() {
+  TRACE_SPAN(tracer, "setupWifi");
+  HEAP_SCOPE(heapProfiler, "setupWifi");
   String eepromSSID = "";
   String eepromPWD = "";
   int i;
@@ -543,49 +731,235 @@ char* string2char(String command){
 }
 
 void setupServer() {
-  //Setup request handling
-  server.on("/", handleRoot);
-  server.on("/open", openDoor);
-  server.on("/close", closeDoor);
-  server.on("/override", alterDoorState);
-  server.on("/stopopened", stopDoorOpened);
-  server.on("/stopclosed", stopDoorClosed);
-  server.on("/header.png", loadHeaderImage);
-  server.on("/date.png", loadDateImage);
-  server.on("/door.png", loadDoorImage);
-  server.on("/sunrise.png", loadSunriseImage);
-  server.on("/sunset.png", loadSunsetImage);
-  server.on("/time.png", loadTimeImage);
-  server.on("/pollo.css", loadCSS);
-  server.on("/setwifi", setWifi);
-  server.on("/clearwifi", clearWifiCredentials);
-  server.on("/settime", setRTCTime);
-  server.on("/setoverrun", setOverRun);
-  server.on("/settings", handleSettings);
-  server.on("/reset", handleReset);
-  server.serveStatic("/",  SPIFFS, "/" ,"max-age=86400");
+  //Setup request handling from ROUTES. Handlers run from the network stack, so anything that moves
+  //the door or writes EEPROM is queued for loop() with queueWebCommand(). Pages are still built
+  //here, outside the scheduler's tick budget
+  Router *router = new Router(ROUTES, &ROUTE_INDEX);
+  limiter.setBudget(RATE_READ, RATE_READ_BURST, RATE_READ_REFILL);
+  limiter.setBudget(RATE_CONTROL, RATE_CONTROL_BURST, RATE_CONTROL_REFILL);
+  router->setLimiter(&limiter);
+  router->setProfiler(&heapProfiler);
+  router->setFallback(RATE_READ, handleFile);
+  server.addHandler(router);
   server.begin();
 }
 
-void handleRoot() {
+//Queue a state change from a request handler. Returns false when the queue is full
+bool queueWebCommand(uint8_t pType, int32_t pValue, const wifiCredentials *pCreds, const mqttSettings *pMqtt) {
+  if (webCommandCount == WEB_COMMAND_QUEUE) {
+    return false;
+  }
+  webCommand &command = webCommands[(webCommandHead + webCommandCount) % WEB_COMMAND_QUEUE];
+  command.type = pType;
+  command.value = pValue;
+  if (pCreds != NULL) {
+    command.creds = *pCreds;
+  }
+  if (pMqtt != NULL) {
+    command.mqtt = *pMqtt;
+  }
+  webCommandCount++;
+  return true;
+}
+
+//Run queued web commands from loop(), within WEB_COMMAND_BUDGET microseconds
+void serviceWebCommands() {
+  TRACE_SPAN(tracer, "serviceWebCommands");
+  unsigned long start = micros();
+  while (webCommandCount > 0) {
+    webCommand command = webCommands[webCommandHead];
+    //Commands run in order, so everything behind a held one waits too
+    if (!webCommandReady(command)) {
+      break;
+    }
+    webCommandHead = (webCommandHead + 1) % WEB_COMMAND_QUEUE;
+    webCommandCount--;
+    runWebCommand(command);
+    if (micros() - start >= WEB_COMMAND_BUDGET) {
+      break;
+    }
+  }
+}
+
+//A door command that would start the motor waits for a running overrun to finish and then until
+//the motor has rested since it stopped, so a burst of overrides can't reverse it faster than MOTOR_REST_MILLIS
+bool webCommandReady(const webCommand &pCommand) {
+  int target;
+  if (pCommand.type != WEB_COMMAND_OPEN && pCommand.type != WEB_COMMAND_CLOSE && pCommand.type != WEB_COMMAND_OVERRIDE) {
+    return true;
+  }
+  target = expectedDoorState(pCommand.type);
+  if (target != DOOR_STATE_OPENING && target != DOOR_STATE_CLOSING) {
+    return true;
+  }
+  return !overrunning && millis() - motorStoppedAt >= MOTOR_REST_MILLIS;
+}
+
+void runWebCommand(const webCommand &pCommand) {
+  switch (pCommand.type) {
+    case WEB_COMMAND_OPEN:
+      openDoor();
+      break;
+    case WEB_COMMAND_CLOSE:
+      closeDoor();
+      break;
+    case WEB_COMMAND_OVERRIDE:
+      overrideDoor();
+      break;
+    case WEB_COMMAND_STOP_OPENED:
+      stopDoorOpened();
+      break;
+    case WEB_COMMAND_STOP_CLOSED:
+      stopDoorClosed();
+      break;
+    case WEB_COMMAND_STOP:
+      haltDoor();
+      break;
+    case WEB_COMMAND_NEW_UDP_KEY:
+      newUdpKey();
+      break;
+    case WEB_COMMAND_SET_WIFI:
+      setWifi(pCommand.creds);
+      break;
+    case WEB_COMMAND_CLEAR_WIFI:
+      clearWifiCredentials();
+      break;
+    case WEB_COMMAND_SET_TIME:
+      setRTCTime(pCommand.value);
+      break;
+    case WEB_COMMAND_SET_OVERRUN:
+      setOverRun(pCommand.value);
+      break;
+    case WEB_COMMAND_RESET:
+      ESP.restart();
+      break;
+    case WEB_COMMAND_APPLY_UPDATE:
+      applyUpdate(pCommand.value);
+      break;
+    case WEB_COMMAND_SET_MQTT:
+      setMqtt(pCommand.mqtt);
+      break;
+    default:
+      break;
+  }
+}
+
+//Queue a command and send the browser home, or answer 503 if loop() is behind. With format=json the
+//page's script gets the door state change and message instead, and updates itself in place
+void queueAndRedirect(AsyncWebServerRequest *request, uint8_t pType, int32_t pValue, const wifiCredentials *pCreds, String message, const mqttSettings *pMqtt) {
+  String json;
+  int from = doorState;
+  int to = expectedDoorState(pType);
+
+  if (!queueWebCommand(pType, pValue, pCreds, pMqtt)) {
+    request->send(503, "text/plain", "Busy");
+    return;
+  }
+  if (request->arg("format") != "json") {
+    redirectHome(request, message);
+    return;
+  }
+  json = "{\"from\":";
+  json.concat(jsonString(FPSTR(pgm_read_ptr(&DOOR_STATE_TABLE[from].name))));
+  json.concat(",\"state\":");
+  json.concat(jsonString(FPSTR(pgm_read_ptr(&DOOR_STATE_TABLE[to].name))));
+  json.concat(",\"message\":");
+  json.concat(jsonString(message));
+  json.concat("}");
+  request->send(200, "application/json", json);
+}
+
+//State the door is headed for once a queued command has run. Arriving at a made limit switch
+//settles it a step further, which the next page load shows
+int expectedDoorState(uint8_t pType) {
+  switch (pType) {
+    case WEB_COMMAND_OPEN:
+      return DOOR_ACTION_TARGET[DOOR_ACTION_OPEN];
+    case WEB_COMMAND_CLOSE:
+      return DOOR_ACTION_TARGET[DOOR_ACTION_CLOSE];
+    case WEB_COMMAND_OVERRIDE:
+      return DOOR_ACTION_TARGET[pgm_read_byte(&DOOR_STATE_TABLE[doorState].onOverride)];
+    case WEB_COMMAND_STOP_OPENED:
+      return DOOR_STATE_OPEN;
+    case WEB_COMMAND_STOP_CLOSED:
+      return DOOR_STATE_CLOSED;
+    case WEB_COMMAND_STOP:
+      if (doorState == DOOR_STATE_OPENING) {
+        return DOOR_ACTION_TARGET[DOOR_ACTION_HALT_OPENING];
+      }
+      if (doorState == DOOR_STATE_CLOSING) {
+        return DOOR_ACTION_TARGET[DOOR_ACTION_HALT_CLOSING];
+      }
+      return doorState;
+    default:
+      return doorState;
+  }
+}
+
+//Quote and escape text for a JSON response
+String jsonString(const String &pText) {
+  String json = "\"";
+  char hex[7];
+  unsigned int i;
+
+  for (i = 0; i < pText.length(); i++) {
+    char c = pText.charAt(i);
+    if (c == '"' || c == '\\') {
+      json.concat('\\');
+      json.concat(c);
+    }
+    else if ((uint8_t)c < 0x20) {
+      snprintf(hex, sizeof(hex), "\\u%04x", c);
+      json.concat(hex);
+    }
+    else {
+      json.concat(c);
+    }
+  }
+  json.concat('"');
+  return json;
+}
+
+void handleOpen(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_OPEN, 0, NULL, "Function: OpenDoor");
+}
+
+void handleClose(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_CLOSE, 0, NULL, "Function: CloseDoor");
+}
+
+void handleOverride(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_OVERRIDE, 0, NULL, "Function: AlterDoorState");
+}
+
+void handleStopOpened(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_STOP_OPENED, 0, NULL, "Function: StopDoorOpened");
+}
+
+void handleStopClosed(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_STOP_CLOSED, 0, NULL, "Function: StopDoorClosed");
+}
+
+void handleRoot(AsyncWebServerRequest *request) {
+  TRACE_SPAN(tracer, "handleRoot");
   String htmlString;
-  htmlString="";
+  htmlString.reserve(ROOT_PAGE_LENGTH);
     htmlString.concat("<html>");
     htmlString.concat("<head>");
       htmlString.concat("<title>Casa del Pollo</title>");
       htmlString.concat("<META name='viewport' content='width=device-width, initial-scale=1.0, maximum-scale=1.0' />");
       htmlString.concat("<META name='format-detection' content='telephone=no' />");
       htmlString.concat("<link rel='stylesheet' href='/pollo.css'>");
+      htmlString.concat("<script src='/pollo.js' defer></script>");
     htmlString.concat("</head>");
     htmlString.concat("<body>");
       htmlString.concat("<div class='content'>");
         htmlString.concat("<div class='header'>");
         htmlString.concat("</div>");
-        if (server.arg("message") != "" ) {
-          htmlString.concat("<div class='message'>");
-          htmlString.concat(server.arg("message"));
-          htmlString.concat("</div>");
-        }
+        //Kept even when empty, for pollo.js to fill in
+        htmlString.concat(request->arg("message") != "" ? "<div class='message' id='message'>" : "<div class='message' id='message' hidden>");
+        htmlString.concat(request->arg("message"));
+        htmlString.concat("</div>");
         htmlString.concat("<div class='info'>");
           htmlString.concat("<table>");
             htmlString.concat("<tr>");
@@ -624,7 +998,7 @@ void handleRoot() {
               htmlString.concat("<td>");
                 htmlString.concat("<div class='doorstate'>");
               htmlString.concat("</td>");
-              htmlString.concat("<td class='data'>");
+              htmlString.concat("<td class='data' id='state'>");
                 htmlString.concat(getDoorState());
               htmlString.concat("</td>");
             htmlString.concat("</tr>");
@@ -637,15 +1011,15 @@ void handleRoot() {
                 htmlString.concat("<a href='/' class='button'>Refresh</a>");
               htmlString.concat("</td>");
               htmlString.concat("<td>");
-                htmlString.concat("<a href='stopopened' class='buttonOpen'>Set Open</a>");
+                htmlString.concat("<a href='stopopened' data-action class='buttonOpen'>Set Open</a>");
               htmlString.concat("</td>");
             htmlString.concat("</tr>");
             htmlString.concat("<tr>");
               htmlString.concat("<td>");
-                htmlString.concat("<a href='override' class='buttonOverride'>Override</a>");
+                htmlString.concat("<a href='override' data-action class='buttonOverride'>Override</a>");
               htmlString.concat("</td>");
               htmlString.concat("<td>");
-                htmlString.concat("<a href='stopclosed' class='buttonClosed'>Set Closed</a>");
+                htmlString.concat("<a href='stopclosed' data-action class='buttonClosed'>Set Closed</a>");
               htmlString.concat("</td>");
             htmlString.concat("</tr>");
             htmlString.concat("<tr>");
@@ -660,133 +1034,446 @@ void handleRoot() {
       htmlString.concat("</div>");
     htmlString.concat("</body>");
   htmlString.concat("</html>");
-  server.send(200, "text/html", htmlString);
+  request->send(200, "text/html", htmlString);
+}
+
+void loadScript(AsyncWebServerRequest *request) {
+  sendAsset(request, "/pollo.js", "application/javascript");
+}
+
+void loadCSS(AsyncWebServerRequest *request) {
+  sendFile(request, "/pollo.css", "text/css");
 }
 
-void loadCSS(){
-  File file = SPIFFS.open("/pollo.css", "r");
-  server.streamFile(file, "text/css");
-  file.close();
+void loadHeaderImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/header.png", "image/png");
 }
 
-void loadHeaderImage(){
-  File file = SPIFFS.open("/header.png", "r");
-  server.streamFile(file, "image/png");
-  file.close();
+void loadDateImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/date.png", "image/png");
 }
 
-void loadDateImage() {
-  File file = SPIFFS.open("/date.png", "r");
-  server.streamFile(file, "image/png");
-  file.close();
+void loadDoorImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/door.png", "image/png");
 }
 
-void loadDoorImage() {
-  File file = SPIFFS.open("/door.png", "r");
-  server.streamFile(file, "image/png");
-  file.close();
+void loadSunriseImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/sunrise.png", "image/png");
 }
 
-void loadSunriseImage() {
-  File file = SPIFFS.open("/sunrise.png", "r");
-  server.streamFile(file, "image/png");
-  file.close();
+void loadSunsetImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/sunset.png", "image/png");
 }
 
-void loadSunsetImage() {
-  File file = SPIFFS.open("/sunset.png", "r");
- server.streamFile(file, "image/png");
-  file.close();
+void loadTimeImage(AsyncWebServerRequest *request) {
+  sendAsset(request, "/time.png", "image/png");
 }
 
-void loadTimeImage() {
-  File file = SPIFFS.open("/time.png", "r");
-  server.streamFile(file, "image/png");
-  file.close();
+//Serve a static file from the RAM cache, or stream it from LittleFS when it isn't cached; a
+//missed asset is loaded later by serviceAssets(). The asset stays pinned until the response has gone
+void sendAsset(AsyncWebServerRequest *request, const char *pPath, const char *pContentType) {
+  TRACE_SPAN(tracer, "sendAsset");
+  AsyncWebServerResponse *response;
+  cachedAsset *asset = assets.get(pPath);
+  if (asset == NULL) {
+    sendFile(request, pPath, pContentType);
+    return;
+  }
+  response = request->beginResponse_P(200, pContentType, asset->data, asset->length);
+  if (asset->gzipped) {
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("Cache-Control", "max-age=86400");
+  request->onDisconnect([asset]() {
+    assets.release(asset);
+  });
+  request->send(response);
 }
 
-void redirectHome(String message) {
+//Any other GET is for a file at the top of LittleFS. Nothing below it is served, so the rollback
+//image in /ota and the raw event log in /log stay on the door. LittleFS skips repeated slashes and
+//follows . and .., so a path with a second slash or a leading dot is turned away whatever it names
+void handleFile(AsyncWebServerRequest *request) {
+  AsyncWebServerResponse *response;
+  const String &path = request->url();
+  if (request->method() != HTTP_GET || path.length() < 2 || path.indexOf('/', 1) >= 0 || path[1] == '.'
+    || (!LittleFS.exists(path) && !LittleFS.exists(path + ".gz"))) {
+    request->send(404);
+    return;
+  }
+  response = request->beginResponse(LittleFS, path);
+  response->addHeader("Cache-Control", "max-age=86400");
+  request->send(response);
+}
+
+//Stream a file from LittleFS, its precompressed <path>.gz when there is one
+void sendFile(AsyncWebServerRequest *request, const char *pPath, const char *pContentType) {
+  AsyncWebServerResponse *response;
+  String gzipped = String(pPath) + ".gz";
+  if (LittleFS.exists(gzipped)) {
+    response = request->beginResponse(LittleFS, gzipped, pContentType);
+    response->addHeader("Content-Encoding", "gzip");
+  } else {
+    response = request->beginResponse(LittleFS, pPath, pContentType);
+  }
+  response->addHeader("Cache-Control", "max-age=86400");
+  request->send(response);
+}
+
+void redirectHome(AsyncWebServerRequest *request, String message) {
+  HEAP_SCOPE(heapProfiler, "redirectHome");
   String homeURL = "/";
   if (message.length() > 0) {
     homeURL.concat("?message=");
     homeURL.concat(message);
   }
-  server.sendHeader("Location", homeURL, true);
-  server.send ( 302, "text/plain", "");
+  request->redirect(homeURL);
 }
 
-void setWifi () {
-  String message;
-  int i;
-  String pSSID;
-  String pPassword;
-  char chSSID[20];
-  char chPWD[20];
-  wifiCredentials creds;
+//Stream the event log as CSV, or raw 16 byte records with format=bin
+//Filters: from=<first seq>, count=<max records>, since=<UTC unix time>
+//Records are read a batch at a time as the client's TCP window opens
+void handleLog(AsyncWebServerRequest *request) {
+  String error;
+  logStream stream;
+  logArgs args = { 0, -1, 0, "" };
 
-  if (server.arg("ssid")==""){
+  if (!parseArgs(request, LOG_ARGS, sizeof(LOG_ARGS) / sizeof(LOG_ARGS[0]), &args, error)) {
+    sendArgError(request, error);
     return;
+  }
+  stream.seq = eventLog.firstSeq();
+  if ((uint32_t)args.from > stream.seq) {
+    stream.seq = args.from;
+  }
+  stream.remaining = args.count < 0 ? 0xFFFFFFFF : args.count;
+  stream.since = args.since;
+  stream.binary = strcmp(args.format, "bin") == 0;
+  stream.headerSent = stream.binary;
+
+  request->send(request->beginChunkedResponse(stream.binary ? "application/octet-stream" : "text/csv",
+    [stream](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+      return fillLogStream(stream, buffer, maxLen);
+    }));
+}
+
+size_t fillLogStream(logStream &pStream, uint8_t *pBuffer, size_t pMaxLen) {
+  TRACE_SPAN(tracer, "fillLogStream");
+  eventRecord records[LOG_STREAM_RECORDS];
+  char line[LOG_LINE_LENGTH];
+  size_t length = 0;
+  size_t lineLength;
+  size_t i;
+  size_t n;
+
+  if (!pStream.headerSent) {
+    lineLength = strlen(LOG_CSV_HEADER);
+    if (pMaxLen < lineLength) {
+      return RESPONSE_TRY_AGAIN;
+    }
+    memcpy(pBuffer, LOG_CSV_HEADER, lineLength);
+    length = lineLength;
+    pStream.headerSent = true;
+  }
+  while (pStream.remaining > 0) {
+    n = eventLog.read(pStream.seq, records, LOG_STREAM_RECORDS);
+    if (n == 0) {
+      break;
+    }
+    for (i = 0; i < n && pStream.remaining > 0; i++) {
+      if (records[i].time < pStream.since) {
+        pStream.seq = records[i].seq + 1;
+        continue;
+      }
+      if (pStream.binary) {
+        memcpy(line, &records[i], sizeof(eventRecord));
+        lineLength = sizeof(eventRecord);
+      } else {
+        lineLength = snprintf(line, sizeof(line), "%u,%u,%s,%u,%u,%d\n", records[i].seq, records[i].time,
+          records[i].type <= EVENT_CONFIG ? EVENT_TYPE_NAME[records[i].type] : "unknown",
+          records[i].code, records[i].detail, records[i].value);
+      }
+      if (length + lineLength > pMaxLen) {
+        return length > 0 ? length : RESPONSE_TRY_AGAIN;
+      }
+      memcpy(pBuffer + length, line, lineLength);
+      length += lineLength;
+      pStream.seq = records[i].seq + 1;
+      pStream.remaining--;
+    }
+  }
+  return length;
+}
+
+//Stream the trace ring as Chrome trace-event JSON, for chrome://tracing or Perfetto.
+//Reading it to the end unfreezes a trace held around a stall
+void handleTrace(AsyncWebServerRequest *request) {
+  traceStream stream;
+  traceSpan first;
+  stream.seq = tracer.firstSeq();
+  stream.end = tracer.nextSeq();
+  stream.base = tracer.read(stream.seq, &first, 1) == 1 ? first.start : 0;
+  stream.sent = 0;
+  stream.headerSent = false;
+  stream.footerSent = false;
+
+  request->send(request->beginChunkedResponse("application/json",
+    [stream](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+      return fillTraceStream(stream, buffer, maxLen);
+    }));
+}
+
+size_t fillTraceStream(traceStream &pStream, uint8_t *pBuffer, size_t pMaxLen) {
+  static const char header[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  static const char footer[] = "]}\n";
+  traceSpan spans[TRACE_STREAM_SPANS];
+  char event[TRACE_EVENT_LENGTH];
+  size_t length = 0;
+  size_t eventLength;
+  size_t i;
+  size_t n;
+
+  if (!pStream.headerSent) {
+    if (pMaxLen < sizeof(header) - 1) {
+      return RESPONSE_TRY_AGAIN;
+    }
+    memcpy(pBuffer, header, sizeof(header) - 1);
+    length = sizeof(header) - 1;
+    pStream.headerSent = true;
+  }
+  //Spans recorded since the request started wait for the next one
+  while (pStream.seq < pStream.end) {
+    if (pStream.seq < tracer.firstSeq()) {
+      pStream.seq = tracer.firstSeq();
+      continue;
+    }
+    n = tracer.read(pStream.seq, spans, pStream.end - pStream.seq < TRACE_STREAM_SPANS ? pStream.end - pStream.seq : TRACE_STREAM_SPANS);
+    for (i = 0; i < n; i++) {
+      eventLength = snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%u,\"dur\":%u}",
+        pStream.sent > 0 ? "," : "", spans[i].name, spans[i].start - pStream.base, spans[i].duration);
+      if (length + eventLength > pMaxLen) {
+        return length > 0 ? length : RESPONSE_TRY_AGAIN;
+      }
+      memcpy(pBuffer + length, event, eventLength);
+      length += eventLength;
+      pStream.seq++;
+      pStream.sent++;
+    }
+    if (n == 0) {
+      break;
+    }
+  }
+  if (!pStream.footerSent) {
+    if (length + sizeof(footer) - 1 > pMaxLen) {
+      return length > 0 ? length : RESPONSE_TRY_AGAIN;
+    }
+    memcpy(pBuffer + length, footer, sizeof(footer) - 1);
+    length += sizeof(footer) - 1;
+    pStream.footerSent = true;
+    tracer.resume();
+  }
+  return length;
+}
+
+//Allocations per route and HEAP_SCOPE, the heap's low water marks and a day of its worst moments, as JSON.
+//Samples are [uptime seconds, free, largest block, fragmentation %], oldest first
+void handleHeap(AsyncWebServerRequest *request) {
+  heapStream stream;
+  stream.index = 0;
+  stream.sites = heapProfiler.sites();
+  stream.samples = heapProfiler.samples();
+
+  request->send(request->beginChunkedResponse("application/json",
+    [stream](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+      return fillHeapStream(stream, buffer, maxLen);
+    }));
+}
+
+size_t fillHeapStream(heapStream &pStream, uint8_t *pBuffer, size_t pMaxLen) {
+  char element[HEAP_ELEMENT_LENGTH];
+  size_t length = 0;
+  size_t elementLength;
+
+  while ((elementLength = heapElement(pStream, element, sizeof(element))) > 0) {
+    if (length + elementLength > pMaxLen) {
+      return length > 0 ? length : RESPONSE_TRY_AGAIN;
+    }
+    memcpy(pBuffer + length, element, elementLength);
+    length += elementLength;
+    pStream.index++;
+  }
+  return length;
+}
+
+//Element pStream.index of /heap. 0 once everything is sent
+size_t heapElement(const heapStream &pStream, char *pElement, size_t pSize) {
+  heapCounters counts;
+  int length;
+  size_t i = pStream.index;
+
+  if (i == 0) {
+    heapCounts(counts);
+    length = snprintf(pElement, pSize, "{\"free\":%u,\"largest\":%u,\"fragmentation\":%u,\"minFree\":%u,\"minLargest\":%u,"
+      "\"maxFragmentation\":%u,\"allocs\":%u,\"frees\":%u,\"bytes\":%u,\"failed\":%u,\"overBudget\":%u,\"untracked\":%u,\"sites\":[",
+      ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation(), heapProfiler.minFree(), heapProfiler.minLargest(),
+      heapProfiler.maxFragmentation(), counts.allocs, counts.frees, counts.bytes, counts.failed, heapProfiler.overBudget(),
+      heapProfiler.untracked());
+  } else if (i <= pStream.sites) {
+    const heapSite &site = heapProfiler.site(i - 1);
+    length = snprintf(pElement, pSize, "%s{\"name\":\"%s\",\"calls\":%u,\"allocs\":%u,\"bytes\":%u,\"kept\":%u,\"maxAllocs\":%u,"
+      "\"maxBytes\":%u,\"budgetAllocs\":%u,\"budgetBytes\":%u,\"overBudget\":%u}", i > 1 ? "," : "", site.name, site.calls,
+      site.allocs, site.bytes, site.kept, site.maxAllocs, site.maxBytes, site.budgetAllocs, site.budgetBytes, site.overBudget);
+  } else if (i == pStream.sites + 1u) {
+    length = snprintf(pElement, pSize, "],\"samples\":[");
+  } else if (i <= pStream.sites + 1u + pStream.samples) {
+    i -= pStream.sites + 2;
+    const heapSample &sample = heapProfiler.sample(i);
+    length = snprintf(pElement, pSize, "%s[%u,%u,%u,%u]", i > 0 ? "," : "", sample.uptime, sample.free, sample.largest,
+      sample.fragmentation);
+  } else if (i == pStream.sites + 2u + pStream.samples) {
+    length = snprintf(pElement, pSize, "]}\n");
   } else {
-    if (server.arg("password")=="") {
-      return;
-    } else {
-      pSSID = server.arg("ssid");
-      pPassword = server.arg("password");
+    return 0;
+  }
+  return length < (int)pSize ? length : pSize - 1;
+}
+
+//Per task runtime stats from the scheduler, as JSON. Times are microseconds; worstGap is the
+//longest a task waited between runs, which for the door is its worst case period
+void handleTasks(AsyncWebServerRequest *request) {
+  taskStream stream;
+  stream.index = 0;
+
+  request->send(request->beginChunkedResponse("application/json",
+    [stream](uint8_t *buffer, size_t maxLen, size_t) mutable -> size_t {
+      return fillTaskStream(stream, buffer, maxLen);
+    }));
+}
+
+size_t fillTaskStream(taskStream &pStream, uint8_t *pBuffer, size_t pMaxLen) {
+  char element[TASK_ELEMENT_LENGTH];
+  size_t length = 0;
+  size_t elementLength;
+
+  while ((elementLength = taskElement(pStream, element, sizeof(element))) > 0) {
+    if (length + elementLength > pMaxLen) {
+      return length > 0 ? length : RESPONSE_TRY_AGAIN;
     }
+    memcpy(pBuffer + length, element, elementLength);
+    length += elementLength;
+    pStream.index++;
   }
-  pSSID.toCharArray(chSSID,20);
-  pPassword.toCharArray(chPWD,20);
-  
-  for ( i=0; i< 20; i++) {
-    creds.ssid[i] = chSSID[i];
-    creds.pwd[i] = chPWD[i];
+  return length;
+}
+
+//Element pStream.index of /tasks. 0 once everything is sent
+size_t taskElement(const taskStream &pStream, char *pElement, size_t pSize) {
+  int length;
+  uint8_t i = pStream.index;
+
+  if (i == 0) {
+    length = snprintf(pElement, pSize, "{\"ticks\":%u,\"tickBudget\":%u,\"tasks\":[", scheduler.ticks(), SCHEDULER_TICK_BUDGET);
+  } else if (i <= scheduler.count()) {
+    const schedulerTask &task = scheduler.task(i - 1);
+    const taskStats &stats = scheduler.stats(i - 1);
+    length = snprintf(pElement, pSize, "%s{\"name\":\"%s\",\"priority\":%u,\"period\":%u,\"budget\":%u,\"runs\":%u,\"micros\":%llu,"
+      "\"longest\":%u,\"overruns\":%u,\"worstGap\":%u}", i > 1 ? "," : "", task.name, task.priority, task.period, task.budget,
+      stats.runs, (unsigned long long)stats.micros, stats.longest, stats.overruns, stats.worstGap);
+  } else if (i == scheduler.count() + 1) {
+    length = snprintf(pElement, pSize, "]}\n");
+  } else {
+    return 0;
+  }
+  return length < (int)pSize ? length : pSize - 1;
+}
+
+void handleSetWifi(AsyncWebServerRequest *request) {
+  String message;
+  wifiCredentials creds;
+
+  memset(&creds, 0, sizeof(creds));
+  if (!parseArgs(request, WIFI_ARGS, sizeof(WIFI_ARGS) / sizeof(WIFI_ARGS[0]), &creds, message)) {
+    sendArgError(request, message);
+    return;
   }
-  EEPROM.put(4,creds);
-  EEPROM.commit();
   message = "Wifi Credentials Set";
   message.concat("<br><b>SSID</b>: ");
-  message.concat(pSSID);
+  message.concat(creds.ssid);
   message.concat("<br><b>Password</b>: ");
-  message.concat(pPassword);
-  redirectHome(message);
+  message.concat(creds.pwd);
+  queueAndRedirect(request, WEB_COMMAND_SET_WIFI, 0, &creds, message);
+}
+
+void sendArgError(AsyncWebServerRequest *request, const String &pError) {
+  request->send(400, "text/plain", pError);
 }
 
-void setRTCTime() {
+void setWifi(const wifiCredentials &pCreds) {
+  EEPROM.put(4, pCreds);
+  commitEEPROM();
+  logEvent(EVENT_CONFIG, CONFIG_WIFI, 0, 0);
+}
+
+void handleSetTime(AsyncWebServerRequest *request) {
   String message;
-  TimeElements newTimeElements;
   time_t newTime;
   time_t newTimeUTC;
+  timeArgs args = { 0, 0, 0, 0, 0, 0 };
   //Get Time Elements from querystring
-  String argYear = server.arg("year");
-  String argMonth = server.arg("month");
-  String argHour = server.arg("hour");
-  String argMinute = server.arg("minute");
-  String argSecond = server.arg("second");
-  String argDay = server.arg("day");
-  //build newTime from TimeElements
-  newTimeElements.Year = argYear.toInt()-1970;
-  newTimeElements.Month = argMonth.toInt();
-  newTimeElements.Day = argDay.toInt();
-  newTimeElements.Hour = argHour.toInt();
-  newTimeElements.Minute = argMinute.toInt();
-  newTimeElements.Second = argSecond.toInt(); 
+  if (!parseArgs(request, TIME_ARGS, sizeof(TIME_ARGS) / sizeof(TIME_ARGS[0]), &args, message)) {
+    sendArgError(request, message);
+    return;
+  }
+  newTimeUTC = timeArgsToUTC(args);
+  if (newTimeUTC == 0) {
+    sendArgError(request, "day is past the end of the month");
+    return;
+  }
+  newTime = localTime.toLocal(newTimeUTC);
+  message = "RTC Time Set: ";
+  message.concat(dateToString(newTime));
+  message.concat(" ");
+  message.concat(timeToString(newTime));
+  queueAndRedirect(request, WEB_COMMAND_SET_TIME, newTimeUTC, NULL, message);
+}
+
+//Local time from a settime to UTC, or 0 if the day is past the end of the month
+time_t timeArgsToUTC(const timeArgs &pArgs) {
+  TimeElements newTimeElements;
+  time_t newTime;
+  newTimeElements.Year = pArgs.year - 1970;
+  newTimeElements.Month = pArgs.month;
+  newTimeElements.Day = pArgs.day;
+  newTimeElements.Hour = pArgs.hour;
+  newTimeElements.Minute = pArgs.minute;
+  newTimeElements.Second = pArgs.second;
   newTime = makeTime(newTimeElements);
+  //makeTime() rolls 31 June over to 1 July
+  if (day(newTime) != pArgs.day) {
+    return 0;
+  }
   //Internal times use UTC. Convert to UTC
-  newTimeUTC = localTime.toUTC(newTime);
-  //RTC.adjust(DateTime(2017, 8, 20, 9, 13, 30));
-  RTC.adjust(DateTime(year(newTimeUTC), month(newTimeUTC), day(newTimeUTC), hour(newTimeUTC), minute(newTimeUTC), second(newTimeUTC)));
+  return localTime.toUTC(newTime);
+}
+
+void setRTCTime(time_t pNewTimeUTC) {
+  RTC.adjust(DateTime(year(pNewTimeUTC), month(pNewTimeUTC), day(pNewTimeUTC), hour(pNewTimeUTC), minute(pNewTimeUTC), second(pNewTimeUTC)));
+  //The RTC jumped, so earlier readings say nothing about drift
+  rtcClock.reset();
   setSyncProvider(syncProvider);
+  logEvent(EVENT_CONFIG, CONFIG_TIME, 0, pNewTimeUTC);
   //Setup alarms to open/close door
   setSunAlarms();
-  message = "RTC Time Set: ";
-  message.concat(getTime(GT_DATETIME,false));
-  redirectHome(message);
+}
+
+void handleClearWifi(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_CLEAR_WIFI, 0, NULL, "Wifi Credentials Cleared");
 }
 
 void clearWifiCredentials () {
   EEPROM.put(4,0);
-  EEPROM.commit();
-  redirectHome("Wifi Credentials Cleared");
+  commitEEPROM();
+  logEvent(EVENT_CONFIG, CONFIG_CLEAR_WIFI, 0, 0);
 }
 
 int getOverRun() {
@@ -795,40 +1482,669 @@ int getOverRun() {
   return overRunTime;
 }
 
-void setOverRun() {
+void handleSetOverRun(AsyncWebServerRequest *request) {
   String message;
-  int overRunTime;
-  if (server.arg("overrun") == ""){
+  overrunArgs args;
+  if (!parseArgs(request, OVERRUN_ARGS, sizeof(OVERRUN_ARGS) / sizeof(OVERRUN_ARGS[0]), &args, message)) {
+    sendArgError(request, message);
     return;
-  } else {
-    overRunTime = server.arg("overrun").toInt();
-    EEPROM.put(45,overRunTime);
-    EEPROM.commit();
   }
-  overRun = overRunTime;
   message = "Overrun Set:";
-  message.concat(overRunTime);
+  message.concat(args.overrun);
   message.concat(" milliseconds");
-  redirectHome(message);
+  queueAndRedirect(request, WEB_COMMAND_SET_OVERRUN, args.overrun, NULL, message);
+}
+
+void setOverRun(int pOverRun) {
+  EEPROM.put(45, pOverRun);
+  commitEEPROM();
+  overRun = pOverRun;
+  logEvent(EVENT_CONFIG, CONFIG_OVERRUN, 0, pOverRun);
+}
+
+//An empty host turns telemetry off
+void handleSetMqtt(AsyncWebServerRequest *request) {
+  String message;
+  mqttSettings mqtt;
+
+  memset(&mqtt, 0, sizeof(mqtt));
+  mqtt.port = MQTT_DEFAULT_PORT;
+  if (!parseArgs(request, MQTT_ARGS, sizeof(MQTT_ARGS) / sizeof(MQTT_ARGS[0]), &mqtt, message)) {
+    sendArgError(request, message);
+    return;
+  }
+  if (mqtt.host[0] == '\0') {
+    message = "Telemetry Off";
+  } else {
+    message = "MQTT Broker Set: ";
+    message.concat(mqtt.host);
+    message.concat(":");
+    message.concat(mqtt.port);
+  }
+  queueAndRedirect(request, WEB_COMMAND_SET_MQTT, 0, NULL, message, &mqtt);
+}
+
+//Unwritten EEPROM reads back as 0xFF, which leaves telemetry off
+void getMqttSettings(mqttSettings &pSettings) {
+  EEPROM.get(MQTT_SETTINGS_ADDRESS, pSettings);
+  if ((uint8_t)pSettings.host[0] == 0xFF || memchr(pSettings.host, '\0', sizeof(pSettings.host)) == NULL) {
+    pSettings.host[0] = '\0';
+  }
+  if (pSettings.port == 0 || pSettings.port == 0xFFFF) {
+    pSettings.port = MQTT_DEFAULT_PORT;
+  }
+}
+
+void setMqtt(const mqttSettings &pSettings) {
+  EEPROM.put(MQTT_SETTINGS_ADDRESS, pSettings);
+  commitEEPROM();
+  telemetry.setBroker(pSettings.host, pSettings.port);
+  logEvent(EVENT_CONFIG, CONFIG_MQTT, 0, pSettings.port);
+}
+
+//Refresh the health topic now and then, and keep the broker fed
+void serviceTelemetry() {
+  TRACE_SPAN(tracer, "serviceTelemetry");
+  HEAP_SCOPE(heapProfiler, "serviceTelemetry");
+  if (millis() - telemetryHealthAt >= TELEMETRY_HEALTH_INTERVAL) {
+    telemetryHealthAt = millis();
+    publishHealth();
+  }
+  telemetry.service(millis());
+}
+
+void publishHealth() {
+  HEAP_SCOPE(heapProfiler, "publishHealth");
+  String health = "{\"uptime\":";
+  health.concat((uint32_t)(millis() / 1000));
+  health.concat(",\"heap\":");
+  health.concat(ESP.getFreeHeap());
+  health.concat(",\"minHeap\":");
+  health.concat(heapProfiler.minFree());
+  health.concat(",\"largestBlock\":");
+  health.concat(heapProfiler.minLargest());
+  health.concat(",\"overBudget\":");
+  health.concat(heapProfiler.overBudget());
+  health.concat(",\"doorGap\":");
+  health.concat(scheduler.stats(0).worstGap);
+  health.concat(",\"rssi\":");
+  health.concat(WiFi.RSSI());
+  health.concat(",\"drift\":");
+  health.concat(String(rtcClock.drift() / 1000.0, 1));
+  health.concat(",\"longestSpan\":");
+  health.concat(tracer.longest());
+  health.concat(",\"dropped\":");
+  health.concat(telemetry.dropped() + eventLog.dropped());
+  health.concat(",\"limited\":");
+  health.concat(limiter.limited(RATE_READ) + limiter.limited(RATE_CONTROL));
+  health.concat("}");
+  telemetry.setStatus(telemetryHealth, health);
+}
+
+void handleNewUdpKey(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_NEW_UDP_KEY, 0, NULL, "New UDP Key");
+}
+
+//Blank EEPROM reads back as all 0xFF (or all zero), which leaves UDP off until a key is made
+void loadUdpKey() {
+  uint8_t all = 0xFF;
+  uint8_t any = 0;
+  EEPROM.get(UDP_KEY_ADDRESS, udpKey);
+  for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i++) {
+    all &= udpKey[i];
+    any |= udpKey[i];
+  }
+  if (all == 0xFF || any == 0) {
+    memset(udpKey, 0, sizeof(udpKey));
+  }
+  //Kept across restarts, so a captured command can't be replayed after one. Blank reads as all 0xFF
+  EEPROM.get(UDP_SEQ_ADDRESS, udpCommandSeq);
+  if (!udpKeySet() || udpCommandSeq == 0xFFFFFFFF) {
+    udpCommandSeq = 0;
+  }
+}
+
+//From the hardware RNG. Gateways need the new key from the console's dump config
+void newUdpKey() {
+  for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i += 4) {
+    uint32_t word = ESP.random();
+    memcpy(udpKey + i, &word, sizeof(word));
+  }
+  EEPROM.put(UDP_KEY_ADDRESS, udpKey);
+  saveUdpCommandSeq(0);
+  logEvent(EVENT_CONFIG, CONFIG_UDP_KEY, 0, 0);
+}
+
+//Commands come far less often than the door's own state changes, which commit every time too
+void saveUdpCommandSeq(uint32_t pSeq) {
+  udpCommandSeq = pSeq;
+  EEPROM.put(UDP_SEQ_ADDRESS, udpCommandSeq);
+  commitEEPROM();
+}
+
+bool udpKeySet() {
+  uint8_t any = 0;
+  for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i++) {
+    any |= udpKey[i];
+  }
+  return any != 0;
+}
+
+//Answer up to UDP_PACKETS_PER_LOOP datagrams, each read and answered in place on the stack
+void serviceUdp() {
+  TRACE_SPAN(tracer, "serviceUdp");
+  for (uint8_t i = 0; i < UDP_PACKETS_PER_LOOP && udp.parsePacket() > 0; i++) {
+    handleUdpPacket();
+  }
+}
+
+void handleUdpPacket() {
+  udpRequest request;
+  udpStatus reply;
+  uint8_t result = UDP_OK;
+  uint8_t command = 0;
+  int target = doorState;
+  bool already;
+
+  if (udp.available() != sizeof(request) || udp.read((uint8_t*)&request, sizeof(request)) != sizeof(request)
+    || memcmp(request.magic, UDP_MAGIC, sizeof(UDP_MAGIC)) != 0 || request.version != UDP_VERSION || !udpKeySet()
+    || !sipVerify(udpKey, (const uint8_t*)&request, offsetof(udpRequest, tag), request.tag)) {
+    udp.flush();
+    udpRejected++;
+    return;
+  }
+  if (limiter.take(udp.remoteIP(), request.type == UDP_STATUS ? RATE_READ : RATE_CONTROL, millis()) > 0) {
+    udpRejected++;
+    return;
+  }
+
+  //Commands are idempotent: one the door is already doing is acknowledged and not queued
+  switch (request.type) {
+    case UDP_STATUS:
+      break;
+    case UDP_OPEN:
+      command = WEB_COMMAND_OPEN;
+      break;
+    case UDP_CLOSE:
+      command = WEB_COMMAND_CLOSE;
+      break;
+    case UDP_STOP:
+      command = WEB_COMMAND_STOP;
+      break;
+    default:
+      result = UDP_UNKNOWN;
+      break;
+  }
+  if (command != 0) {
+    target = expectedDoorState(command);
+    already = target == doorState
+      || (command == WEB_COMMAND_OPEN && doorState == DOOR_STATE_OPEN)
+      || (command == WEB_COMMAND_CLOSE && doorState == DOOR_STATE_CLOSED);
+    if (request.seq <= udpCommandSeq) {
+      result = UDP_STALE;
+      target = doorState;
+    }
+    else if (already) {
+      saveUdpCommandSeq(request.seq);
+      target = doorState;
+    }
+    else if (!queueWebCommand(command, 0, NULL)) {
+      result = UDP_BUSY;
+      target = doorState;
+    }
+    else {
+      saveUdpCommandSeq(request.seq);
+    }
+  }
+
+  memcpy(reply.magic, UDP_MAGIC, sizeof(UDP_MAGIC));
+  reply.version = UDP_VERSION;
+  reply.type = request.type | UDP_REPLY;
+  reply.seq = request.seq;
+  reply.result = result;
+  reply.doorState = target;
+  reply.rssi = WiFi.RSSI();
+  reply.reserved = 0;
+  reply.overRun = overRun;
+  reply.drift = rtcClock.drift() / 100;
+  reply.time = now();
+  reply.openAt = openAtUTC;
+  reply.closeAt = closeAtUTC;
+  reply.uptime = millis() / 1000;
+  reply.freeHeap = ESP.getFreeHeap();
+  sipTag(udpKey, (const uint8_t*)&reply, offsetof(udpStatus, tag), reply.tag);
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write((const uint8_t*)&reply, sizeof(reply));
+  udp.endPacket();
+  udpAnswered++;
+}
+
+//Run console commands from loop(), so they never wait on the network and never overlap a web command
+void serviceConsole() {
+  TRACE_SPAN(tracer, "serviceConsole");
+  console.service();
+}
+
+void consoleHelp(Console &pConsole, void *) {
+  pConsole.help();
+  pConsole.ok("help");
+}
+
+void consoleStatus(Console &pConsole, void *) {
+  char state[24];
+  time_t local = localTime.toLocal(now());
+  IPAddress ip = WiFi.getMode() == WIFI_AP ? WiFi.softAPIP() : WiFi.localIP();
+
+  consoleDoorState(doorState, state, sizeof(state));
+  pConsole.printf("door %s\r\n", state);
+  pConsole.printf("time %04d-%02d-%02d %02d:%02d:%02d\r\n", year(local), month(local), day(local), hour(local), minute(local), second(local));
+  local = localTime.toLocal(openAtUTC);
+  pConsole.printf("open %02d:%02d\r\n", hour(local), minute(local));
+  local = localTime.toLocal(closeAtUTC);
+  pConsole.printf("close %02d:%02d\r\n", hour(local), minute(local));
+  pConsole.printf("wifi %s %d.%d.%d.%d\r\n", WiFi.getMode() == WIFI_AP ? "ap" : WiFi.status() == WL_CONNECTED ? "connected" : "connecting",
+    ip[0], ip[1], ip[2], ip[3]);
+  pConsole.ok("status");
+}
+
+void consoleOpen(Console &pConsole, void *) {
+  consoleQueue(pConsole, WEB_COMMAND_OPEN, 0, NULL);
+}
+
+void consoleClose(Console &pConsole, void *) {
+  consoleQueue(pConsole, WEB_COMMAND_CLOSE, 0, NULL);
+}
+
+void consoleStop(Console &pConsole, void *) {
+  consoleQueue(pConsole, WEB_COMMAND_STOP, 0, NULL);
+}
+
+void consoleOverride(Console &pConsole, void *) {
+  consoleQueue(pConsole, WEB_COMMAND_OVERRIDE, 0, NULL);
+}
+
+void consoleSetTime(Console &pConsole, void *pArgs) {
+  time_t utc = timeArgsToUTC(*(const timeArgs*)pArgs);
+  if (utc == 0) {
+    pConsole.error("day is past the end of the month");
+    return;
+  }
+  consoleQueue(pConsole, WEB_COMMAND_SET_TIME, utc, NULL);
+}
+
+void consoleSetOverRun(Console &pConsole, void *pArgs) {
+  consoleQueue(pConsole, WEB_COMMAND_SET_OVERRUN, ((const overrunArgs*)pArgs)->overrun, NULL);
+}
+
+void consoleSetWifi(Console &pConsole, void *pArgs) {
+  consoleQueue(pConsole, WEB_COMMAND_SET_WIFI, 0, (const wifiCredentials*)pArgs);
+}
+
+//Queued like a web command, so the motor rest and the EEPROM writes are the same whichever way it came
+void consoleQueue(Console &pConsole, uint8_t pType, int32_t pValue, const wifiCredentials *pCreds) {
+  char state[24];
+  if (!queueWebCommand(pType, pValue, pCreds)) {
+    pConsole.error("busy");
+    return;
+  }
+  consoleDoorState(expectedDoorState(pType), state, sizeof(state));
+  pConsole.ok(state);
+}
+
+//Settings as saved in EEPROM. The wifi password is not shown
+void consoleDumpConfig(Console &pConsole, void *) {
+  wifiCredentials creds;
+  mqttSettings mqtt;
+  char key[SIPHASH_KEY_LENGTH * 2 + 1];
+
+  EEPROM.get(4, creds);
+  if (memchr(creds.ssid, '\0', sizeof(creds.ssid)) == NULL || (uint8_t)creds.ssid[0] == 0xFF) {
+    creds.ssid[0] = '\0';
+  }
+  pConsole.printf("ssid %s\r\n", creds.ssid[0] == '\0' ? "(none)" : creds.ssid);
+  pConsole.printf("overrun %d\r\n", overRun);
+  getMqttSettings(mqtt);
+  if (mqtt.host[0] == '\0') {
+    pConsole.printf("mqtt off\r\n");
+  } else {
+    pConsole.printf("mqtt %s:%u\r\n", mqtt.host, mqtt.port);
+  }
+  strcpy(key, "(none)");
+  if (udpKeySet()) {
+    for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i++) {
+      snprintf(key + i * 2, 3, "%02x", udpKey[i]);
+    }
+  }
+  pConsole.printf("udpkey %s\r\n", key);
+  pConsole.printf("ota %u %u\r\n", ota.phase, ota.boots);
+  pConsole.ok("config");
+}
+
+void consoleDumpMetrics(Console &pConsole, void *) {
+  pConsole.printf("uptime %lu\r\n", (unsigned long)(millis() / 1000));
+  pConsole.printf("heap %lu largest %lu frag %u\r\n", (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMaxFreeBlockSize(),
+    ESP.getHeapFragmentation());
+  pConsole.printf("heap low %lu largest low %lu over budget %lu\r\n", (unsigned long)heapProfiler.minFree(),
+    (unsigned long)heapProfiler.minLargest(), (unsigned long)heapProfiler.overBudget());
+  pConsole.printf("span %lu stalls %lu\r\n", (unsigned long)tracer.longest(), (unsigned long)tracer.stalls());
+  pConsole.printf("drift %.1f reads %lu\r\n", rtcClock.drift() / 1000.0, (unsigned long)rtcClock.syncs());
+  pConsole.printf("events %lu pending %u dropped %lu\r\n", (unsigned long)eventLog.nextSeq(), eventLog.pending(), (unsigned long)eventLog.dropped());
+  pConsole.printf("assets %lu/%lu\r\n", (unsigned long)assets.hits(), (unsigned long)assets.misses());
+  pConsole.printf("pages %lu/%lu actions %lu/%lu\r\n", (unsigned long)limiter.admitted(RATE_READ), (unsigned long)limiter.limited(RATE_READ),
+    (unsigned long)limiter.admitted(RATE_CONTROL), (unsigned long)limiter.limited(RATE_CONTROL));
+  pConsole.printf("telemetry %lu/%u/%lu\r\n", (unsigned long)telemetry.published(), telemetry.queued(), (unsigned long)telemetry.dropped());
+  pConsole.printf("udp %lu/%lu\r\n", (unsigned long)udpAnswered, (unsigned long)udpRejected);
+  pConsole.printf("console %lu/%lu\r\n", (unsigned long)pConsole.lines(), (unsigned long)pConsole.errors());
+  pConsole.ok("metrics");
+}
+
+void consoleDumpTasks(Console &pConsole, void *) {
+  for (uint8_t i = 0; i < scheduler.count(); i++) {
+    const taskStats &stats = scheduler.stats(i);
+    pConsole.printf("%s p%u runs %lu avg %lu max %lu over %lu gap %lu\r\n", scheduler.task(i).name, scheduler.task(i).priority,
+      (unsigned long)stats.runs, (unsigned long)(stats.runs > 0 ? stats.micros / stats.runs : 0), (unsigned long)stats.longest,
+      (unsigned long)stats.overruns, (unsigned long)stats.worstGap);
+  }
+  pConsole.ok("tasks");
+}
+
+//Door state names live in flash
+void consoleDoorState(int pState, char *pName, size_t pSize) {
+  strncpy_P(pName, (PGM_P)pgm_read_ptr(&DOOR_STATE_TABLE[pState].name), pSize - 1);
+  pName[pSize - 1] = '\0';
+}
+
+void handleReset(AsyncWebServerRequest *request) {
+  queueAndRedirect(request, WEB_COMMAND_RESET, 0, NULL, "Restarting");
+}
+
+//POST /update?type=firmware|filesystem&md5=<hex>&tag=<hex>, image as a multipart file.
+//The image streams straight into the Updater, which hashes it as it goes. The boot swap is only set
+//up once the whole image matches md5 and carries tag, its SipHash under the device key, so only
+//someone holding the key can flash it. The door keeps running from loop() meanwhile
+void handleUpdateUpload(AsyncWebServerRequest *request, const String &, size_t index, uint8_t *data, size_t len, bool final) {
+  TRACE_SPAN(tracer, "handleUpdateUpload");
+  if (index == 0 && !startUpdate(request)) {
+    return;
+  }
+  if (upload.owner != request || !upload.active) {
+    return;
+  }
+  sipAdd(upload.sip, data, len);
+  if (Update.write(data, len) != len) {
+    failUpdate("Write failed");
+    return;
+  }
+  if (final) {
+    if (!sipFinishVerify(upload.sip, upload.tag)) {
+      failUpdate("Tag does not match the device key");
+      return;
+    }
+    if (!Update.end(true)) {
+      failUpdate(Update.getErrorString().c_str());
+      return;
+    }
+    upload.active = false;
+    upload.verified = true;
+  }
+}
+
+bool startUpdate(AsyncWebServerRequest *request) {
+  FSInfo info;
+  size_t size;
+  int command;
+  String error;
+  updateArgs args = { "firmware", "", "" };
+
+  if (upload.active || upload.owner != NULL) {
+    return false;
+  }
+  upload.owner = request;
+  upload.verified = false;
+  upload.error[0] = 0;
+  upload.type = OTA_TYPE_FIRMWARE;
+  request->onDisconnect([request]() {
+    if (upload.owner == request) {
+      if (upload.active) {
+        failUpdate("Disconnected");
+      }
+      upload.owner = NULL;
+    }
+  });
+  if (!parseArgs(request, UPDATE_ARGS, sizeof(UPDATE_ARGS) / sizeof(UPDATE_ARGS[0]), &args, error)) {
+    failUpdate(error.c_str());
+    return false;
+  }
+  if (!udpKeySet()) {
+    failUpdate("No device key, press New Key first");
+    return false;
+  }
+  if (!parseTag(args.tag, upload.tag)) {
+    failUpdate("tag must be 16 hex digits");
+    return false;
+  }
+  sipBegin(upload.sip, udpKey);
+  if (strcmp(args.type, "filesystem") == 0) {
+    upload.type = OTA_TYPE_FILESYSTEM;
+  } else if (strcmp(args.type, "firmware") != 0) {
+    failUpdate("type must be firmware or filesystem");
+    return false;
+  }
+  if (upload.type == OTA_TYPE_FIRMWARE) {
+    if (!rollbackReady) {
+      failUpdate("Rollback image not saved yet");
+      return false;
+    }
+    size = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+    command = U_FLASH;
+  }
+  else {
+    if (rollbackFile) {
+      failUpdate("Rollback image being saved");
+      return false;
+    }
+    //The new image replaces the whole filesystem, so stop using it
+    LittleFS.info(info);
+    size = info.totalBytes;
+    LittleFS.end();
+    command = U_FS;
+  }
+  Update.runAsync(true);
+  if (!Update.begin(size, command) || !Update.setMD5(args.md5)) {
+    failUpdate(Update.getErrorString().c_str());
+    return false;
+  }
+  upload.active = true;
+  return true;
 }
 
-void handleReset () {
+//16 hex digits, the tag's bytes in the order they are sent over UDP
+bool parseTag(const char *pHex, uint8_t *pTag) {
+  for (uint8_t i = 0; i < SIPHASH_TAG_LENGTH; i++) {
+    char pair[3] = { pHex[i * 2], pHex[i * 2 + 1], 0 };
+    if (!isxdigit(pair[0]) || !isxdigit(pair[1])) {
+      return false;
+    }
+    pTag[i] = strtoul(pair, NULL, 16);
+  }
+  return true;
+}
+
+void failUpdate(const char *pError) {
+  strncpy(upload.error, pError, sizeof(upload.error) - 1);
+  upload.error[sizeof(upload.error) - 1] = 0;
+  if (Update.isRunning()) {
+    Update.end(false);
+  }
+  if (upload.active && upload.type == OTA_TYPE_FILESYSTEM) {
+    LittleFS.begin();
+  }
+  upload.active = false;
+  upload.verified = false;
+}
+
+void handleUpdate(AsyncWebServerRequest *request) {
+  if (upload.owner != request) {
+    request->send(upload.active ? 409 : 400, "text/plain", upload.active ? "Another update is in progress" : "No image uploaded");
+    return;
+  }
+  upload.owner = NULL;
+  if (!upload.verified) {
+    request->send(400, "text/plain", upload.error);
+    return;
+  }
+  upload.verified = false;
+  if (!queueWebCommand(WEB_COMMAND_APPLY_UPDATE, upload.type, NULL)) {
+    request->send(503, "text/plain", "Busy");
+    return;
+  }
+  request->send(200, "text/plain", "Update verified, restarting");
+}
+
+//A verified image is waiting for the boot swap. New firmware boots on trial
+void applyUpdate(uint8_t pType) {
+  if (pType == OTA_TYPE_FIRMWARE) {
+    ota.phase = OTA_TRIAL;
+    ota.boots = 0;
+    EEPROM.put(OTA_STATE_ADDRESS, ota);
+    commitEEPROM();
+    logEvent(EVENT_CONFIG, CONFIG_FIRMWARE, OTA_TRIAL, 0);
+    eventLog.flush(millis());
+  }
   ESP.restart();
 }
 
-void handleSettings(){
+//Runs before anything that could crash, so a firmware that never gets going is still counted
+void checkOtaBoot() {
+  EEPROM.get(OTA_STATE_ADDRESS, ota);
+  if (ota.phase != OTA_TRIAL && ota.phase != OTA_ROLLED_BACK) {
+    ota.phase = OTA_CONFIRMED;
+    return;
+  }
+  if (ota.phase != OTA_TRIAL) {
+    return;
+  }
+  ota.boots++;
+  otaBootMillis = millis();
+  EEPROM.put(OTA_STATE_ADDRESS, ota);
+  commitEEPROM();
+  if (ota.boots > OTA_TRIAL_BOOTS) {
+    rollbackFirmware();
+  }
+}
+
+//Flash the saved sketch back. If there isn't one, the new firmware has to stay. The copy takes
+//seconds, so the watchdog is fed between chunks
+void rollbackFirmware() {
+  uint8_t buffer[OTA_COPY_CHUNK];
+  size_t copied = 0;
+  size_t length;
+  File image;
+  LittleFS.begin();
+  image = LittleFS.open(OTA_ROLLBACK_PATH, "r");
+  ota.phase = OTA_CONFIRMED;
+  if (image && Update.begin(image.size(), U_FLASH)) {
+    while ((length = image.read(buffer, sizeof(buffer))) > 0 && Update.write(buffer, length) == length) {
+      copied += length;
+      yield();
+    }
+    if (copied == image.size() && Update.end()) {
+      ota.phase = OTA_ROLLED_BACK;
+    }
+  }
+  image.close();
+  EEPROM.put(OTA_STATE_ADDRESS, ota);
+  commitEEPROM();
+  if (ota.phase == OTA_ROLLED_BACK) {
+    ESP.restart();
+  }
+}
+
+//The rollback image is good if it is a copy of the sketch that is running now
+void checkRollbackImage() {
+  File md5File = LittleFS.open(OTA_ROLLBACK_MD5_PATH, "r");
+  rollbackReady = false;
+  if (md5File) {
+    rollbackReady = md5File.readString() == ESP.getSketchMD5();
+    md5File.close();
+  }
+}
+
+//Settle trial firmware and keep the rollback image current, a chunk per loop when the door is idle
+void serviceOta() {
+  TRACE_SPAN(tracer, "serviceOta");
+  if (ota.phase == OTA_ROLLED_BACK) {
+    ota.phase = OTA_CONFIRMED;
+    EEPROM.put(OTA_STATE_ADDRESS, ota);
+    commitEEPROM();
+    logEvent(EVENT_CONFIG, CONFIG_FIRMWARE, OTA_ROLLED_BACK, 0);
+  }
+  if (ota.phase == OTA_TRIAL && millis() - otaBootMillis >= OTA_CONFIRM_MILLIS) {
+    ota.phase = OTA_CONFIRMED;
+    EEPROM.put(OTA_STATE_ADDRESS, ota);
+    commitEEPROM();
+    logEvent(EVENT_CONFIG, CONFIG_FIRMWARE, OTA_CONFIRMED, ota.boots);
+  }
+  if (ota.phase != OTA_CONFIRMED || rollbackReady || rollbackFailed || upload.active) {
+    return;
+  }
+  if (doorState == DOOR_STATE_OPENING || doorState == DOOR_STATE_CLOSING) {
+    return;
+  }
+  copyRollbackImage();
+}
+
+void copyRollbackImage() {
+  TRACE_SPAN(tracer, "copyRollbackImage");
+  uint32_t buffer[OTA_COPY_CHUNK / 4];
+  uint32_t sketchSize = ESP.getSketchSize();
+  size_t length;
+  File md5File;
+
+  if (!rollbackFile) {
+    LittleFS.mkdir("/ota");
+    rollbackFile = LittleFS.open(OTA_ROLLBACK_PATH, "w");
+    rollbackOffset = 0;
+    if (!rollbackFile) {
+      rollbackFailed = true;
+      return;
+    }
+  }
+  length = sketchSize - rollbackOffset < OTA_COPY_CHUNK ? sketchSize - rollbackOffset : OTA_COPY_CHUNK;
+  //flashRead wants whole words. The tail of the last one is dropped
+  if (!ESP.flashRead(rollbackOffset, buffer, (length + 3) & ~3) || rollbackFile.write((uint8_t*)buffer, length) != length) {
+    rollbackFile.close();
+    LittleFS.remove(OTA_ROLLBACK_PATH);
+    rollbackFailed = true;
+    return;
+  }
+  rollbackOffset += length;
+  if (rollbackOffset < sketchSize) {
+    return;
+  }
+  rollbackFile.close();
+  md5File = LittleFS.open(OTA_ROLLBACK_MD5_PATH, "w");
+  md5File.print(ESP.getSketchMD5());
+  md5File.close();
+  rollbackReady = true;
+}
+
+void handleSettings(AsyncWebServerRequest *request) {
+  TRACE_SPAN(tracer, "handleSettings");
 	int i;
   time_t rtcTime;
   String eepromSSID = "";
   String eepromPWD = "";
   String htmlString="";
   wifiCredentials creds;
+  mqttSettings mqtt;
   String MONTH_NAME[13] = { "Unknown", "January", "February", "March", "April", "May", "June","July","August","September","October","November","December"};
 	
   rtcTime = localTime.toLocal(now());
   TimeElements rtcTimeElements;
   breakTime(rtcTime, rtcTimeElements);
   
+  htmlString.reserve(SETTINGS_PAGE_LENGTH);
   htmlString.concat("<html>");
     htmlString.concat("<head>");
       htmlString.concat("<title>Casa del Pollo</title>");
@@ -937,6 +2253,126 @@ void handleSettings(){
     	htmlString.concat("<input type='submit' value='Set Credentials'>");
     	htmlString.concat("</form>");
 
+      htmlString.concat("<h4>Clock</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Drift:</td><td>");
+      htmlString.concat(String(rtcClock.drift() / 1000.0, 1));
+      htmlString.concat(" ppm (+/- ");
+      htmlString.concat(String(rtcClock.uncertainty() / 1000.0, 1));
+      htmlString.concat(")</td></tr>");
+      htmlString.concat("<tr><td>RTC reads:</td><td>");
+      htmlString.concat(rtcClock.syncs());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+
+      getMqttSettings(mqtt);
+      htmlString.concat("<form action='setmqtt' method='get'>");
+      htmlString.concat("<h4>Telemetry</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Broker:</td><td><input type='text' name='host' value='");
+      htmlString.concat(mqtt.host);
+      htmlString.concat("'></td></tr>");
+      htmlString.concat("<tr><td>Port:</td><td><input type='text' name='port' value='");
+      htmlString.concat(mqtt.port);
+      htmlString.concat("'></td></tr>");
+      htmlString.concat("<tr><td>Status:</td><td>");
+      htmlString.concat(!telemetry.enabled() ? "Off" : telemetry.connected() ? "Connected" : "Connecting");
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Published/Queued/Dropped:</td><td>");
+      htmlString.concat(telemetry.published());
+      htmlString.concat("/");
+      htmlString.concat(telemetry.queued());
+      htmlString.concat("/");
+      htmlString.concat(telemetry.dropped());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+      htmlString.concat("<input type='submit' value='Set Broker'>");
+      htmlString.concat("</form>");
+
+      htmlString.concat("<form action='newudpkey' method='get'>");
+      htmlString.concat("<h4>UDP</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Port:</td><td>");
+      htmlString.concat(UDP_PORT);
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Key:</td><td>");
+      htmlString.concat(udpKeySet() ? "Set, see dump config on the console" : "None");
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Answered/Rejected:</td><td>");
+      htmlString.concat(udpAnswered);
+      htmlString.concat("/");
+      htmlString.concat(udpRejected);
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+      htmlString.concat("<input type='submit' value='New Key'>");
+      htmlString.concat("</form>");
+
+      htmlString.concat("<h4>Requests</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Pages served/limited:</td><td>");
+      htmlString.concat(limiter.admitted(RATE_READ));
+      htmlString.concat("/");
+      htmlString.concat(limiter.limited(RATE_READ));
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Actions accepted/limited:</td><td>");
+      htmlString.concat(limiter.admitted(RATE_CONTROL));
+      htmlString.concat("/");
+      htmlString.concat(limiter.limited(RATE_CONTROL));
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Clients/evicted/shared:</td><td>");
+      htmlString.concat(limiter.clients());
+      htmlString.concat("/");
+      htmlString.concat(limiter.evictions());
+      htmlString.concat("/");
+      htmlString.concat(limiter.shared());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+
+      htmlString.concat("<h4>Heap</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Free/Lowest:</td><td>");
+      htmlString.concat(ESP.getFreeHeap());
+      htmlString.concat("/");
+      htmlString.concat(heapProfiler.minFree());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Largest block/Lowest:</td><td>");
+      htmlString.concat(ESP.getMaxFreeBlockSize());
+      htmlString.concat("/");
+      htmlString.concat(heapProfiler.minLargest());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Over budget:</td><td>");
+      htmlString.concat(heapProfiler.overBudget());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+
+      htmlString.concat("<h4>Asset Cache</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Hits/Misses:</td><td>");
+      htmlString.concat(assets.hits());
+      htmlString.concat("/");
+      htmlString.concat(assets.misses());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("<tr><td>Bytes:</td><td>");
+      htmlString.concat(assets.used());
+      htmlString.concat(" of ");
+      htmlString.concat(assets.budget());
+      htmlString.concat("</td></tr>");
+      htmlString.concat("</table>");
+
+      //Fields ahead of the file, so they are parsed before the upload starts
+      htmlString.concat("<form action='update' method='post' enctype='multipart/form-data'>");
+      htmlString.concat("<h4>Update</h4>");
+      htmlString.concat("<table>");
+      htmlString.concat("<tr><td>Image:</td><td><select name='type'><option value='firmware'>Firmware</option>");
+      htmlString.concat("<option value='filesystem'>Filesystem</option></select></td></tr>");
+      htmlString.concat("<tr><td>MD5:</td><td><input type='text' name='md5' size=32></td></tr>");
+      htmlString.concat("<tr><td>Tag:</td><td><input type='text' name='tag' size=16></td></tr>");
+      htmlString.concat("<tr><td>File:</td><td><input type='file' name='image'></td></tr>");
+      htmlString.concat("</table>");
+      htmlString.concat(rollbackReady ? "" : "Saving the rollback image<br>");
+      htmlString.concat("<input type='submit' value='Upload'>");
+      htmlString.concat("</form>");
+
       htmlString.concat("<form action='reset' method='get'>");
       htmlString.concat("<h4>Restart</h4>");
       htmlString.concat("<input type='submit' value='Restart'>");
@@ -944,5 +2380,5 @@ void handleSettings(){
       
      htmlString.concat("</body>");
   htmlString.concat("</html>");
-  server.send(200, "text/html", htmlString);
+  request->send(200, "text/html", htmlString);
 }
@@ -0,0 +1,321 @@
+#include "Fleet.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+  const char *const STATE_NAMES[UDP_DOOR_STATES] = { "Unknown", "Open", "Closed", "Opening", "Closing", "Stopped-Opening", "Stopped-Closing" };
+
+  uint8_t maxTries(uint8_t pType) {
+    return pType == UDP_STATUS ? 1 : FLEET_COMMAND_TRIES;
+  }
+}
+
+const char *fleetStateName(uint8_t pState) {
+  return pState < UDP_DOOR_STATES ? STATE_NAMES[pState] : "Invalid";
+}
+
+const char *fleetResultName(uint8_t pResult) {
+  switch (pResult) {
+    case UDP_OK:
+      return "ok";
+    case UDP_STALE:
+      return "stale";
+    case UDP_BUSY:
+      return "busy";
+    case UDP_UNKNOWN:
+      return "unknown";
+    case FLEET_PENDING:
+      return "pending";
+    default:
+      return "timeout";
+  }
+}
+
+uint64_t fleetMillis() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+Fleet::Fleet() {
+  _fd = -1;
+  _timeout = FLEET_DEFAULT_TIMEOUT;
+  _roundType = 0;
+  _outstanding = 0;
+  _unsent = 0;
+  _roundStart = 0;
+  _roundMillis = 0;
+  _rounds = 0;
+  _rejected = 0;
+}
+
+Fleet::~Fleet() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+//One non-blocking socket for every node. Port 0 takes any free one
+bool Fleet::begin(uint16_t pPort) {
+  sockaddr_in local;
+  int buffer = 1 << 20;
+  _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_fd < 0) {
+    return false;
+  }
+  //Room for a whole fleet's replies arriving at once
+  setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(pPort);
+  return bind(_fd, (const sockaddr*)&local, sizeof(local)) == 0;
+}
+
+int Fleet::fd() {
+  return _fd;
+}
+
+//Names must be unique, as must addresses, since replies are matched to nodes by where they came from
+bool Fleet::add(const char *pName, const sockaddr_in &pAddress, const uint8_t *pKey) {
+  fleetNode node;
+  if (strlen(pName) >= FLEET_NAME_LENGTH || find(pName) >= 0 || _byAddress.count(addressKey(pAddress)) > 0 || busy()) {
+    return false;
+  }
+  memset(&node, 0, sizeof(node));
+  strcpy(node.name, pName);
+  node.address = pAddress;
+  memcpy(node.key, pKey, SIPHASH_KEY_LENGTH);
+  node.result = FLEET_TIMEOUT;
+  _byAddress[addressKey(pAddress)] = _nodes.size();
+  _nodes.push_back(node);
+  return true;
+}
+
+size_t Fleet::size() {
+  return _nodes.size();
+}
+
+const fleetNode &Fleet::node(size_t pIndex) {
+  return _nodes[pIndex];
+}
+
+int Fleet::find(const char *pName) {
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    if (strcmp(_nodes[i].name, pName) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void Fleet::setTimeout(uint64_t pMillis) {
+  _timeout = pMillis;
+}
+
+uint64_t Fleet::timeout() {
+  return _timeout;
+}
+
+//Send pType to pNode, or every node if it is -1. False if a round is already running
+bool Fleet::start(uint8_t pType, int pNode, uint64_t pNow) {
+  if (busy() || pNode >= (int)_nodes.size()) {
+    return false;
+  }
+  _roundType = pType;
+  _roundStart = pNow;
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    if (pNode >= 0 && (int)i != pNode) {
+      continue;
+    }
+    fleetNode &node = _nodes[i];
+    node.pendingType = pType;
+    node.tries = 0;
+    node.result = FLEET_PENDING;
+    _outstanding++;
+    send(node, pNow);
+  }
+  if (_outstanding == 0) {
+    _roundMillis = 0;
+    _rounds++;
+  }
+  return true;
+}
+
+bool Fleet::busy() {
+  return _outstanding > 0;
+}
+
+bool Fleet::wantsWrite() {
+  return _unsent > 0;
+}
+
+//Take every datagram waiting. Anything that isn't the tagged answer to a node's request in flight is dropped
+void Fleet::onReadable(uint64_t pNow) {
+  udpStatus reply;
+  sockaddr_in from;
+  socklen_t fromLength;
+  ssize_t length;
+  while (true) {
+    fromLength = sizeof(from);
+    length = recvfrom(_fd, &reply, sizeof(reply), MSG_TRUNC, (sockaddr*)&from, &fromLength);
+    if (length < 0) {
+      return;
+    }
+    auto found = _byAddress.find(addressKey(from));
+    if (found == _byAddress.end()) {
+      _rejected++;
+      continue;
+    }
+    fleetNode &node = _nodes[found->second];
+    if (length != sizeof(reply) || node.pendingType == 0 || node.unsent || memcmp(reply.magic, UDP_MAGIC, sizeof(UDP_MAGIC)) != 0
+      || reply.version != UDP_VERSION || reply.type != (node.pendingType | UDP_REPLY) || reply.seq != node.pendingSeq
+      || !sipVerify(node.key, (const uint8_t*)&reply, offsetof(udpStatus, tag), reply.tag)) {
+      _rejected++;
+      continue;
+    }
+    node.answered = true;
+    node.status = reply;
+    node.statusAt = pNow;
+    //A busy door is asked again at the deadline, while tries last
+    if (reply.result == UDP_BUSY && node.tries < maxTries(node.pendingType)) {
+      node.result = UDP_BUSY;
+      node.pendingSeq = 0;
+      continue;
+    }
+    finish(node, reply.result, pNow);
+  }
+}
+
+//Retry sends the socket had no room for
+void Fleet::onWritable(uint64_t pNow) {
+  for (size_t i = 0; i < _nodes.size() && _unsent > 0; i++) {
+    if (_nodes[i].unsent) {
+      _nodes[i].unsent = false;
+      _unsent--;
+      send(_nodes[i], pNow);
+      if (_nodes[i].unsent) {
+        return;
+      }
+    }
+  }
+}
+
+//Resend or give up on nodes past their deadline
+void Fleet::service(uint64_t pNow) {
+  for (size_t i = 0; i < _nodes.size() && _outstanding > 0; i++) {
+    fleetNode &node = _nodes[i];
+    if (node.pendingType == 0 || node.unsent || node.deadline > pNow) {
+      continue;
+    }
+    if (node.tries < maxTries(node.pendingType)) {
+      send(node, pNow);
+    } else {
+      node.timeouts++;
+      finish(node, node.result == UDP_BUSY ? UDP_BUSY : FLEET_TIMEOUT, pNow);
+    }
+  }
+}
+
+//Milliseconds time of the next deadline, or 0 if nothing is waiting on one
+uint64_t Fleet::nextDeadline() {
+  uint64_t next = 0;
+  for (size_t i = 0; i < _nodes.size() && _outstanding > 0; i++) {
+    const fleetNode &node = _nodes[i];
+    if (node.pendingType != 0 && !node.unsent && (next == 0 || node.deadline < next)) {
+      next = node.deadline;
+    }
+  }
+  return next;
+}
+
+uint8_t Fleet::roundType() {
+  return _roundType;
+}
+
+//How long the last finished round took
+uint64_t Fleet::roundMillis() {
+  return _roundMillis;
+}
+
+uint32_t Fleet::rounds() {
+  return _rounds;
+}
+
+uint32_t Fleet::rejected() {
+  return _rejected;
+}
+
+//Latest known state of pNode, or every node if it is -1, with each one's part in the last round
+void Fleet::statusJson(std::string &pOut, uint64_t pNow, int pNode) {
+  char line[384];
+  char address[INET_ADDRSTRLEN];
+  bool first = true;
+  pOut.append("{\"nodes\":[");
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    const fleetNode &node = _nodes[i];
+    if (pNode >= 0 && (int)i != pNode) {
+      continue;
+    }
+    inet_ntop(AF_INET, &node.address.sin_addr, address, sizeof(address));
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"address\":\"%s:%u\",\"result\":\"%s\",\"timeouts\":%u", first ? "" : ",",
+      node.name, address, ntohs(node.address.sin_port), fleetResultName(node.result), node.timeouts);
+    pOut.append(line);
+    if (node.answered) {
+      const udpStatus &status = node.status;
+      snprintf(line, sizeof(line), ",\"age\":%llu,\"state\":\"%s\",\"rssi\":%d,\"overrun\":%u,\"drift\":%.1f,\"time\":%u,\"openAt\":%u,"
+        "\"closeAt\":%u,\"uptime\":%u,\"heap\":%u", (unsigned long long)(pNow - node.statusAt), fleetStateName(status.doorState),
+        status.rssi, status.overRun, status.drift / 10.0, status.time, status.openAt, status.closeAt, status.uptime, status.freeHeap);
+      pOut.append(line);
+    }
+    pOut.append("}");
+    first = false;
+  }
+  snprintf(line, sizeof(line), "],\"roundMillis\":%llu,\"rounds\":%u,\"rejected\":%u}", (unsigned long long)_roundMillis, _rounds, _rejected);
+  pOut.append(line);
+}
+
+void Fleet::send(fleetNode &pNode, uint64_t pNow) {
+  udpRequest request;
+  memcpy(request.magic, UDP_MAGIC, sizeof(UDP_MAGIC));
+  request.version = UDP_VERSION;
+  request.type = pNode.pendingType;
+  if (pNode.pendingType == UDP_STATUS) {
+    request.seq = ++pNode.pollSeq;
+  } else {
+    uint32_t wall = time(NULL);
+    pNode.commandSeq = pNode.commandSeq + 1 > wall ? pNode.commandSeq + 1 : wall;
+    request.seq = pNode.commandSeq;
+  }
+  sipTag(pNode.key, (const uint8_t*)&request, offsetof(udpRequest, tag), request.tag);
+  if (sendto(_fd, &request, sizeof(request), 0, (const sockaddr*)&pNode.address, sizeof(pNode.address)) < 0
+    && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+    pNode.unsent = true;
+    _unsent++;
+    return;
+  }
+  //Other send errors are left to time out like a lost datagram
+  pNode.pendingSeq = request.seq;
+  pNode.deadline = pNow + _timeout;
+  pNode.tries++;
+}
+
+void Fleet::finish(fleetNode &pNode, uint8_t pResult, uint64_t pNow) {
+  pNode.result = pResult;
+  pNode.pendingType = 0;
+  pNode.pendingSeq = 0;
+  _outstanding--;
+  if (_outstanding == 0) {
+    _roundMillis = pNow - _roundStart;
+    _rounds++;
+  }
+}
+
+uint64_t Fleet::addressKey(const sockaddr_in &pAddress) {
+  return ((uint64_t)pAddress.sin_addr.s_addr << 16) | pAddress.sin_port;
+}
@@ -0,0 +1,91 @@
+#ifndef __FLEET_H__
+#define __FLEET_H__
+
+//Every door the gateway knows, polled and commanded together over UDP from one socket. Linux only
+
+
+#include <UdpProtocol.h>
+#include <netinet/in.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Sizing. A command gets FLEET_COMMAND_TRIES timeouts to be answered, a status poll one
+const size_t FLEET_NAME_LENGTH = 32;
+const uint8_t FLEET_COMMAND_TRIES = 3;
+const uint64_t FLEET_DEFAULT_TIMEOUT = 500;
+
+//Outcome of a node's part in a round: a UDP_ result from its reply, or one of these
+const uint8_t FLEET_PENDING = 0xFE;
+const uint8_t FLEET_TIMEOUT = 0xFF;
+
+struct fleetNode {
+  char name[FLEET_NAME_LENGTH];
+  sockaddr_in address;
+  uint8_t key[SIPHASH_KEY_LENGTH];
+  //The request in flight, if any. unsent is set while the socket had no room for it
+  uint8_t pendingType;
+  uint32_t pendingSeq;
+  uint64_t deadline;
+  uint8_t tries;
+  bool unsent;
+  //Commands need a seq above the last one the door took, so they start from the wall clock
+  uint32_t commandSeq;
+  uint32_t pollSeq;
+  //Latest reply and when it came, in gateway milliseconds
+  bool answered;
+  udpStatus status;
+  uint64_t statusAt;
+  uint8_t result;
+  uint32_t timeouts;
+};
+
+//Sends one request type to a set of nodes at once and waits for all of them, each on its own deadline,
+//so a round takes as long as its slowest node rather than the sum of them. One round at a time
+class Fleet {
+  public:
+    Fleet();
+    ~Fleet();
+    bool begin(uint16_t pPort = 0);
+    int fd();
+    bool add(const char *pName, const sockaddr_in &pAddress, const uint8_t *pKey);
+    size_t size();
+    const fleetNode &node(size_t pIndex);
+    int find(const char *pName);
+    void setTimeout(uint64_t pMillis);
+    uint64_t timeout();
+    bool start(uint8_t pType, int pNode, uint64_t pNow);
+    bool busy();
+    bool wantsWrite();
+    void onReadable(uint64_t pNow);
+    void onWritable(uint64_t pNow);
+    void service(uint64_t pNow);
+    uint64_t nextDeadline();
+    uint8_t roundType();
+    uint64_t roundMillis();
+    uint32_t rounds();
+    uint32_t rejected();
+    void statusJson(std::string &pOut, uint64_t pNow, int pNode = -1);
+  private:
+    void send(fleetNode &pNode, uint64_t pNow);
+    void finish(fleetNode &pNode, uint8_t pResult, uint64_t pNow);
+    static uint64_t addressKey(const sockaddr_in &pAddress);
+    int _fd;
+    std::vector<fleetNode> _nodes;
+    std::unordered_map<uint64_t, size_t> _byAddress;
+    uint64_t _timeout;
+    uint8_t _roundType;
+    size_t _outstanding;
+    size_t _unsent;
+    uint64_t _roundStart;
+    uint64_t _roundMillis;
+    uint32_t _rounds;
+    uint32_t _rejected;
+};
+
+const char *fleetStateName(uint8_t pState);
+const char *fleetResultName(uint8_t pResult);
+uint64_t fleetMillis();
+
+
+#endif // __FLEET_H__
@@ -0,0 +1,276 @@
+#include "Gateway.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace {
+  const char *actionName(uint8_t pType) {
+    switch (pType) {
+      case UDP_OPEN:
+        return "open";
+      case UDP_CLOSE:
+        return "close";
+      case UDP_STOP:
+        return "stop";
+      default:
+        return "status";
+    }
+  }
+
+  //Names from the network go into JSON with anything that could break out of the string left out
+  std::string jsonSafe(const std::string &pText) {
+    std::string out;
+    for (char c : pText) {
+      if (c >= ' ' && c <= '~' && c != '"' && c != '\\') {
+        out += c;
+      }
+    }
+    return out;
+  }
+
+  bool watch(int pEpoll, int pFd) {
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = pFd;
+    return epoll_ctl(pEpoll, EPOLL_CTL_ADD, pFd, &event) == 0;
+  }
+}
+
+Gateway::Gateway() {
+  _epoll = -1;
+  _running = false;
+  _watchingWrites = false;
+  _pollInterval = GATEWAY_DEFAULT_POLL;
+  _polledAt = 0;
+  _stopped = false;
+}
+
+Gateway::~Gateway() {
+  if (_epoll >= 0) {
+    close(_epoll);
+  }
+}
+
+//API on pApiAddress:pApiPort, doors polled from pUdpPort. Either port may be 0 for any free one
+bool Gateway::begin(const char *pApiAddress, uint16_t pApiPort, uint16_t pUdpPort) {
+  _epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (_epoll < 0 || !_fleet.begin(pUdpPort) || !_mdns.begin()) {
+    return false;
+  }
+  if (!watch(_epoll, _fleet.fd()) || !watch(_epoll, _mdns.fd())) {
+    return false;
+  }
+  return _api.begin(_epoll, pApiAddress, pApiPort, [this](uint32_t pClient, const std::string &pPath, const apiArgs &pArgs) {
+    onRequest(pClient, pPath, pArgs);
+  });
+}
+
+Fleet &Gateway::fleet() {
+  return _fleet;
+}
+
+HttpApi &Gateway::api() {
+  return _api;
+}
+
+MdnsBrowser &Gateway::mdns() {
+  return _mdns;
+}
+
+//Poll every door this often when nothing else is running. 0 only polls when asked
+void Gateway::setPollInterval(uint64_t pMillis) {
+  _pollInterval = pMillis;
+}
+
+//Wait for sockets or the next deadline, at most pMaxWaitMillis, and handle whatever is ready
+void Gateway::runOnce(int pMaxWaitMillis) {
+  epoll_event events[GATEWAY_EVENTS];
+  uint64_t now = fleetMillis();
+  uint64_t next = _fleet.nextDeadline();
+  int wait = pMaxWaitMillis;
+  if (_mdns.browsing(now) && (next == 0 || _mdns.deadline() < next)) {
+    next = _mdns.deadline();
+  }
+  if (!_running && _pollInterval > 0 && _fleet.size() > 0 && (next == 0 || _polledAt + _pollInterval < next)) {
+    next = _polledAt + _pollInterval;
+  }
+  if (next != 0) {
+    uint64_t until = next > now ? next - now : 0;
+    if (until < (uint64_t)wait) {
+      wait = until;
+    }
+  }
+  int count = epoll_wait(_epoll, events, GATEWAY_EVENTS, wait);
+  now = fleetMillis();
+  for (int i = 0; i < count; i++) {
+    int fd = events[i].data.fd;
+    if (fd == _fleet.fd()) {
+      if ((events[i].events & EPOLLIN) != 0) {
+        _fleet.onReadable(now);
+      }
+      if ((events[i].events & EPOLLOUT) != 0) {
+        _fleet.onWritable(now);
+      }
+    } else if (fd == _mdns.fd()) {
+      _mdns.onReadable();
+    } else {
+      _api.onEvent(fd, events[i].events);
+    }
+  }
+  service(now);
+}
+
+void Gateway::stop() {
+  _stopped = true;
+}
+
+bool Gateway::stopped() {
+  return _stopped;
+}
+
+void Gateway::onRequest(uint32_t pClient, const std::string &pPath, const apiArgs &pArgs) {
+  int node = -1;
+  auto named = pArgs.find("node");
+  auto fresh = pArgs.find("fresh");
+  auto action = pArgs.find("action");
+  if (named != pArgs.end()) {
+    node = _fleet.find(named->second.c_str());
+    if (node < 0) {
+      _api.reply(pClient, 404, "text/plain", "No such node\n");
+      return;
+    }
+  }
+  if (pPath == "/status") {
+    if (fresh != pArgs.end() && fresh->second == "1") {
+      queue(UDP_STATUS, node, pClient);
+      return;
+    }
+    std::string body;
+    _fleet.statusJson(body, fleetMillis(), node);
+    _api.reply(pClient, 200, "application/json", body);
+    return;
+  }
+  if (pPath == "/command") {
+    uint8_t type = 0;
+    if (action != pArgs.end()) {
+      type = action->second == "open" ? UDP_OPEN : action->second == "close" ? UDP_CLOSE : action->second == "stop" ? UDP_STOP : 0;
+    }
+    if (type == 0) {
+      _api.reply(pClient, 400, "text/plain", "action must be open, close or stop\n");
+      return;
+    }
+    queue(type, node, pClient);
+    return;
+  }
+  if (pPath == "/discover") {
+    _mdns.browse(fleetMillis(), _fleet.timeout());
+    _discoverers.push_back(pClient);
+    return;
+  }
+  _api.reply(pClient, 404, "text/plain", "Not found\n");
+}
+
+//Join an identical round that hasn't started yet, else queue a new one
+void Gateway::queue(uint8_t pType, int pNode, uint32_t pClient) {
+  for (size_t i = _running ? 1 : 0; i < _jobs.size(); i++) {
+    if (_jobs[i].type == pType && _jobs[i].node == pNode) {
+      if (pClient != 0) {
+        _jobs[i].clients.push_back(pClient);
+      }
+      return;
+    }
+  }
+  if (_jobs.size() >= GATEWAY_JOB_QUEUE) {
+    if (pClient != 0) {
+      _api.reply(pClient, 503, "text/plain", "Busy\n");
+    }
+    return;
+  }
+  gatewayJob job;
+  job.type = pType;
+  job.node = pNode;
+  if (pClient != 0) {
+    job.clients.push_back(pClient);
+  }
+  _jobs.push_back(job);
+}
+
+//Answer the round that finished, then start the next one
+void Gateway::service(uint64_t pNow) {
+  _fleet.service(pNow);
+  while (true) {
+    if (_running && !_fleet.busy()) {
+      gatewayJob &job = _jobs.front();
+      if (!job.clients.empty()) {
+        std::string json;
+        std::string body = "{\"action\":\"";
+        _fleet.statusJson(json, pNow, job.node);
+        body.append(actionName(job.type));
+        body.append("\",");
+        body.append(json, 1, std::string::npos);
+        for (uint32_t client : job.clients) {
+          _api.reply(client, 200, "application/json", body);
+        }
+      }
+      _jobs.pop_front();
+      _running = false;
+    }
+    if (_running) {
+      break;
+    }
+    if (_jobs.empty() && _pollInterval > 0 && _fleet.size() > 0 && pNow - _polledAt >= _pollInterval) {
+      queue(UDP_STATUS, -1, 0);
+    }
+    if (_jobs.empty()) {
+      break;
+    }
+    _fleet.start(_jobs.front().type, _jobs.front().node, pNow);
+    _running = true;
+    if (_jobs.front().type == UDP_STATUS && _jobs.front().node < 0) {
+      _polledAt = pNow;
+    }
+  }
+  if (!_discoverers.empty() && !_mdns.browsing(pNow)) {
+    finishDiscovery();
+  }
+  watchWrites(_fleet.wantsWrite());
+}
+
+void Gateway::finishDiscovery() {
+  std::string body = "{\"found\":[";
+  char entry[160];
+  char address[INET_ADDRSTRLEN];
+  for (size_t i = 0; i < _mdns.found().size(); i++) {
+    const mdnsFound &found = _mdns.found()[i];
+    const char *node = NULL;
+    for (size_t n = 0; n < _fleet.size() && node == NULL; n++) {
+      const sockaddr_in &known = _fleet.node(n).address;
+      if (known.sin_addr.s_addr == found.address.sin_addr.s_addr && known.sin_port == found.address.sin_port) {
+        node = _fleet.node(n).name;
+      }
+    }
+    inet_ntop(AF_INET, &found.address.sin_addr, address, sizeof(address));
+    snprintf(entry, sizeof(entry), "%s{\"instance\":\"%.63s\",\"address\":\"%s:%u\",\"node\":%s%s%s}", i == 0 ? "" : ",",
+      jsonSafe(found.instance).c_str(), address, ntohs(found.address.sin_port), node ? "\"" : "", node ? node : "null", node ? "\"" : "");
+    body.append(entry);
+  }
+  body.append("]}");
+  for (uint32_t client : _discoverers) {
+    _api.reply(client, 200, "application/json", body);
+  }
+  _discoverers.clear();
+}
+
+//Only ask for EPOLLOUT on the fleet socket while sends are waiting for room
+void Gateway::watchWrites(bool pWatch) {
+  epoll_event event;
+  if (pWatch == _watchingWrites) {
+    return;
+  }
+  event.events = EPOLLIN | (pWatch ? (uint32_t)EPOLLOUT : 0);
+  event.data.fd = _fleet.fd();
+  epoll_ctl(_epoll, EPOLL_CTL_MOD, _fleet.fd(), &event);
+  _watchingWrites = pWatch;
+}
@@ -0,0 +1,62 @@
+#ifndef __GATEWAY_H__
+#define __GATEWAY_H__
+
+//The gateway daemon: the fleet, its HTTP API and discovery on one epoll loop. Linux only
+
+
+#include "Fleet.h"
+#include "HttpApi.h"
+#include "Mdns.h"
+#include <deque>
+#include <vector>
+
+//Sizing
+const int GATEWAY_EVENTS = 64;
+const size_t GATEWAY_JOB_QUEUE = 32;
+const uint64_t GATEWAY_DEFAULT_POLL = 30000;
+
+//A round waiting for the fleet, and the API clients waiting on it. Background polls have none
+struct gatewayJob {
+  uint8_t type;
+  int node;
+  std::vector<uint32_t> clients;
+};
+
+//API:
+//  GET /status[?node=name][&fresh=1]    latest state, or after a new poll with fresh=1
+//  GET /command?action=open|close|stop[&node=name]
+//  GET /discover                        doors answering an mDNS browse, and which are configured
+//Everything is JSON. Rounds queue behind each other; identical queued ones share one round
+class Gateway {
+  public:
+    Gateway();
+    ~Gateway();
+    bool begin(const char *pApiAddress, uint16_t pApiPort, uint16_t pUdpPort);
+    Fleet &fleet();
+    HttpApi &api();
+    MdnsBrowser &mdns();
+    void setPollInterval(uint64_t pMillis);
+    void runOnce(int pMaxWaitMillis);
+    void stop();
+    bool stopped();
+  private:
+    void onRequest(uint32_t pClient, const std::string &pPath, const apiArgs &pArgs);
+    void queue(uint8_t pType, int pNode, uint32_t pClient);
+    void service(uint64_t pNow);
+    void finishDiscovery();
+    void watchWrites(bool pWatch);
+    int _epoll;
+    Fleet _fleet;
+    HttpApi _api;
+    MdnsBrowser _mdns;
+    std::deque<gatewayJob> _jobs;
+    bool _running;
+    bool _watchingWrites;
+    uint64_t _pollInterval;
+    uint64_t _polledAt;
+    std::vector<uint32_t> _discoverers;
+    volatile bool _stopped;
+};
+
+
+#endif // __GATEWAY_H__
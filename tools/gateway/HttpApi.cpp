@@ -0,0 +1,276 @@
+#include "HttpApi.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+  const char *reason(int pCode) {
+    switch (pCode) {
+      case 200:
+        return "OK";
+      case 400:
+        return "Bad Request";
+      case 404:
+        return "Not Found";
+      case 431:
+        return "Request Header Fields Too Large";
+      case 503:
+        return "Service Unavailable";
+      default:
+        return "Error";
+    }
+  }
+
+  int hexDigit(char pDigit) {
+    if (pDigit >= '0' && pDigit <= '9') {
+      return pDigit - '0';
+    }
+    if (pDigit >= 'a' && pDigit <= 'f') {
+      return pDigit - 'a' + 10;
+    }
+    if (pDigit >= 'A' && pDigit <= 'F') {
+      return pDigit - 'A' + 10;
+    }
+    return -1;
+  }
+
+  std::string decode(const std::string &pText) {
+    std::string out;
+    for (size_t i = 0; i < pText.size(); i++) {
+      if (pText[i] == '+') {
+        out += ' ';
+      } else if (pText[i] == '%' && i + 3 <= pText.size() && hexDigit(pText[i + 1]) >= 0 && hexDigit(pText[i + 2]) >= 0) {
+        out += (char)(hexDigit(pText[i + 1]) * 16 + hexDigit(pText[i + 2]));
+        i += 2;
+      } else {
+        out += pText[i];
+      }
+    }
+    return out;
+  }
+}
+
+//name=value pairs split on &, percent decoded
+void apiParseQuery(const std::string &pQuery, apiArgs &pArgs) {
+  size_t start = 0;
+  while (start < pQuery.size()) {
+    size_t end = pQuery.find('&', start);
+    if (end == std::string::npos) {
+      end = pQuery.size();
+    }
+    std::string pair = pQuery.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (!pair.empty()) {
+      pArgs[decode(pair.substr(0, equals))] = equals == std::string::npos ? "" : decode(pair.substr(equals + 1));
+    }
+    start = end + 1;
+  }
+}
+
+HttpApi::HttpApi() {
+  _epoll = -1;
+  _fd = -1;
+  _nextId = 1;
+}
+
+HttpApi::~HttpApi() {
+  while (!_clients.empty()) {
+    drop(_clients.begin()->first);
+  }
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+bool HttpApi::begin(int pEpoll, const char *pAddress, uint16_t pPort, handler pHandler) {
+  sockaddr_in local;
+  epoll_event event;
+  int on = 1;
+  _epoll = pEpoll;
+  _handler = pHandler;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(pPort);
+  if (inet_pton(AF_INET, pAddress, &local.sin_addr) != 1) {
+    return false;
+  }
+  _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_fd < 0) {
+    return false;
+  }
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(_fd, (const sockaddr*)&local, sizeof(local)) != 0 || listen(_fd, API_BACKLOG) != 0) {
+    return false;
+  }
+  event.events = EPOLLIN;
+  event.data.fd = _fd;
+  return epoll_ctl(_epoll, EPOLL_CTL_ADD, _fd, &event) == 0;
+}
+
+//The port listened on, which begin() may have been left to choose
+uint16_t HttpApi::port() {
+  sockaddr_in local;
+  socklen_t length = sizeof(local);
+  if (getsockname(_fd, (sockaddr*)&local, &length) != 0) {
+    return 0;
+  }
+  return ntohs(local.sin_port);
+}
+
+bool HttpApi::owns(int pFd) {
+  return pFd == _fd || _clients.count(pFd) > 0;
+}
+
+void HttpApi::onEvent(int pFd, uint32_t pEvents) {
+  if (pFd == _fd) {
+    accept();
+    return;
+  }
+  auto found = _clients.find(pFd);
+  if (found == _clients.end()) {
+    return;
+  }
+  if ((pEvents & (EPOLLERR | EPOLLHUP)) != 0) {
+    drop(pFd);
+    return;
+  }
+  if ((pEvents & EPOLLIN) != 0) {
+    read(pFd, found->second);
+  }
+  found = _clients.find(pFd);
+  if (found != _clients.end() && (pEvents & EPOLLOUT) != 0) {
+    write(pFd, found->second);
+  }
+}
+
+void HttpApi::reply(uint32_t pClient, int pCode, const char *pType, const std::string &pBody) {
+  char head[160];
+  auto id = _ids.find(pClient);
+  if (id == _ids.end()) {
+    return;
+  }
+  int fd = id->second;
+  apiClient &client = _clients[fd];
+  if (client.answered) {
+    return;
+  }
+  snprintf(head, sizeof(head), "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+    pCode, reason(pCode), pType, pBody.size());
+  client.out = head;
+  client.out.append(pBody);
+  client.answered = true;
+  write(fd, client);
+}
+
+size_t HttpApi::clients() {
+  return _clients.size();
+}
+
+void HttpApi::accept() {
+  epoll_event event;
+  while (true) {
+    int fd = accept4(_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    apiClient &client = _clients[fd];
+    client.id = _nextId++;
+    client.sent = 0;
+    client.handled = false;
+    client.answered = false;
+    client.ended = false;
+    _ids[client.id] = fd;
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+//Gather the head, then hand the request line to the handler. Bodies are ignored. A client that
+//shuts its side once the request is sent is still answered
+void HttpApi::read(int pFd, apiClient &pClient) {
+  char buffer[1024];
+  ssize_t length;
+  epoll_event event;
+  while ((length = recv(pFd, buffer, sizeof(buffer), 0)) > 0) {
+    if (!pClient.handled && !pClient.answered) {
+      pClient.in.append(buffer, length);
+    }
+  }
+  if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    drop(pFd);
+    return;
+  }
+  bool complete = pClient.in.find("\r\n\r\n") != std::string::npos;
+  if (length == 0) {
+    if (!pClient.handled && !pClient.answered && !complete) {
+      drop(pFd);
+      return;
+    }
+    //Nothing more to read, so stop waking for it
+    pClient.ended = true;
+    event.events = pClient.sent < pClient.out.size() ? (uint32_t)EPOLLOUT : 0;
+    event.data.fd = pFd;
+    epoll_ctl(_epoll, EPOLL_CTL_MOD, pFd, &event);
+  }
+  if (pClient.handled || pClient.answered || !complete) {
+    if (!pClient.handled && !pClient.answered && pClient.in.size() > API_REQUEST_LIMIT) {
+      reply(pClient.id, 431, "text/plain", "Request too large\n");
+    }
+    return;
+  }
+  size_t lineEnd = pClient.in.find("\r\n");
+  std::string line = pClient.in.substr(0, lineEnd);
+  size_t pathStart = line.find(' ');
+  size_t pathEnd = pathStart == std::string::npos ? std::string::npos : line.find(' ', pathStart + 1);
+  if (pathEnd == std::string::npos) {
+    reply(pClient.id, 400, "text/plain", "Bad request line\n");
+    return;
+  }
+  std::string target = line.substr(pathStart + 1, pathEnd - pathStart - 1);
+  size_t query = target.find('?');
+  apiArgs args;
+  if (query != std::string::npos) {
+    apiParseQuery(target.substr(query + 1), args);
+  }
+  pClient.in.clear();
+  pClient.handled = true;
+  _handler(pClient.id, target.substr(0, query), args);
+}
+
+//Write what the socket takes, waiting for EPOLLOUT for the rest, and close once it is all gone
+void HttpApi::write(int pFd, apiClient &pClient) {
+  epoll_event event;
+  while (pClient.sent < pClient.out.size()) {
+    ssize_t length = send(pFd, pClient.out.data() + pClient.sent, pClient.out.size() - pClient.sent, MSG_NOSIGNAL);
+    if (length < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        event.events = pClient.ended ? EPOLLOUT : EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+        event.data.fd = pFd;
+        epoll_ctl(_epoll, EPOLL_CTL_MOD, pFd, &event);
+        return;
+      }
+      drop(pFd);
+      return;
+    }
+    pClient.sent += length;
+  }
+  if (pClient.answered) {
+    drop(pFd);
+  }
+}
+
+void HttpApi::drop(int pFd) {
+  auto found = _clients.find(pFd);
+  if (found != _clients.end()) {
+    _ids.erase(found->second.id);
+    _clients.erase(found);
+  }
+  epoll_ctl(_epoll, EPOLL_CTL_DEL, pFd, NULL);
+  close(pFd);
+}
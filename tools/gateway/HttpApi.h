@@ -0,0 +1,59 @@
+#ifndef __HTTPAPI_H__
+#define __HTTPAPI_H__
+
+//Just enough HTTP/1.0 for the gateway's API, on the gateway's epoll loop. Linux only
+
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+//Sizing. A request head bigger than this is answered 431 and closed
+const size_t API_REQUEST_LIMIT = 4096;
+const int API_BACKLOG = 64;
+
+typedef std::map<std::string, std::string> apiArgs;
+
+struct apiClient {
+  uint32_t id;
+  std::string in;
+  std::string out;
+  size_t sent;
+  bool handled;
+  bool answered;
+  bool ended;
+};
+
+//One request per connection, answered then closed. The handler gets a client id it can reply to
+//straight away or later, once the fleet has answered. A client that only shuts its side is still
+//answered; one that goes away entirely is forgotten, and a late reply to it goes nowhere
+class HttpApi {
+  public:
+    typedef std::function<void(uint32_t pClient, const std::string &pPath, const apiArgs &pArgs)> handler;
+    HttpApi();
+    ~HttpApi();
+    bool begin(int pEpoll, const char *pAddress, uint16_t pPort, handler pHandler);
+    uint16_t port();
+    bool owns(int pFd);
+    void onEvent(int pFd, uint32_t pEvents);
+    void reply(uint32_t pClient, int pCode, const char *pType, const std::string &pBody);
+    size_t clients();
+  private:
+    void accept();
+    void read(int pFd, apiClient &pClient);
+    void write(int pFd, apiClient &pClient);
+    void drop(int pFd);
+    int _epoll;
+    int _fd;
+    uint32_t _nextId;
+    std::unordered_map<int, apiClient> _clients;
+    std::unordered_map<uint32_t, int> _ids;
+    handler _handler;
+};
+
+void apiParseQuery(const std::string &pQuery, apiArgs &pArgs);
+
+
+#endif // __HTTPAPI_H__
@@ -0,0 +1,200 @@
+#include "Mdns.h"
+#include <UdpProtocol.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+  const uint16_t DNS_A = 1;
+  const uint16_t DNS_PTR = 12;
+  const uint16_t DNS_SRV = 33;
+  const uint16_t DNS_CLASS_IN = 1;
+  //Ask for a unicast answer
+  const uint16_t DNS_QU = 0x8000;
+  const uint16_t DNS_RESPONSE = 0x8000;
+  const uint8_t DNS_MAX_JUMPS = 16;
+
+  uint16_t read16(const uint8_t *pBytes) {
+    return (pBytes[0] << 8) | pBytes[1];
+  }
+}
+
+//A possibly compressed name at pOffset, dotted. pOffset ends up just past it
+bool mdnsReadName(const uint8_t *pPacket, size_t pLength, size_t &pOffset, std::string &pName) {
+  size_t at = pOffset;
+  uint8_t jumps = 0;
+  pName.clear();
+  while (at < pLength) {
+    uint8_t label = pPacket[at];
+    if (label == 0) {
+      if (jumps == 0) {
+        pOffset = at + 1;
+      }
+      return true;
+    }
+    if ((label & 0xC0) == 0xC0) {
+      if (at + 1 >= pLength || ++jumps > DNS_MAX_JUMPS) {
+        return false;
+      }
+      if (jumps == 1) {
+        pOffset = at + 2;
+      }
+      at = ((label & 0x3F) << 8) | pPacket[at + 1];
+      continue;
+    }
+    if ((label & 0xC0) != 0 || at + 1 + label > pLength) {
+      return false;
+    }
+    if (!pName.empty()) {
+      pName += '.';
+    }
+    pName.append((const char*)pPacket + at + 1, label);
+    at += 1 + label;
+  }
+  return false;
+}
+
+MdnsBrowser::MdnsBrowser() {
+  _fd = -1;
+  _deadline = 0;
+  memset(&_target, 0, sizeof(_target));
+  _target.sin_family = AF_INET;
+  _target.sin_port = htons(MDNS_PORT);
+  inet_pton(AF_INET, MDNS_GROUP, &_target.sin_addr);
+}
+
+MdnsBrowser::~MdnsBrowser() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+bool MdnsBrowser::begin() {
+  uint8_t ttl = 255;
+  _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_fd < 0) {
+    return false;
+  }
+  setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  return true;
+}
+
+int MdnsBrowser::fd() {
+  return _fd;
+}
+
+//Where queries go. The mDNS group unless a test says otherwise
+void MdnsBrowser::setTarget(const sockaddr_in &pTarget) {
+  _target = pTarget;
+}
+
+//Forget what was found and ask again, listening for pMillis. False if a browse is already listening
+bool MdnsBrowser::browse(uint64_t pNow, uint64_t pMillis) {
+  uint8_t query[64];
+  size_t length = 12;
+  const char *label = MDNS_SERVICE;
+  if (browsing(pNow)) {
+    return false;
+  }
+  memset(query, 0, sizeof(query));
+  query[5] = 1;
+  while (*label != '\0') {
+    size_t size = strcspn(label, ".");
+    query[length++] = size;
+    memcpy(query + length, label, size);
+    length += size;
+    label += size;
+    if (*label == '.') {
+      label++;
+    }
+  }
+  query[length++] = 0;
+  query[length++] = DNS_PTR >> 8;
+  query[length++] = DNS_PTR & 0xFF;
+  query[length++] = (DNS_QU | DNS_CLASS_IN) >> 8;
+  query[length++] = (DNS_QU | DNS_CLASS_IN) & 0xFF;
+  _found.clear();
+  _deadline = pNow + pMillis;
+  return sendto(_fd, query, length, 0, (const sockaddr*)&_target, sizeof(_target)) == (ssize_t)length;
+}
+
+bool MdnsBrowser::browsing(uint64_t pNow) {
+  return _deadline != 0 && pNow < _deadline;
+}
+
+uint64_t MdnsBrowser::deadline() {
+  return _deadline;
+}
+
+void MdnsBrowser::onReadable() {
+  uint8_t packet[1500];
+  sockaddr_in from;
+  socklen_t fromLength;
+  ssize_t length;
+  while (true) {
+    fromLength = sizeof(from);
+    length = recvfrom(_fd, packet, sizeof(packet), 0, (sockaddr*)&from, &fromLength);
+    if (length < 0) {
+      return;
+    }
+    parse(packet, length, from);
+  }
+}
+
+const std::vector<mdnsFound> &MdnsBrowser::found() {
+  return _found;
+}
+
+//Answers and additional records alike. Anything malformed ends the parse with what was found so far
+void MdnsBrowser::parse(const uint8_t *pPacket, size_t pLength, const sockaddr_in &pFrom) {
+  std::string name;
+  std::string instance;
+  bool matched = false;
+  mdnsFound door;
+  size_t offset = 12;
+  if (pLength < 12 || (read16(pPacket + 2) & DNS_RESPONSE) == 0) {
+    return;
+  }
+  uint16_t questions = read16(pPacket + 4);
+  uint16_t records = read16(pPacket + 6) + read16(pPacket + 8) + read16(pPacket + 10);
+  door.address = pFrom;
+  door.address.sin_port = htons(UDP_PORT);
+  for (uint16_t i = 0; i < questions; i++) {
+    if (!mdnsReadName(pPacket, pLength, offset, name) || offset + 4 > pLength) {
+      return;
+    }
+    offset += 4;
+  }
+  for (uint16_t i = 0; i < records; i++) {
+    if (!mdnsReadName(pPacket, pLength, offset, name) || offset + 10 > pLength) {
+      break;
+    }
+    uint16_t type = read16(pPacket + offset);
+    uint16_t size = read16(pPacket + offset + 8);
+    size_t data = offset + 10;
+    if (data + size > pLength) {
+      break;
+    }
+    offset = data + size;
+    if (type == DNS_PTR && strcasecmp(name.c_str(), MDNS_SERVICE) == 0 && mdnsReadName(pPacket, pLength, data, instance)) {
+      matched = true;
+      door.instance = instance.substr(0, instance.find('.'));
+    } else if (type == DNS_SRV && size >= 6) {
+      door.address.sin_port = htons(read16(pPacket + data + 4));
+    } else if (type == DNS_A && size == 4) {
+      memcpy(&door.address.sin_addr, pPacket + data, 4);
+    }
+  }
+  if (!matched) {
+    return;
+  }
+  for (mdnsFound &found : _found) {
+    if (found.address.sin_addr.s_addr == door.address.sin_addr.s_addr && found.address.sin_port == door.address.sin_port) {
+      found.instance = door.instance;
+      return;
+    }
+  }
+  _found.push_back(door);
+}
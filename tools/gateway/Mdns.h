@@ -0,0 +1,48 @@
+#ifndef __MDNS_H__
+#define __MDNS_H__
+
+//One-shot DNS-SD browse for doors advertising _chookdoor._udp. Linux only
+
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Sizing
+const char MDNS_SERVICE[] = "_chookdoor._udp.local";
+const uint16_t MDNS_PORT = 5353;
+const char MDNS_GROUP[] = "224.0.0.251";
+
+struct mdnsFound {
+  std::string instance;
+  sockaddr_in address;
+};
+
+//Asks from an ordinary port rather than 5353, so responders answer it directly (a legacy unicast
+//query) and nothing else on the host that speaks mDNS is disturbed. A door is reported at the
+//address and port of its A and SRV records, or where the answer came from if they are missing
+class MdnsBrowser {
+  public:
+    MdnsBrowser();
+    ~MdnsBrowser();
+    bool begin();
+    int fd();
+    void setTarget(const sockaddr_in &pTarget);
+    bool browse(uint64_t pNow, uint64_t pMillis);
+    bool browsing(uint64_t pNow);
+    uint64_t deadline();
+    void onReadable();
+    const std::vector<mdnsFound> &found();
+  private:
+    void parse(const uint8_t *pPacket, size_t pLength, const sockaddr_in &pFrom);
+    int _fd;
+    sockaddr_in _target;
+    uint64_t _deadline;
+    std::vector<mdnsFound> _found;
+};
+
+bool mdnsReadName(const uint8_t *pPacket, size_t pLength, size_t &pOffset, std::string &pName);
+
+
+#endif // __MDNS_H__
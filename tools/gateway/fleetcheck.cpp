@@ -0,0 +1,385 @@
+//Runs the gateway against a fleet of simulated doors on localhost and checks it scales: a fleet-wide
+//poll takes one timeout however many doors are silent, commands reach every door that answers,
+//lossy doors get retries, and the API, round sharing and discovery work.
+//
+//The simulated doors answer the UDP protocol the way handleUdpPacket() in the firmware does, from
+//a thread of their own. Some never answer, some answer with the wrong key and some lose requests.
+//
+//Build from the repository root:
+//  g++ -std=gnu++17 -O2 -pthread -Ilib/SipHash -Ilib/UdpProtocol tools/gateway/fleetcheck.cpp tools/gateway/Fleet.cpp
+//      tools/gateway/HttpApi.cpp tools/gateway/Gateway.cpp tools/gateway/Mdns.cpp lib/SipHash/SipHash.cpp -o fleetcheck
+//Run:
+//  ./fleetcheck [doors] [timeoutMillis]
+//Exits non-zero if any check fails.
+
+#include "Gateway.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+namespace check {
+  //Every SILENT_EVERY'th door never answers, every BAD_KEY_EVERY'th tags with the wrong key and every
+  //LOSSY_EVERY'th loses its first command
+  const size_t SILENT_EVERY = 20;
+  const size_t BAD_KEY_EVERY = 97;
+  const size_t LOSSY_EVERY = 13;
+
+  struct fakeDoor {
+    int fd;
+    uint16_t port;
+    uint8_t key[SIPHASH_KEY_LENGTH];
+    bool silent;
+    bool badKey;
+    uint8_t dropCommands;
+    uint8_t state;
+    uint32_t lastSeq;
+    uint32_t polls;
+    uint32_t commands;
+    uint32_t stale;
+  };
+
+  std::vector<fakeDoor> doors;
+  std::mutex doorsLock;
+  std::atomic<bool> stopping(false);
+
+  int expect(bool pPassed, const char *pWhat) {
+    if (!pPassed) {
+      printf("fleet: %s failed\n", pWhat);
+    }
+    return pPassed ? 0 : 1;
+  }
+
+  sockaddr_in localAddress(uint16_t pPort) {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(pPort);
+    return address;
+  }
+
+  int bindLocal(int pType, uint16_t &pPort) {
+    sockaddr_in address = localAddress(0);
+    socklen_t length = sizeof(address);
+    int fd = socket(AF_INET, pType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || getsockname(fd, (sockaddr*)&address, &length) != 0) {
+      perror("fleetcheck");
+      exit(1);
+    }
+    pPort = ntohs(address.sin_port);
+    return fd;
+  }
+
+  //As handleUdpPacket() does it: commands the door is already doing are acknowledged, replays are stale
+  void answer(fakeDoor &pDoor) {
+    udpRequest request;
+    udpStatus reply;
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    uint8_t wrongKey[SIPHASH_KEY_LENGTH];
+    while (recvfrom(pDoor.fd, &request, sizeof(request), 0, (sockaddr*)&from, &fromLength) == sizeof(request)) {
+      std::lock_guard<std::mutex> lock(doorsLock);
+      fromLength = sizeof(from);
+      if (pDoor.silent || !sipVerify(pDoor.key, (const uint8_t*)&request, offsetof(udpRequest, tag), request.tag)) {
+        continue;
+      }
+      memset(&reply, 0, sizeof(reply));
+      reply.result = UDP_OK;
+      if (request.type == UDP_STATUS) {
+        pDoor.polls++;
+      } else {
+        if (pDoor.dropCommands > 0) {
+          pDoor.dropCommands--;
+          continue;
+        }
+        pDoor.commands++;
+        if (request.seq <= pDoor.lastSeq) {
+          reply.result = UDP_STALE;
+          pDoor.stale++;
+        } else {
+          pDoor.lastSeq = request.seq;
+          if (request.type == UDP_OPEN && pDoor.state != 1 && pDoor.state != 3) {
+            pDoor.state = 3;
+          } else if (request.type == UDP_CLOSE && pDoor.state != 2 && pDoor.state != 4) {
+            pDoor.state = 4;
+          } else if (request.type == UDP_STOP && (pDoor.state == 3 || pDoor.state == 4)) {
+            pDoor.state += 2;
+          }
+        }
+      }
+      memcpy(reply.magic, UDP_MAGIC, sizeof(UDP_MAGIC));
+      reply.version = UDP_VERSION;
+      reply.type = request.type | UDP_REPLY;
+      reply.seq = request.seq;
+      reply.doorState = pDoor.state;
+      reply.rssi = -60;
+      reply.overRun = 500;
+      reply.uptime = 1000;
+      reply.freeHeap = 30000;
+      memcpy(wrongKey, pDoor.key, sizeof(wrongKey));
+      wrongKey[0] ^= pDoor.badKey;
+      sipTag(wrongKey, (const uint8_t*)&reply, offsetof(udpStatus, tag), reply.tag);
+      sendto(pDoor.fd, &reply, sizeof(reply), 0, (const sockaddr*)&from, sizeof(from));
+    }
+  }
+
+  void runDoors() {
+    epoll_event events[64];
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < doors.size(); i++) {
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = i;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, doors[i].fd, &event);
+    }
+    while (!stopping) {
+      int count = epoll_wait(epoll, events, 64, 20);
+      for (int i = 0; i < count; i++) {
+        answer(doors[events[i].data.u64]);
+      }
+    }
+    close(epoll);
+  }
+
+  int sendGet(Gateway &pGateway, const char *pPath) {
+    char request[256];
+    sockaddr_in api = localAddress(pGateway.api().port());
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, (const sockaddr*)&api, sizeof(api)) != 0) {
+      perror("fleetcheck");
+      exit(1);
+    }
+    snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: localhost\r\n\r\n", pPath);
+    send(fd, request, strlen(request), MSG_NOSIGNAL);
+    return fd;
+  }
+
+  //Turn the gateway's loop until the whole response to pFd has come back
+  std::string readAll(Gateway &pGateway, int pFd) {
+    char buffer[4096];
+    std::string response;
+    uint64_t start = fleetMillis();
+    while (fleetMillis() - start < 20000) {
+      ssize_t length = recv(pFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (length == 0) {
+        break;
+      }
+      if (length > 0) {
+        response.append(buffer, length);
+        continue;
+      }
+      pGateway.runOnce(5);
+    }
+    close(pFd);
+    return response;
+  }
+
+  //Ask the gateway's API for pPath and wait for the answer
+  std::string httpGet(Gateway &pGateway, const char *pPath, int &pCode, uint64_t &pMillis) {
+    uint64_t start = fleetMillis();
+    std::string response = readAll(pGateway, sendGet(pGateway, pPath));
+    pMillis = fleetMillis() - start;
+    pCode = 0;
+    sscanf(response.c_str(), "HTTP/1.0 %d", &pCode);
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? "" : response.substr(body + 4);
+  }
+
+  size_t occurrences(const std::string &pText, const char *pWhat) {
+    size_t count = 0;
+    for (size_t at = pText.find(pWhat); at != std::string::npos; at = pText.find(pWhat, at + 1)) {
+      count++;
+    }
+    return count;
+  }
+
+  //A DNS-SD answer for door pDoor as a door's mDNS responder would send it: PTR, SRV and A
+  void answerBrowse(int pFd, uint16_t pDoorPort) {
+    uint8_t query[512];
+    uint8_t packet[512];
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    size_t length = 0;
+    if (recvfrom(pFd, query, sizeof(query), 0, (sockaddr*)&from, &fromLength) < 12) {
+      return;
+    }
+    const uint8_t head[] = { 0, 0, 0x84, 0, 0, 0, 0, 1, 0, 0, 0, 2 };
+    const uint8_t service[] = { 10, '_', 'c', 'h', 'o', 'o', 'k', 'd', 'o', 'o', 'r', 4, '_', 'u', 'd', 'p', 5, 'l', 'o', 'c', 'a', 'l', 0 };
+    memcpy(packet, head, sizeof(head));
+    length = sizeof(head);
+    //PTR _chookdoor._udp.local -> casadelpollo._chookdoor._udp.local
+    memcpy(packet + length, service, sizeof(service));
+    length += sizeof(service);
+    const uint8_t ptr[] = { 0, 12, 0, 1, 0, 0, 0, 120, 0, 15, 12, 'c', 'a', 's', 'a', 'd', 'e', 'l', 'p', 'o', 'l', 'l', 'o', 0xC0, 12 };
+    memcpy(packet + length, ptr, sizeof(ptr));
+    length += sizeof(ptr);
+    //SRV on the instance, pointing at the door's port
+    uint8_t srv[] = { 0xC0, 0, 0, 33, 0x80, 1, 0, 0, 0, 120, 0, 8, 0, 0, 0, 0, (uint8_t)(pDoorPort >> 8), (uint8_t)pDoorPort, 0xC0, 0 };
+    srv[1] = 12 + sizeof(service) + 10;
+    srv[19] = srv[1];
+    memcpy(packet + length, srv, sizeof(srv));
+    length += sizeof(srv);
+    //A record: 127.0.0.1
+    uint8_t a[] = { 0xC0, 0, 0, 1, 0x80, 1, 0, 0, 0, 120, 0, 4, 127, 0, 0, 1 };
+    a[1] = srv[1];
+    memcpy(packet + length, a, sizeof(a));
+    length += sizeof(a);
+    sendto(pFd, packet, length, 0, (const sockaddr*)&from, sizeof(from));
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 500;
+  uint64_t timeout = argc > 2 ? strtoull(argv[2], NULL, 10) : 300;
+  int failed = 0;
+  int checks = 0;
+  int code;
+  uint64_t millis;
+  size_t answering = 0;
+  size_t lossy = 0;
+  std::string body;
+  rlimit files;
+  Gateway gateway;
+
+  //A socket per simulated door
+  getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &files);
+  if (count + 64 > files.rlim_cur) {
+    count = files.rlim_cur - 64;
+  }
+
+  if (!gateway.begin("127.0.0.1", 0, 0)) {
+    perror("fleetcheck");
+    return 1;
+  }
+  gateway.fleet().setTimeout(timeout);
+  gateway.setPollInterval(0);
+  srand(2017);
+  check::doors.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    check::fakeDoor &door = check::doors[i];
+    char name[FLEET_NAME_LENGTH];
+    door.fd = check::bindLocal(SOCK_DGRAM, door.port);
+    for (uint8_t b = 0; b < SIPHASH_KEY_LENGTH; b++) {
+      door.key[b] = rand();
+    }
+    door.silent = i % check::SILENT_EVERY == check::SILENT_EVERY - 1;
+    door.badKey = !door.silent && i % check::BAD_KEY_EVERY == check::BAD_KEY_EVERY - 1;
+    door.dropCommands = !door.silent && !door.badKey && i % check::LOSSY_EVERY == 0 ? 1 : 0;
+    door.state = i % 3 == 0 ? 2 : 1;
+    door.lastSeq = 0;
+    door.polls = 0;
+    door.commands = 0;
+    door.stale = 0;
+    answering += !door.silent && !door.badKey;
+    lossy += door.dropCommands;
+    snprintf(name, sizeof(name), "door%zu", i);
+    gateway.fleet().add(name, check::localAddress(door.port), door.key);
+  }
+  std::thread doorThread(check::runDoors);
+
+  //Every door at once, in one timeout however many are silent
+  body = check::httpGet(gateway, "/status?fresh=1", code, millis);
+  failed += check::expect(code == 200 && check::occurrences(body, "\"result\":\"ok\"") == answering
+    && check::occurrences(body, "\"result\":\"timeout\"") == count - answering, "polling every door"), checks++;
+  failed += check::expect(millis >= timeout && millis < timeout * 2 + 100, "polling in one timeout"), checks++;
+  uint64_t pollMillis = millis;
+
+  //The same doors one after another, as the cron scripts did, for comparison
+  uint64_t start = fleetMillis();
+  for (size_t i = 0; i < count && i < 40; i++) {
+    gateway.fleet().start(UDP_STATUS, i, fleetMillis());
+    while (gateway.fleet().busy()) {
+      gateway.runOnce(5);
+    }
+  }
+  double perDoor = (fleetMillis() - start) / (double)(count < 40 ? count : 40);
+
+  body = check::httpGet(gateway, "/status?node=door0&fresh=1", code, millis);
+  failed += check::expect(code == 200 && check::occurrences(body, "\"name\":") == 1 && millis < timeout, "polling one door"), checks++;
+
+  //Close them all: lossy doors get it on a retry, and doors already closed just acknowledge it
+  body = check::httpGet(gateway, "/command?action=close", code, millis);
+  size_t closing = 0;
+  {
+    std::lock_guard<std::mutex> lock(check::doorsLock);
+    for (const check::fakeDoor &door : check::doors) {
+      closing += !door.silent && !door.badKey && (door.state == 2 || door.state == 4);
+    }
+  }
+  failed += check::expect(code == 200 && closing == answering && check::occurrences(body, "\"result\":\"ok\"") == answering,
+    "closing every door"), checks++;
+  failed += check::expect(check::occurrences(body, "\"state\":\"Closing\"") + check::occurrences(body, "\"state\":\"Closed\"") >= answering,
+    "reporting the doors closing"), checks++;
+  body = check::httpGet(gateway, "/command?action=close", code, millis);
+  uint32_t stale = 0;
+  {
+    std::lock_guard<std::mutex> lock(check::doorsLock);
+    for (const check::fakeDoor &door : check::doors) {
+      stale += door.stale;
+    }
+  }
+  failed += check::expect(code == 200 && check::occurrences(body, "\"result\":\"ok\"") == answering && stale == 0,
+    "closing again without replays"), checks++;
+
+  //Clients asking for the same fresh poll while a silent door holds up another round share one round
+  uint32_t rounds = gateway.fleet().rounds();
+  std::vector<int> waiting;
+  char silent[64];
+  snprintf(silent, sizeof(silent), "/status?fresh=1&node=door%zu", check::SILENT_EVERY - 1);
+  waiting.push_back(check::sendGet(gateway, silent));
+  while (!gateway.fleet().busy()) {
+    gateway.runOnce(5);
+  }
+  for (int i = 0; i < 3; i++) {
+    waiting.push_back(check::sendGet(gateway, "/status?fresh=1"));
+  }
+  size_t answered = 0;
+  for (int fd : waiting) {
+    answered += check::readAll(gateway, fd).find("HTTP/1.0 200") == 0;
+  }
+  failed += check::expect(answered == waiting.size() && gateway.fleet().rounds() - rounds == 2, "sharing rounds"), checks++;
+
+  check::httpGet(gateway, "/status?node=nobody", code, millis);
+  failed += check::expect(code == 404, "refusing unknown doors"), checks++;
+  check::httpGet(gateway, "/command?action=fly", code, millis);
+  failed += check::expect(code == 400, "refusing unknown actions"), checks++;
+  body = check::httpGet(gateway, "/status?node=door%30", code, millis);
+  failed += check::expect(code == 200 && body.find("\"name\":\"door0\"") != std::string::npos, "decoding a trailing escape"), checks++;
+
+  //A client that shuts its side once the request is sent still gets the answer
+  int halfClosed = check::sendGet(gateway, "/status?node=door0");
+  shutdown(halfClosed, SHUT_WR);
+  failed += check::expect(check::readAll(gateway, halfClosed).find("HTTP/1.0 200") == 0, "answering a half-closed client"), checks++;
+
+  //Discovery, with a stand-in for door0's mDNS responder
+  uint16_t responderPort;
+  int responder = check::bindLocal(SOCK_DGRAM, responderPort);
+  gateway.mdns().setTarget(check::localAddress(responderPort));
+  std::thread responderThread([responder]() {
+    for (int i = 0; i < 200; i++) {
+      check::answerBrowse(responder, check::doors[0].port);
+      usleep(5000);
+    }
+  });
+  body = check::httpGet(gateway, "/discover", code, millis);
+  responderThread.join();
+  close(responder);
+  failed += check::expect(code == 200 && body.find("\"instance\":\"casadelpollo\"") != std::string::npos
+    && body.find("\"node\":\"door0\"") != std::string::npos, "discovering doors"), checks++;
+
+  check::stopping = true;
+  doorThread.join();
+  printf("fleet: %zu doors, %zu answering, %zu lossy: all polled in %llu ms, against %.1f ms a door (%.0f ms in all) one at a time\n",
+    count, answering, lossy, (unsigned long long)pollMillis, perDoor, perDoor * count);
+  printf("fleet: %u rounds, %u rejected replies, %d checked, %d failed\n", gateway.fleet().rounds(), gateway.fleet().rejected(), checks, failed);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+//Fleet gateway for ChookDoor units. Polls every configured door over its UDP port at once, fans
+//commands out to all of them, and serves the combined state as JSON. See README.md.
+//
+//Build from the repository root:
+//  g++ -std=gnu++17 -O2 -Ilib/SipHash -Ilib/UdpProtocol tools/gateway/gateway.cpp tools/gateway/Fleet.cpp
+//      tools/gateway/HttpApi.cpp tools/gateway/Gateway.cpp tools/gateway/Mdns.cpp lib/SipHash/SipHash.cpp -o gateway
+//Run:
+//  ./gateway -c doors.conf [-l 127.0.0.1:8080] [-u udpPort] [-t timeoutMillis] [-i pollMillis]
+//doors.conf has a line per door: name host[:port] key, the key being the 32 hex digits from dump config on the door's console.
+//# starts a comment
+
+#include "Gateway.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+  Gateway *running = NULL;
+
+  void onSignal(int) {
+    if (running != NULL) {
+      running->stop();
+    }
+  }
+
+  bool parseKey(const char *pHex, uint8_t *pKey) {
+    if (strlen(pHex) != SIPHASH_KEY_LENGTH * 2) {
+      return false;
+    }
+    for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i++) {
+      unsigned int byte;
+      if (sscanf(pHex + i * 2, "%2x", &byte) != 1 || !isxdigit(pHex[i * 2]) || !isxdigit(pHex[i * 2 + 1])) {
+        return false;
+      }
+      pKey[i] = byte;
+    }
+    return true;
+  }
+
+  //host or host:port, by name or dotted quad
+  bool parseAddress(const char *pText, uint16_t pDefaultPort, sockaddr_in &pAddress) {
+    char host[256];
+    addrinfo hints;
+    addrinfo *found;
+    const char *colon = strrchr(pText, ':');
+    long port = pDefaultPort;
+    size_t length = colon ? (size_t)(colon - pText) : strlen(pText);
+    if (length == 0 || length >= sizeof(host)) {
+      return false;
+    }
+    if (colon != NULL) {
+      char *end;
+      port = strtol(colon + 1, &end, 10);
+      if (*end != '\0' || port < 1 || port > 65535) {
+        return false;
+      }
+    }
+    memcpy(host, pText, length);
+    host[length] = '\0';
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0) {
+      return false;
+    }
+    pAddress = *(const sockaddr_in*)found->ai_addr;
+    pAddress.sin_port = htons(port);
+    freeaddrinfo(found);
+    return true;
+  }
+
+  bool validName(const char *pName) {
+    if (*pName == '\0' || strlen(pName) >= FLEET_NAME_LENGTH) {
+      return false;
+    }
+    for (; *pName != '\0'; pName++) {
+      if (!isalnum((unsigned char)*pName) && strchr("-_.", *pName) == NULL) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool loadNodes(Fleet &pFleet, const char *pPath) {
+    char line[512];
+    char name[64];
+    char address[300];
+    char key[64];
+    uint8_t keyBytes[SIPHASH_KEY_LENGTH];
+    sockaddr_in resolved;
+    int number = 0;
+    FILE *file = fopen(pPath, "r");
+    if (file == NULL) {
+      fprintf(stderr, "gateway: can't read %s\n", pPath);
+      return false;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+      number++;
+      char *comment = strchr(line, '#');
+      if (comment != NULL) {
+        *comment = '\0';
+      }
+      int fields = sscanf(line, "%63s %299s %63s", name, address, key);
+      if (fields <= 0) {
+        continue;
+      }
+      if (fields != 3 || !validName(name) || !parseKey(key, keyBytes)) {
+        fprintf(stderr, "gateway: %s:%d: want name host[:port] key\n", pPath, number);
+        fclose(file);
+        return false;
+      }
+      if (!parseAddress(address, UDP_PORT, resolved)) {
+        fprintf(stderr, "gateway: %s:%d: can't resolve %s\n", pPath, number, address);
+        fclose(file);
+        return false;
+      }
+      if (!pFleet.add(name, resolved, keyBytes)) {
+        fprintf(stderr, "gateway: %s:%d: %s is already in the fleet\n", pPath, number, name);
+        fclose(file);
+        return false;
+      }
+    }
+    fclose(file);
+    return true;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *config = NULL;
+  char listen[64] = "127.0.0.1:8080";
+  long udpPort = 0;
+  long timeout = FLEET_DEFAULT_TIMEOUT;
+  long interval = GATEWAY_DEFAULT_POLL;
+  sockaddr_in api;
+  int option;
+  Gateway gateway;
+
+  while ((option = getopt(argc, argv, "c:l:u:t:i:")) != -1) {
+    switch (option) {
+      case 'c':
+        config = optarg;
+        break;
+      case 'l':
+        snprintf(listen, sizeof(listen), "%s", optarg);
+        break;
+      case 'u':
+        udpPort = atol(optarg);
+        break;
+      case 't':
+        timeout = atol(optarg);
+        break;
+      case 'i':
+        interval = atol(optarg);
+        break;
+      default:
+        config = NULL;
+        optind = argc;
+        break;
+    }
+  }
+  if (config == NULL || udpPort < 0 || udpPort > 65535 || timeout < 1 || interval < 0 || !parseAddress(listen, 8080, api)) {
+    fprintf(stderr, "usage: gateway -c doors.conf [-l 127.0.0.1:8080] [-u udpPort] [-t timeoutMillis] [-i pollMillis]\n");
+    return 2;
+  }
+  if (!gateway.begin(inet_ntoa(api.sin_addr), ntohs(api.sin_port), udpPort)) {
+    perror("gateway");
+    return 1;
+  }
+  if (!loadNodes(gateway.fleet(), config)) {
+    return 1;
+  }
+  gateway.fleet().setTimeout(timeout);
+  gateway.setPollInterval(interval);
+  running = &gateway;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "gateway: %zu doors, API on %s\n", gateway.fleet().size(), listen);
+  while (!gateway.stopped()) {
+    gateway.runOnce(1000);
+  }
+  return 0;
+}
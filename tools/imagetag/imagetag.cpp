@@ -0,0 +1,64 @@
+//Prints the tag /update wants with a firmware or filesystem image: the image's SipHash-2-4 under
+//the door's key, as 16 hex digits. See README.md.
+//
+//Build from the repository root:
+//  g++ -std=gnu++17 -O2 -Ilib/SipHash tools/imagetag/imagetag.cpp lib/SipHash/SipHash.cpp -o imagetag
+//Run:
+//  ./imagetag key image.bin
+//key is the 32 hex digits from dump config on the door's console.
+
+#include <SipHash.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+  bool parseKey(const char *pHex, uint8_t *pKey) {
+    if (strlen(pHex) != SIPHASH_KEY_LENGTH * 2) {
+      return false;
+    }
+    for (uint8_t i = 0; i < SIPHASH_KEY_LENGTH; i++) {
+      char pair[3] = { pHex[i * 2], pHex[i * 2 + 1], 0 };
+      if (!isxdigit((unsigned char)pair[0]) || !isxdigit((unsigned char)pair[1])) {
+        return false;
+      }
+      pKey[i] = strtoul(pair, NULL, 16);
+    }
+    return true;
+  }
+}
+
+int main(int argc, char **argv) {
+  uint8_t key[SIPHASH_KEY_LENGTH];
+  uint8_t buffer[4096];
+  size_t length;
+  sipState state;
+  FILE *image;
+
+  if (argc != 3 || !parseKey(argv[1], key)) {
+    fprintf(stderr, "usage: imagetag key image.bin\n");
+    return 2;
+  }
+  image = fopen(argv[2], "rb");
+  if (image == NULL) {
+    perror("imagetag");
+    return 1;
+  }
+  sipBegin(state, key);
+  while ((length = fread(buffer, 1, sizeof(buffer), image)) > 0) {
+    sipAdd(state, buffer, length);
+  }
+  if (ferror(image)) {
+    perror("imagetag");
+    fclose(image);
+    return 1;
+  }
+  fclose(image);
+  uint64_t tag = sipFinish(state);
+  for (uint8_t i = 0; i < SIPHASH_TAG_LENGTH; i++) {
+    printf("%02x", (unsigned)(uint8_t)(tag >> (8 * i)));
+  }
+  printf("\n");
+  return 0;
+}
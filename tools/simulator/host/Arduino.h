@@ -0,0 +1,286 @@
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+//Host build of the Arduino core pieces the firmware uses. Time and pins are virtual, see host.h
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define FPSTR(p) ((const __FlashStringHelper*)(p))
+#define F(s) ((const __FlashStringHelper*)(s))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+class __FlashStringHelper;
+
+//NodeMCU pin labels map to GPIO numbers
+const uint8_t D0 = 16;
+const uint8_t D1 = 5;
+const uint8_t D2 = 4;
+const uint8_t D3 = 0;
+const uint8_t D4 = 2;
+const uint8_t D5 = 14;
+const uint8_t D6 = 12;
+const uint8_t D7 = 13;
+const uint8_t D8 = 15;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint32_t hostGPI();
+uint32_t hostGP16I();
+#define GPI hostGPI()
+#define GP16I hostGP16I()
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+//Counted by HeapProfiler, which lives in lib/
+void heapCountAlloc(size_t pBytes, bool pAllocated);
+void heapCountFree();
+
+//String's own buffer is kept out of the allocation counts. String reports what the ESP8266 core's
+//would allocate instead: nothing up to its 10 character inline buffer, then a realloc to the exact
+//length whenever it grows
+template <typename T> struct uncountedAllocator {
+  typedef T value_type;
+  uncountedAllocator() {}
+  template <typename U> uncountedAllocator(const uncountedAllocator<U> &) {}
+  T *allocate(size_t n) { return (T*)malloc(n * sizeof(T)); }
+  void deallocate(T *p, size_t) { free(p); }
+  template <typename U> bool operator==(const uncountedAllocator<U> &) const { return true; }
+  template <typename U> bool operator!=(const uncountedAllocator<U> &) const { return false; }
+};
+typedef std::basic_string<char, std::char_traits<char>, uncountedAllocator<char> > hostString;
+
+class String {
+  public:
+    String() {}
+    String(const char *c) : s(c ? c : "") { grow(s.size()); }
+    String(const __FlashStringHelper *f) : s((const char*)f) { grow(s.size()); }
+    String(const std::string &o) : s(o.data(), o.size()) { grow(s.size()); }
+    String(const hostString &o) : s(o) { grow(s.size()); }
+    String(const String &o) : s(o.s) { grow(s.size()); }
+    String(String &&o) : s(std::move(o.s)), capacity(o.capacity) { o.s.clear(); o.capacity = SSO_LENGTH; }
+    explicit String(char c) : s(1, c) {}
+    explicit String(unsigned char v, unsigned char base = 10) { fromInt(v, base); }
+    explicit String(int v, unsigned char base = 10) { fromInt(v, base); }
+    explicit String(unsigned int v, unsigned char base = 10) { fromInt(v, base); }
+    explicit String(long v, unsigned char base = 10) { fromInt(v, base); }
+    explicit String(unsigned long v, unsigned char base = 10) { fromInt(v, base); }
+    explicit String(float v, unsigned char decimals = 2) { fromDouble(v, decimals); }
+    explicit String(double v, unsigned char decimals = 2) { fromDouble(v, decimals); }
+    ~String() { release(); }
+
+    String &operator=(const String &o) { if (this != &o) { s = o.s; grow(s.size()); } return *this; }
+    String &operator=(String &&o) {
+      if (this != &o) {
+        release();
+        s = std::move(o.s);
+        capacity = o.capacity;
+        o.s.clear();
+        o.capacity = SSO_LENGTH;
+      }
+      return *this;
+    }
+
+    unsigned int length() const { return s.size(); }
+    const char *c_str() const { return s.c_str(); }
+    bool reserve(unsigned int n) { grow(n); s.reserve(n); return true; }
+
+    bool concat(const String &o) { grow(s.size() + o.s.size()); s += o.s; return true; }
+    bool concat(const char *c) { if (c) { grow(s.size() + strlen(c)); s += c; } return true; }
+    bool concat(const char *c, unsigned int n) { grow(s.size() + n); s.append(c, n); return true; }
+    bool concat(const __FlashStringHelper *f) { return concat((const char*)f); }
+    bool concat(char c) { grow(s.size() + 1); s += c; return true; }
+    bool concat(unsigned char v) { return concat(String(v)); }
+    bool concat(int v) { return concat(String(v)); }
+    bool concat(unsigned int v) { return concat(String(v)); }
+    bool concat(long v) { return concat(String(v)); }
+    bool concat(unsigned long v) { return concat(String(v)); }
+    bool concat(float v) { return concat(String(v)); }
+    bool concat(double v) { return concat(String(v)); }
+    template <typename T> String &operator+=(const T &v) { concat(v); return *this; }
+
+    bool equals(const String &o) const { return s == o.s; }
+    bool operator==(const String &o) const { return s == o.s; }
+    bool operator!=(const String &o) const { return s != o.s; }
+    bool operator==(const char *c) const { return s == (c ? c : ""); }
+    bool operator!=(const char *c) const { return !(*this == c); }
+    bool operator<(const String &o) const { return s < o.s; }
+    char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    int indexOf(char c, unsigned int from = 0) const { size_t p = s.find(c, from); return p == hostString::npos ? -1 : (int)p; }
+    int indexOf(const String &o, unsigned int from = 0) const { size_t p = s.find(o.s, from); return p == hostString::npos ? -1 : (int)p; }
+    bool startsWith(const String &o) const { return s.compare(0, o.s.size(), o.s) == 0; }
+    bool endsWith(const String &o) const { return s.size() >= o.s.size() && s.compare(s.size() - o.s.size(), o.s.size(), o.s) == 0; }
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < s.size() && to > from ? String(s.substr(from, to - from)) : String(); }
+    void toCharArray(char *buf, unsigned int size) const { getBytes((unsigned char*)buf, size); }
+    void getBytes(unsigned char *buf, unsigned int size) const {
+      if (size == 0) return;
+      size_t n = std::min((size_t)size - 1, s.size());
+      memcpy(buf, s.data(), n);
+      buf[n] = 0;
+    }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void trim() { size_t a = s.find_first_not_of(" \t\r\n"); size_t b = s.find_last_not_of(" \t\r\n"); s = a == hostString::npos ? "" : s.substr(a, b - a + 1); }
+    void toLowerCase() { for (auto &c : s) c = tolower(c); }
+    void toUpperCase() { for (auto &c : s) c = toupper(c); }
+    std::string str() const { return std::string(s.data(), s.size()); }
+
+    hostString s;
+  private:
+    static const unsigned int SSO_LENGTH = 10;
+    unsigned int capacity = SSO_LENGTH;
+    void grow(size_t n) {
+      if (n <= capacity) return;
+      heapCountAlloc(n + 1, true);
+      if (capacity > SSO_LENGTH) heapCountFree();
+      capacity = n;
+    }
+    void release() {
+      if (capacity > SSO_LENGTH) heapCountFree();
+      capacity = SSO_LENGTH;
+    }
+    void fromInt(long long v, unsigned char base) {
+      char buf[72];
+      if (base == 10) { snprintf(buf, sizeof(buf), "%lld", v); }
+      else if (base == 16) { snprintf(buf, sizeof(buf), "%llx", (unsigned long long)v); }
+      else { snprintf(buf, sizeof(buf), "%llo", (unsigned long long)v); }
+      s = buf;
+      grow(s.size());
+    }
+    void fromDouble(double v, unsigned char decimals) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+      s = buf;
+      grow(s.size());
+    }
+};
+
+template <typename T> String operator+(const String &a, const T &b) { String r(a); r.concat(b); return r; }
+inline String operator+(const char *a, const String &b) { String r(a); r.concat(b); return r; }
+inline String operator+(const __FlashStringHelper *a, const String &b) { String r(a); r.concat(b); return r; }
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual int availableForWrite() { return 0; }
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while (n < size && write(buffer[n])) n++;
+      return n;
+    }
+    size_t write(const char *str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    size_t print(const String &v) { return write((const uint8_t*)v.c_str(), v.length()); }
+    size_t print(const char *v) { return write(v); }
+    size_t print(const __FlashStringHelper *v) { return write((const char*)v); }
+    size_t print(char v) { return write((uint8_t)v); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned int v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, (unsigned char)decimals)); }
+    template <typename T> size_t println(const T &v) { return print(v) + println(); }
+    size_t println() { return write("\r\n"); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    size_t readBytes(uint8_t *buffer, size_t length) {
+      size_t n = 0;
+      while (n < length && available()) buffer[n++] = read();
+      return n;
+    }
+    size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+    String readString() {
+      String r;
+      while (available()) r.concat((char)read());
+      return r;
+    }
+};
+
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long baud);
+    int available() override;
+    int read() override;
+    int peek() override;
+    int availableForWrite() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+extern HardwareSerial Serial;
+
+struct rst_info {
+  uint32_t reason;
+};
+
+class EspClass {
+  public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+    uint8_t getHeapFragmentation();
+    uint32_t getChipId();
+    uint32_t getCycleCount();
+    uint32_t random();
+    rst_info *getResetInfoPtr();
+    String getResetReason();
+    uint32_t getSketchSize();
+    String getSketchMD5();
+    uint32_t getFreeSketchSpace();
+    bool flashRead(uint32_t address, uint32_t *data, size_t size);
+};
+extern EspClass ESP;
+
+
+#endif // __HOST_ARDUINO_H__
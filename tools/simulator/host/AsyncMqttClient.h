@@ -0,0 +1,61 @@
+#ifndef __HOST_ASYNCMQTTCLIENT_H__
+#define __HOST_ASYNCMQTTCLIENT_H__
+
+//Host AsyncMqttClient. The broker lives in host.h; connects and acks arrive from host::advance(),
+//the way the real client's callbacks arrive between loop() calls
+
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+enum class AsyncMqttClientDisconnectReason : int8_t {
+  TCP_DISCONNECTED = 0,
+  MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+  MQTT_IDENTIFIER_REJECTED = 2,
+  MQTT_SERVER_UNAVAILABLE = 3,
+  MQTT_MALFORMED_CREDENTIALS = 4,
+  MQTT_NOT_AUTHORIZED = 5,
+  ESP8266_NOT_ENOUGH_SPACE = 6,
+  TLS_BAD_FINGERPRINT = 7
+};
+
+typedef std::function<void(bool sessionPresent)> AsyncMqttClientInternals_OnConnectUserCallback;
+typedef std::function<void(AsyncMqttClientDisconnectReason reason)> AsyncMqttClientInternals_OnDisconnectUserCallback;
+typedef std::function<void(uint16_t packetId)> AsyncMqttClientInternals_OnPublishUserCallback;
+
+class AsyncMqttClient {
+  public:
+    AsyncMqttClient();
+    ~AsyncMqttClient();
+    AsyncMqttClient &setServer(const char *host, uint16_t port);
+    AsyncMqttClient &setClientId(const char *clientId);
+    AsyncMqttClient &setKeepAlive(uint16_t keepAlive);
+    AsyncMqttClient &setWill(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0);
+    AsyncMqttClient &onConnect(AsyncMqttClientInternals_OnConnectUserCallback callback);
+    AsyncMqttClient &onDisconnect(AsyncMqttClientInternals_OnDisconnectUserCallback callback);
+    AsyncMqttClient &onPublish(AsyncMqttClientInternals_OnPublishUserCallback callback);
+    bool connected() const;
+    void connect();
+    void disconnect(bool force = false);
+    uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0, bool dup = false, uint16_t message_id = 0);
+
+    //Host side
+    void pump();
+  private:
+    AsyncMqttClientInternals_OnConnectUserCallback _onConnect;
+    AsyncMqttClientInternals_OnDisconnectUserCallback _onDisconnect;
+    AsyncMqttClientInternals_OnPublishUserCallback _onPublish;
+    String _host;
+    uint16_t _port;
+    String _willTopic;
+    String _willPayload;
+    bool _connecting;
+    bool _connected;
+    bool _closing;
+    uint16_t _nextId;
+    std::vector<uint16_t> _inFlight;
+};
+
+
+#endif // __HOST_ASYNCMQTTCLIENT_H__
@@ -0,0 +1,32 @@
+#ifndef __HOST_EEPROM_H__
+#define __HOST_EEPROM_H__
+
+//Host EEPROM emulation backed by RAM
+
+
+#include <Arduino.h>
+
+class EEPROMClass {
+  public:
+    void begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    uint32_t commits();
+    uint8_t *getDataPtr();
+    template <typename T> T &get(int address, T &t) {
+      memcpy((uint8_t*)&t, _data + address, sizeof(T));
+      return t;
+    }
+    template <typename T> const T &put(int address, const T &t) {
+      memcpy(_data + address, (const uint8_t*)&t, sizeof(T));
+      return t;
+    }
+  private:
+    uint8_t _data[4096];
+    uint32_t _commits;
+};
+extern EEPROMClass EEPROM;
+
+
+#endif // __HOST_EEPROM_H__
@@ -0,0 +1,33 @@
+#ifndef __HOST_ESP8266WIFI_H__
+#define __HOST_ESP8266WIFI_H__
+
+//Host WiFi. Always connects immediately
+
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } WiFiMode_t;
+typedef enum { WL_IDLE_STATUS, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_DISCONNECTED } wl_status_t;
+
+class ESP8266WiFiClass {
+  public:
+    bool mode(WiFiMode_t m);
+    WiFiMode_t getMode();
+    wl_status_t begin(const char *ssid, const char *passphrase = NULL);
+    bool disconnect(bool wifioff = false);
+    bool softAP(const char *ssid, const char *passphrase = NULL);
+    bool softAPdisconnect(bool wifioff = false);
+    wl_status_t status();
+    IPAddress localIP();
+    IPAddress softAPIP();
+    int32_t RSSI();
+  private:
+    WiFiMode_t _mode;
+};
+extern ESP8266WiFiClass WiFi;
+
+#include <WiFiClient.h>
+
+
+#endif // __HOST_ESP8266WIFI_H__
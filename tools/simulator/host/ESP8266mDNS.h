@@ -0,0 +1,17 @@
+#ifndef __HOST_ESP8266MDNS_H__
+#define __HOST_ESP8266MDNS_H__
+
+
+#include <Arduino.h>
+
+class MDNSResponder {
+  public:
+    bool begin(const char *hostname);
+    bool addService(const char *service, const char *proto, uint16_t port);
+    bool addServiceTxt(const char *service, const char *proto, const char *key, const char *value);
+    void update();
+};
+extern MDNSResponder MDNS;
+
+
+#endif // __HOST_ESP8266MDNS_H__
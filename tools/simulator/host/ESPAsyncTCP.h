@@ -0,0 +1,21 @@
+#ifndef __HOST_ESPASYNCTCP_H__
+#define __HOST_ESPASYNCTCP_H__
+
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class AsyncClient {
+  public:
+    AsyncClient(IPAddress pRemote = IPAddress(127, 0, 0, 1)) : _remote(pRemote) {}
+    IPAddress remoteIP() { return _remote; }
+    uint16_t remotePort() { return 40000; }
+    size_t space() { return 2920; }
+    bool connected() { return true; }
+    void close(bool now = false) {}
+  private:
+    IPAddress _remote;
+};
+
+
+#endif // __HOST_ESPASYNCTCP_H__
@@ -0,0 +1,188 @@
+#ifndef __HOST_ESPASYNCWEBSERVER_H__
+#define __HOST_ESPASYNCWEBSERVER_H__
+
+//Host ESPAsyncWebServer. Requests are injected with request() and run to completion
+
+
+#include <ESPAsyncTCP.h>
+#include <FS.h>
+#include <functional>
+#include <vector>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+//Returned by a filler with nothing ready yet
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncWebParameter {
+  public:
+    AsyncWebParameter(const String &name, const String &value, bool form = false, bool file = false, size_t size = 0)
+      : _name(name), _value(value), _size(size), _isForm(form), _isFile(file) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return _isFile; }
+  private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _isForm;
+    bool _isFile;
+};
+
+class AsyncWebServerResponse {
+  public:
+    AsyncWebServerResponse(int code, const String &contentType) : _code(code), _contentType(contentType) {}
+    virtual ~AsyncWebServerResponse() {}
+    void addHeader(const String &name, const String &value) { _headers.push_back({ name, value }); }
+    void setContentLength(size_t len) {}
+    void setCode(int code) { _code = code; }
+    virtual String body() = 0;
+    int _code;
+    String _contentType;
+    std::vector<std::pair<String, String> > _headers;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+  public:
+    AsyncBasicResponse(int code, const String &contentType, const String &content) : AsyncWebServerResponse(code, contentType), _content(content) {}
+    String body() override { return _content; }
+  private:
+    String _content;
+};
+
+class AsyncCallbackResponse : public AsyncWebServerResponse {
+  public:
+    AsyncCallbackResponse(const String &contentType, AwsResponseFiller filler) : AsyncWebServerResponse(200, contentType), _filler(filler) {}
+    String body() override;
+  private:
+    AwsResponseFiller _filler;
+};
+
+class AsyncWebServerRequest {
+  public:
+    AsyncWebServerRequest(const String &url, WebRequestMethod method, const std::vector<std::pair<String, String> > &params, IPAddress remote);
+    ~AsyncWebServerRequest();
+    AsyncClient *client() { return &_client; }
+    const String &url() const { return _url; }
+    WebRequestMethodComposite method() const { return _method; }
+    size_t contentLength() const { return _contentLength; }
+    size_t params() const { return _params.size(); }
+    bool hasParam(const String &name, bool post = false, bool file = false) const;
+    AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+    AsyncWebParameter *getParam(size_t num) const;
+    size_t args() const { return _params.size(); }
+    const String &arg(const String &name) const;
+    const String &arg(size_t i) const;
+    const String &argName(size_t i) const;
+    bool hasArg(const char *name) const;
+    bool hasHeader(const String &name) const;
+    void onDisconnect(std::function<void(void)> fn) { _onDisconnect = fn; }
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+    void send(fs::FS &fs, const String &path, const String &contentType = String(), bool download = false);
+    void send_P(int code, const String &contentType, const uint8_t *content, size_t len);
+    void send_P(int code, const String &contentType, PGM_P content);
+    void redirect(const String &url);
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+    AsyncWebServerResponse *beginResponse(fs::FS &fs, const String &path, const String &contentType = String(), bool download = false);
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len);
+    AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+
+    void *_tempObject;
+    AsyncWebServerResponse *_response;
+  private:
+    String _url;
+    WebRequestMethod _method;
+    size_t _contentLength;
+    std::vector<AsyncWebParameter*> _params;
+    AsyncClient _client;
+    std::function<void(void)> _onDisconnect;
+};
+
+class AsyncWebHandler {
+  public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest *request) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest *request) {}
+    virtual void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {}
+    virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {}
+    virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+  public:
+    AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload = NULL, ArBodyHandlerFunction onBody = NULL)
+      : _uri(uri), _method(method), _onRequest(onRequest), _onUpload(onUpload), _onBody(onBody) {}
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override { if (_onRequest) _onRequest(request); }
+    void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) override { if (_onUpload) _onUpload(request, filename, index, data, len, final); }
+    void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override { if (_onBody) _onBody(request, data, len, index, total); }
+  private:
+    String _uri;
+    WebRequestMethodComposite _method;
+    ArRequestHandlerFunction _onRequest;
+    ArUploadHandlerFunction _onUpload;
+    ArBodyHandlerFunction _onBody;
+};
+
+class AsyncStaticWebHandler : public AsyncWebHandler {
+  public:
+    AsyncStaticWebHandler(const char *uri, fs::FS &fs, const char *path, const char *cache_control) : _fs(fs), _uri(uri), _path(path), _cacheControl(cache_control ? cache_control : "") {}
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    AsyncStaticWebHandler &setCacheControl(const char *cache_control) { _cacheControl = cache_control; return *this; }
+  private:
+    fs::FS &_fs;
+    String _uri;
+    String _path;
+    String _cacheControl;
+};
+
+class AsyncWebServer {
+  public:
+    AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+    void begin();
+    void end();
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+    AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody = NULL);
+    AsyncStaticWebHandler &serveStatic(const char *uri, fs::FS &fs, const char *path, const char *cache_control = NULL);
+    void onNotFound(ArRequestHandlerFunction fn);
+
+    //Host side: run one request through the handlers, optionally with an upload body
+    struct hostResponse {
+      int code;
+      String contentType;
+      String body;
+      std::vector<std::pair<String, String> > headers;
+    };
+    hostResponse request(const String &url, const std::vector<std::pair<String, String> > &params = std::vector<std::pair<String, String> >(),
+      IPAddress remote = IPAddress(127, 0, 0, 1), WebRequestMethod method = HTTP_GET, const std::string &upload = std::string(), size_t uploadChunk = 1024);
+  private:
+    std::vector<AsyncWebHandler*> _handlers;
+    ArRequestHandlerFunction _notFound;
+};
+
+
+#endif // __HOST_ESPASYNCWEBSERVER_H__
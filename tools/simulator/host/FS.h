@@ -0,0 +1,98 @@
+#ifndef __HOST_FS_H__
+#define __HOST_FS_H__
+
+//Host filesystem held in RAM. Enough of fs::FS for the firmware and the simulator
+
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+typedef std::shared_ptr<std::vector<uint8_t> > FileData;
+
+class File : public Stream {
+  public:
+    File() : _position(0) {}
+    File(const String &name, FileData data, size_t position) : _name(name), _data(data), _position(position) {}
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t *buffer, size_t size);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    bool truncate(uint32_t size);
+    void close();
+    const char *name() const;
+    operator bool() const;
+  private:
+    String _name;
+    FileData _data;
+    size_t _position;
+};
+
+class FS;
+
+class Dir {
+  public:
+    Dir(FS *fs, const String &path) : _fs(fs), _path(path), _started(false) {}
+    bool next();
+    String fileName();
+    size_t fileSize();
+    File openFile(const char *mode);
+  private:
+    FS *_fs;
+    String _path;
+    String _current;
+    bool _started;
+};
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+class FS {
+  public:
+    bool begin();
+    void end();
+    bool format();
+    bool info(FSInfo &info);
+    File open(const char *path, const char *mode);
+    File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+    bool mkdir(const char *path);
+    Dir openDir(const char *path);
+    std::map<std::string, FileData> files;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+using fs::Dir;
+using fs::FSInfo;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+
+#endif // __HOST_FS_H__
@@ -0,0 +1,26 @@
+#ifndef __HOST_IPADDRESS_H__
+#define __HOST_IPADDRESS_H__
+
+
+#include <Arduino.h>
+
+class IPAddress {
+  public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint32_t address) : _address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    operator uint32_t() const { return _address; }
+    uint8_t operator[](int index) const { return (_address >> (index * 8)) & 0xFF; }
+    bool operator==(const IPAddress &o) const { return _address == o._address; }
+    bool operator!=(const IPAddress &o) const { return _address != o._address; }
+    String toString() const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+      return String(buf);
+    }
+  private:
+    uint32_t _address;
+};
+
+
+#endif // __HOST_IPADDRESS_H__
@@ -0,0 +1,10 @@
+#ifndef __HOST_LITTLEFS_H__
+#define __HOST_LITTLEFS_H__
+
+
+#include <FS.h>
+
+extern fs::FS LittleFS;
+
+
+#endif // __HOST_LITTLEFS_H__
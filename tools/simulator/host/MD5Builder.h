@@ -0,0 +1,28 @@
+#ifndef __HOST_MD5BUILDER_H__
+#define __HOST_MD5BUILDER_H__
+
+//Host MD5Builder (RFC 1321)
+
+
+#include <Arduino.h>
+
+class MD5Builder {
+  public:
+    void begin();
+    void add(const uint8_t *data, uint16_t len);
+    void add(const char *data) { add((const uint8_t*)data, strlen(data)); }
+    void add(const String &data) { add(data.c_str()); }
+    void calculate();
+    void getBytes(uint8_t *output);
+    void getChars(char *output);
+    String toString();
+  private:
+    void transform(const uint8_t *block);
+    uint32_t _state[4];
+    uint64_t _length;
+    uint8_t _buffer[64];
+    uint8_t _digest[16];
+};
+
+
+#endif // __HOST_MD5BUILDER_H__
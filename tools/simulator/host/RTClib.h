@@ -0,0 +1,27 @@
+#ifndef __HOST_RTCLIB_H__
+#define __HOST_RTCLIB_H__
+
+//Host DS1307. It keeps the simulation's true UTC time
+
+
+#include <Arduino.h>
+
+class DateTime {
+  public:
+    DateTime(uint32_t t = 0);
+    DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t min = 0, uint8_t sec = 0);
+    uint32_t unixtime() const;
+  private:
+    uint32_t _unixtime;
+};
+
+class RTC_DS1307 {
+  public:
+    bool begin();
+    bool isrunning();
+    void adjust(const DateTime &dt);
+    DateTime now();
+};
+
+
+#endif // __HOST_RTCLIB_H__
@@ -0,0 +1,8 @@
+#ifndef __HOST_SOFTWARESERIAL_H__
+#define __HOST_SOFTWARESERIAL_H__
+
+
+#include <Arduino.h>
+
+
+#endif // __HOST_SOFTWARESERIAL_H__
@@ -0,0 +1,58 @@
+#ifndef __HOST_TIMEALARMS_H__
+#define __HOST_TIMEALARMS_H__
+
+//Host port of the TimeAlarms scheduler, including its one-shot and slot limits
+
+
+#include <TimeLib.h>
+
+#define dtNBR_ALARMS 12
+#define dtINVALID_ALARM_ID 255
+#define dtINVALID_TIME (time_t)(-1)
+#define AlarmHMS(_hr_, _min_, _sec_) (_hr_ * SECS_PER_HOUR + _min_ * SECS_PER_MIN + _sec_)
+
+typedef uint8_t AlarmID_t;
+typedef void (*OnTick_t)();
+
+typedef enum {
+  dtNotAllocated,
+  dtTimer,
+  dtExplicitAlarm,
+  dtDailyAlarm,
+  dtWeeklyAlarm,
+  dtLastAlarmType
+} dtAlarmPeriod_t;
+
+class TimeAlarmsClass {
+  public:
+    TimeAlarmsClass();
+    AlarmID_t alarmOnce(const int H, const int M, const int S, OnTick_t onTickHandler);
+    AlarmID_t alarmRepeat(const int H, const int M, const int S, OnTick_t onTickHandler);
+    AlarmID_t timerOnce(time_t value, OnTick_t onTickHandler);
+    AlarmID_t timerRepeat(time_t value, OnTick_t onTickHandler);
+    void delay(unsigned long ms);
+    void enable(AlarmID_t ID);
+    void disable(AlarmID_t ID);
+    void free(AlarmID_t ID);
+    time_t read(AlarmID_t ID);
+    uint8_t count();
+    time_t getNextTrigger();
+    void serviceAlarms();
+  private:
+    struct alarm {
+      OnTick_t onTickHandler;
+      time_t value;
+      time_t nextTrigger;
+      dtAlarmPeriod_t alarmType;
+      bool isOneShot;
+      bool isEnabled;
+    };
+    AlarmID_t create(time_t value, OnTick_t onTickHandler, bool isOneShot, dtAlarmPeriod_t alarmType);
+    void updateNextTrigger(AlarmID_t ID);
+    alarm _alarms[dtNBR_ALARMS];
+    bool _isServicing;
+};
+extern TimeAlarmsClass Alarm;
+
+
+#endif // __HOST_TIMEALARMS_H__
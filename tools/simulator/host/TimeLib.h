@@ -0,0 +1,52 @@
+#ifndef __HOST_TIMELIB_H__
+#define __HOST_TIMELIB_H__
+
+//Host port of the TimeLib calls the firmware uses. The clock runs off the virtual millis()
+
+
+#include <Arduino.h>
+#include <time.h>
+
+typedef enum { timeNotSet, timeNeedsSync, timeSet } timeStatus_t;
+typedef enum { dowInvalid, dowSunday, dowMonday, dowTuesday, dowWednesday, dowThursday, dowFriday, dowSaturday } timeDayOfWeek_t;
+
+typedef struct {
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday;
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year;
+} tmElements_t, TimeElements, *tmElementsPtr_t;
+
+typedef time_t(*getExternalTime)();
+
+#define SECS_PER_MIN ((time_t)(60UL))
+#define SECS_PER_HOUR ((time_t)(3600UL))
+#define SECS_PER_DAY ((time_t)(SECS_PER_HOUR * 24UL))
+#define SECS_PER_WEEK ((time_t)(SECS_PER_DAY * 7UL))
+#define SECS_PER_YEAR ((time_t)(SECS_PER_DAY * 365UL))
+#define previousMidnight(_time_) (((_time_) / SECS_PER_DAY) * SECS_PER_DAY)
+#define nextMidnight(_time_) (previousMidnight(_time_) + SECS_PER_DAY)
+#define elapsedSecsToday(_time_) ((_time_) % SECS_PER_DAY)
+
+time_t now();
+void setTime(time_t t);
+void adjustTime(long adjustment);
+timeStatus_t timeStatus();
+void setSyncProvider(getExternalTime getTimeFunction);
+void setSyncInterval(time_t interval);
+void breakTime(time_t time, tmElements_t &tm);
+time_t makeTime(const tmElements_t &tm);
+
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int day(time_t t);
+int weekday(time_t t);
+int month(time_t t);
+int year(time_t t);
+
+
+#endif // __HOST_TIMELIB_H__
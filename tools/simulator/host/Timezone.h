@@ -0,0 +1,41 @@
+#ifndef __HOST_TIMEZONE_H__
+#define __HOST_TIMEZONE_H__
+
+//Host port of JChristensen's Timezone library
+
+
+#include <TimeLib.h>
+
+enum week_t { Last, First, Second, Third, Fourth };
+enum dow_t { Sun = 1, Mon, Tue, Wed, Thu, Fri, Sat };
+enum month_t { Jan = 1, Feb, Mar, Apr, May, Jun, Jul, Aug, Sep, Oct, Nov, Dec };
+
+struct TimeChangeRule {
+  char abbrev[6];
+  uint8_t week;
+  uint8_t dow;
+  uint8_t month;
+  uint8_t hour;
+  int offset;
+};
+
+class Timezone {
+  public:
+    Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart);
+    time_t toLocal(time_t utc);
+    time_t toUTC(time_t local);
+    bool utcIsDST(time_t utc);
+    bool locIsDST(time_t local);
+  private:
+    void calcTimeChanges(int yr);
+    time_t toTime_t(TimeChangeRule r, int yr);
+    TimeChangeRule m_dst;
+    TimeChangeRule m_std;
+    time_t m_dstUTC;
+    time_t m_stdUTC;
+    time_t m_dstLoc;
+    time_t m_stdLoc;
+};
+
+
+#endif // __HOST_TIMEZONE_H__
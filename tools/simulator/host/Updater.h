@@ -0,0 +1,61 @@
+#ifndef __HOST_UPDATER_H__
+#define __HOST_UPDATER_H__
+
+//Host Updater. Images are staged in the simulated flash in host.h and swapped in by ESP.restart()
+
+
+#include <Arduino.h>
+#include <MD5Builder.h>
+
+#define U_FLASH 0
+#define U_FS 100
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_ERASE 2
+#define UPDATE_ERROR_READ 3
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_STREAM 6
+#define UPDATE_ERROR_MD5 7
+#define UPDATE_ERROR_FLASH_CONFIG 8
+#define UPDATE_ERROR_NEW_FLASH_CONFIG 9
+#define UPDATE_ERROR_MAGIC_BYTE 10
+#define UPDATE_ERROR_BOOTSTRAP 11
+#define UPDATE_ERROR_SIGN 12
+#define UPDATE_ERROR_NO_DATA 13
+
+class UpdaterClass {
+  public:
+    UpdaterClass();
+    bool begin(size_t size, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW);
+    bool setMD5(const char *expected_md5);
+    size_t write(uint8_t *data, size_t len);
+    size_t writeStream(Stream &data);
+    bool end(bool evenIfRemaining = false);
+    void runAsync(bool async) {}
+    void printError(Print &out);
+    String getErrorString();
+    bool hasError() { return _error != UPDATE_ERROR_OK; }
+    uint8_t getError() { return _error; }
+    void clearError() { _error = UPDATE_ERROR_OK; }
+    bool isRunning() { return _size > 0; }
+    bool isFinished() { return _size > 0 && _progress == _size; }
+    size_t size() { return _size; }
+    size_t progress() { return _progress; }
+    size_t remaining() { return _size - _progress; }
+    String md5String() { return _md5.toString(); }
+  private:
+    void reset();
+    uint8_t _error;
+    size_t _size;
+    size_t _progress;
+    int _command;
+    String _target;
+    MD5Builder _md5;
+    std::string _image;
+};
+extern UpdaterClass Update;
+
+
+#endif // __HOST_UPDATER_H__
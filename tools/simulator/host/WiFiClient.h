@@ -0,0 +1,27 @@
+#ifndef __HOST_WIFICLIENT_H__
+#define __HOST_WIFICLIENT_H__
+
+//Host TCP client. Output is collected in memory
+
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class WiFiClient : public Stream {
+  public:
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    uint8_t connected();
+    void stop();
+    int available() override;
+    int read() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    IPAddress remoteIP();
+    operator bool();
+    std::string output;
+};
+
+
+#endif // __HOST_WIFICLIENT_H__
@@ -0,0 +1,39 @@
+#ifndef __HOST_WIFIUDP_H__
+#define __HOST_WIFIUDP_H__
+
+//Host WiFiUDP. Datagrams are injected with host::sendUdp() and replies collected by host::udpReplies()
+
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <string>
+
+class WiFiUDP : public Stream {
+  public:
+    uint8_t begin(uint16_t port);
+    void stop();
+    int parsePacket();
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t len);
+    void flush() override;
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    int beginPacket(IPAddress ip, uint16_t port);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int endPacket();
+  private:
+    uint16_t _port = 0;
+    std::string _packet;
+    size_t _read = 0;
+    IPAddress _remote;
+    uint16_t _remotePort = 0;
+    std::string _reply;
+    IPAddress _replyTo;
+    uint16_t _replyPort = 0;
+};
+
+
+#endif // __HOST_WIFIUDP_H__
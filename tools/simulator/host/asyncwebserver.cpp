@@ -0,0 +1,247 @@
+#include <ESPAsyncWebServer.h>
+
+namespace {
+  const String EMPTY_STRING;
+
+  class AsyncFileResponse : public AsyncWebServerResponse {
+    public:
+      AsyncFileResponse(fs::FS &fs, const String &path, const String &contentType) : AsyncWebServerResponse(200, contentType) {
+        File file = fs.open(path, "r");
+        if (!file) {
+          _code = 404;
+          return;
+        }
+        uint8_t buffer[256];
+        size_t n;
+        while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+          _content.concat((const char*)buffer, n);
+        }
+        file.close();
+      }
+      String body() override { return _content; }
+    private:
+      String _content;
+  };
+}
+
+String AsyncCallbackResponse::body() {
+  String content;
+  uint8_t buffer[1460];
+  size_t n;
+  size_t index = 0;
+  while ((n = _filler(buffer, sizeof(buffer), index)) > 0) {
+    if (n == RESPONSE_TRY_AGAIN) {
+      continue;
+    }
+    content.concat((const char*)buffer, n);
+    index += n;
+  }
+  return content;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(const String &url, WebRequestMethod method, const std::vector<std::pair<String, String> > &params, IPAddress remote)
+  : _tempObject(NULL), _response(NULL), _url(url), _method(method), _contentLength(0), _client(remote) {
+  for (auto &p : params) {
+    _params.push_back(new AsyncWebParameter(p.first, p.second));
+  }
+}
+
+//The client going away is the last thing a request sees
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+  if (_onDisconnect) {
+    _onDisconnect();
+  }
+  for (auto p : _params) {
+    delete p;
+  }
+  delete _response;
+  if (_tempObject != NULL) {
+    ::free(_tempObject);
+  }
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const {
+  return getParam(name, post, file) != NULL;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const {
+  for (auto p : _params) {
+    if (p->name() == name) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(size_t num) const {
+  return num < _params.size() ? _params[num] : NULL;
+}
+
+const String &AsyncWebServerRequest::arg(const String &name) const {
+  AsyncWebParameter *p = getParam(name);
+  return p ? p->value() : EMPTY_STRING;
+}
+
+const String &AsyncWebServerRequest::arg(size_t i) const {
+  return i < _params.size() ? _params[i]->value() : EMPTY_STRING;
+}
+
+const String &AsyncWebServerRequest::argName(size_t i) const {
+  return i < _params.size() ? _params[i]->name() : EMPTY_STRING;
+}
+
+bool AsyncWebServerRequest::hasArg(const char *name) const {
+  return getParam(name) != NULL;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String &name) const {
+  return false;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response) {
+  delete _response;
+  _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content) {
+  send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(fs::FS &fs, const String &path, const String &contentType, bool download) {
+  send(beginResponse(fs, path, contentType, download));
+}
+
+void AsyncWebServerRequest::send_P(int code, const String &contentType, const uint8_t *content, size_t len) {
+  send(beginResponse_P(code, contentType, content, len));
+}
+
+void AsyncWebServerRequest::send_P(int code, const String &contentType, PGM_P content) {
+  send(code, contentType, String(content));
+}
+
+void AsyncWebServerRequest::redirect(const String &url) {
+  AsyncWebServerResponse *response = beginResponse(302);
+  response->addHeader("Location", url);
+  send(response);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content) {
+  return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(fs::FS &fs, const String &path, const String &contentType, bool download) {
+  return new AsyncFileResponse(fs, path, contentType);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len) {
+  String body;
+  body.concat((const char*)content, len);
+  return new AsyncBasicResponse(code, contentType, body);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller callback) {
+  return new AsyncCallbackResponse(contentType, callback);
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) {
+  if (!(_method & request->method())) {
+    return false;
+  }
+  if (_uri.length() && _uri != request->url() && !request->url().startsWith(_uri + "/")) {
+    return false;
+  }
+  return true;
+}
+
+bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request) {
+  if (request->method() != HTTP_GET || !request->url().startsWith(_uri)) {
+    return false;
+  }
+  String path = _path + request->url().substring(_uri.length());
+  return _fs.exists(path);
+}
+
+void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request) {
+  AsyncWebServerResponse *response = request->beginResponse(_fs, _path + request->url().substring(_uri.length()));
+  if (_cacheControl.length()) {
+    response->addHeader("Cache-Control", _cacheControl);
+  }
+  request->send(response);
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port) {
+}
+
+AsyncWebServer::~AsyncWebServer() {
+  for (auto h : _handlers) {
+    delete h;
+  }
+}
+
+void AsyncWebServer::begin() {
+}
+
+void AsyncWebServer::end() {
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler) {
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, ArRequestHandlerFunction onRequest) {
+  return on(uri, HTTP_ANY, onRequest);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest);
+  addHandler(handler);
+  return *handler;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) {
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest, onUpload, onBody);
+  addHandler(handler);
+  return *handler;
+}
+
+AsyncStaticWebHandler &AsyncWebServer::serveStatic(const char *uri, fs::FS &fs, const char *path, const char *cache_control) {
+  AsyncStaticWebHandler *handler = new AsyncStaticWebHandler(uri, fs, path, cache_control);
+  addHandler(handler);
+  return *handler;
+}
+
+void AsyncWebServer::onNotFound(ArRequestHandlerFunction fn) {
+  _notFound = fn;
+}
+
+AsyncWebServer::hostResponse AsyncWebServer::request(const String &url, const std::vector<std::pair<String, String> > &params, IPAddress remote,
+  WebRequestMethod method, const std::string &upload, size_t uploadChunk) {
+  hostResponse result = { 0, String(), String(), std::vector<std::pair<String, String> >() };
+  AsyncWebServerRequest request(url, method, params, remote);
+  AsyncWebHandler *handler = NULL;
+  for (auto h : _handlers) {
+    if (h->canHandle(&request)) {
+      handler = h;
+      break;
+    }
+  }
+  if (handler != NULL) {
+    for (size_t index = 0; index < upload.size(); index += uploadChunk) {
+      size_t len = std::min(uploadChunk, upload.size() - index);
+      handler->handleUpload(&request, "upload.bin", index, (uint8_t*)upload.data() + index, len, index + len == upload.size());
+    }
+    handler->handleRequest(&request);
+  } else if (_notFound) {
+    _notFound(&request);
+  } else {
+    request.send(404);
+  }
+  if (request._response != NULL) {
+    result.code = request._response->_code;
+    result.contentType = request._response->_contentType;
+    result.body = request._response->body();
+    result.headers = request._response->_headers;
+  }
+  return result;
+}
@@ -0,0 +1,199 @@
+#include <host.h>
+#include <Updater.h>
+#include <FS.h>
+#include <LittleFS.h>
+
+UpdaterClass Update;
+
+//Simulated flash: the running sketch at address 0, an image waiting for the boot swap and the
+//last filesystem image written
+namespace {
+  const size_t SKETCH_AREA = 1024 * 1024;
+  const size_t SECTOR = 4096;
+
+  std::string sketchImage(256 * 1024, '\xE9');
+  std::string stagedImage;
+  int stagedCommand = -1;
+  std::string filesystemImage;
+}
+
+namespace host {
+  void setSketch(const std::string &pImage) {
+    sketchImage = pImage;
+  }
+
+  const std::string &sketch() {
+    return sketchImage;
+  }
+
+  const std::string &filesystem() {
+    return filesystemImage;
+  }
+
+  bool swapPending() {
+    return stagedCommand >= 0;
+  }
+
+  //What the boot loader does with a verified image
+  void bootSwap() {
+    if (stagedCommand == U_FLASH) {
+      sketchImage = stagedImage;
+    }
+    if (stagedCommand == U_FS) {
+      filesystemImage = stagedImage;
+      LittleFS.format();
+    }
+    stagedImage.clear();
+    stagedCommand = -1;
+  }
+}
+
+uint32_t EspClass::getSketchSize() {
+  return sketchImage.size();
+}
+
+String EspClass::getSketchMD5() {
+  MD5Builder md5;
+  md5.begin();
+  for (size_t i = 0; i < sketchImage.size(); i += SECTOR) {
+    md5.add((const uint8_t*)sketchImage.data() + i, std::min(SECTOR, sketchImage.size() - i));
+  }
+  md5.calculate();
+  return md5.toString();
+}
+
+uint32_t EspClass::getFreeSketchSpace() {
+  return SKETCH_AREA - (sketchImage.size() + SECTOR - 1) / SECTOR * SECTOR;
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t *data, size_t size) {
+  if (address % 4 != 0 || size % 4 != 0) {
+    return false;
+  }
+  memset(data, 0xFF, size);
+  if (address < sketchImage.size()) {
+    memcpy(data, sketchImage.data() + address, std::min(size, sketchImage.size() - address));
+  }
+  return true;
+}
+
+UpdaterClass::UpdaterClass() {
+  reset();
+}
+
+void UpdaterClass::reset() {
+  _size = 0;
+  _progress = 0;
+  _command = U_FLASH;
+  _target = String();
+  _image.clear();
+}
+
+bool UpdaterClass::begin(size_t size, int command, int ledPin, uint8_t ledOn) {
+  if (_size > 0) {
+    _error = UPDATE_ERROR_BOOTSTRAP;
+    return false;
+  }
+  _error = UPDATE_ERROR_OK;
+  if (size == 0) {
+    _error = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  if (command == U_FLASH && size > ESP.getFreeSketchSpace()) {
+    _error = UPDATE_ERROR_SPACE;
+    return false;
+  }
+  _size = size;
+  _command = command;
+  _md5.begin();
+  return true;
+}
+
+bool UpdaterClass::setMD5(const char *expected_md5) {
+  if (strlen(expected_md5) != 32) {
+    return false;
+  }
+  _target = expected_md5;
+  _target.toLowerCase();
+  return true;
+}
+
+size_t UpdaterClass::write(uint8_t *data, size_t len) {
+  if (hasError() || !isRunning()) {
+    return 0;
+  }
+  if (len > remaining()) {
+    _error = UPDATE_ERROR_SPACE;
+    return 0;
+  }
+  //A firmware image must start with the ESP8266 image magic byte
+  if (_progress == 0 && _command == U_FLASH && len > 0 && data[0] != 0xE9) {
+    _error = UPDATE_ERROR_MAGIC_BYTE;
+    reset();
+    return 0;
+  }
+  _image.append((const char*)data, len);
+  _md5.add(data, len);
+  _progress += len;
+  return len;
+}
+
+size_t UpdaterClass::writeStream(Stream &data) {
+  uint8_t buffer[SECTOR];
+  size_t written = 0;
+  size_t n;
+  while ((n = data.readBytes(buffer, sizeof(buffer))) > 0) {
+    if (write(buffer, n) != n) {
+      break;
+    }
+    written += n;
+  }
+  return written;
+}
+
+//Only a complete, matching image is staged for the boot swap
+bool UpdaterClass::end(bool evenIfRemaining) {
+  if (!isRunning()) {
+    return false;
+  }
+  if (hasError() || (!isFinished() && !evenIfRemaining)) {
+    if (!hasError()) {
+      _error = UPDATE_ERROR_STREAM;
+    }
+    reset();
+    return false;
+  }
+  if (_progress == 0) {
+    _error = UPDATE_ERROR_NO_DATA;
+    reset();
+    return false;
+  }
+  _md5.calculate();
+  if (_target.length() > 0 && _target != _md5.toString()) {
+    _error = UPDATE_ERROR_MD5;
+    reset();
+    return false;
+  }
+  stagedImage = _image;
+  stagedCommand = _command;
+  reset();
+  return true;
+}
+
+String UpdaterClass::getErrorString() {
+  switch (_error) {
+    case UPDATE_ERROR_OK: return "No Error";
+    case UPDATE_ERROR_SPACE: return "Not Enough Space";
+    case UPDATE_ERROR_SIZE: return "Bad Size Given";
+    case UPDATE_ERROR_STREAM: return "Stream Read Timeout";
+    case UPDATE_ERROR_MD5: return "MD5 Check Failed";
+    case UPDATE_ERROR_MAGIC_BYTE: return "Magic byte is wrong, not 0xE9";
+    case UPDATE_ERROR_BOOTSTRAP: return "Invalid bootstrapping state, reset ESP8266 before updating";
+    case UPDATE_ERROR_NO_DATA: return "No data supplied";
+    default: return "UNKNOWN";
+  }
+}
+
+void UpdaterClass::printError(Print &out) {
+  out.println(getErrorString());
+}
@@ -0,0 +1,182 @@
+#include <FS.h>
+#include <LittleFS.h>
+
+fs::FS LittleFS;
+
+namespace fs {
+
+int File::available() {
+  return _data ? (int)(_data->size() - _position) : 0;
+}
+
+int File::read() {
+  if (!_data || _position >= _data->size()) {
+    return -1;
+  }
+  return (*_data)[_position++];
+}
+
+int File::peek() {
+  if (!_data || _position >= _data->size()) {
+    return -1;
+  }
+  return (*_data)[_position];
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!_data || _position >= _data->size()) {
+    return 0;
+  }
+  size_t n = std::min(size, _data->size() - _position);
+  memcpy(buffer, _data->data() + _position, n);
+  _position += n;
+  return n;
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!_data) {
+    return 0;
+  }
+  if (_position + size > _data->size()) {
+    _data->resize(_position + size);
+  }
+  memcpy(_data->data() + _position, buffer, size);
+  _position += size;
+  return size;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!_data) {
+    return false;
+  }
+  size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? _position : _data->size());
+  if (base + pos > _data->size()) {
+    return false;
+  }
+  _position = base + pos;
+  return true;
+}
+
+size_t File::position() const {
+  return _position;
+}
+
+size_t File::size() const {
+  return _data ? _data->size() : 0;
+}
+
+bool File::truncate(uint32_t size) {
+  if (!_data) {
+    return false;
+  }
+  _data->resize(size);
+  return true;
+}
+
+void File::close() {
+  _data.reset();
+}
+
+const char *File::name() const {
+  return _name.c_str();
+}
+
+File::operator bool() const {
+  return (bool)_data;
+}
+
+bool Dir::next() {
+  auto it = _started ? _fs->files.upper_bound(_current.str()) : _fs->files.lower_bound(_path.str());
+  _started = true;
+  if (it == _fs->files.end() || it->first.compare(0, _path.length(), _path.c_str()) != 0) {
+    _current = "";
+    return false;
+  }
+  _current = it->first;
+  return true;
+}
+
+String Dir::fileName() {
+  return _current.substring(_path.length());
+}
+
+size_t Dir::fileSize() {
+  auto it = _fs->files.find(_current.str());
+  return it == _fs->files.end() ? 0 : it->second->size();
+}
+
+File Dir::openFile(const char *mode) {
+  return _fs->open(_current, mode);
+}
+
+bool FS::begin() {
+  return true;
+}
+
+void FS::end() {
+}
+
+bool FS::format() {
+  files.clear();
+  return true;
+}
+
+bool FS::info(FSInfo &info) {
+  info.totalBytes = 1024 * 1024;
+  info.usedBytes = 0;
+  for (auto &file : files) {
+    info.usedBytes += file.second->size();
+  }
+  info.blockSize = 8192;
+  info.pageSize = 256;
+  info.maxOpenFiles = 5;
+  info.maxPathLength = 32;
+  return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+  auto it = files.find(path);
+  if (mode[0] == 'r' && mode[1] != '+') {
+    if (it == files.end()) {
+      return File();
+    }
+    return File(path, it->second, 0);
+  }
+  if (it == files.end() || mode[0] == 'w') {
+    files[path] = FileData(new std::vector<uint8_t>());
+    it = files.find(path);
+  }
+  return File(path, it->second, mode[0] == 'a' ? it->second->size() : 0);
+}
+
+bool FS::exists(const char *path) {
+  return files.count(path) > 0;
+}
+
+bool FS::remove(const char *path) {
+  return files.erase(path) > 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo) {
+  auto it = files.find(pathFrom);
+  if (it == files.end()) {
+    return false;
+  }
+  files[pathTo] = it->second;
+  files.erase(pathFrom);
+  return true;
+}
+
+bool FS::mkdir(const char *path) {
+  return true;
+}
+
+Dir FS::openDir(const char *path) {
+  return Dir(this, path);
+}
+
+}
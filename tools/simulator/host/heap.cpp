@@ -0,0 +1,58 @@
+#include <HeapProfiler.h>
+#include <new>
+#include <stdlib.h>
+
+//Stands in for the firmware's malloc wrappers: everything String and the fakes allocate goes
+//through here and is counted the same way
+
+namespace {
+  void *allocate(size_t pSize) {
+    void *allocated = malloc(pSize > 0 ? pSize : 1);
+    heapCountAlloc(pSize, allocated != NULL);
+    if (allocated == NULL) {
+      throw std::bad_alloc();
+    }
+    return allocated;
+  }
+
+  void release(void *pPointer) {
+    if (pPointer != NULL) {
+      heapCountFree();
+      free(pPointer);
+    }
+  }
+}
+
+void *operator new(size_t pSize) {
+  return allocate(pSize);
+}
+
+void *operator new[](size_t pSize) {
+  return allocate(pSize);
+}
+
+void *operator new(size_t pSize, const std::nothrow_t &) noexcept {
+  void *allocated = malloc(pSize > 0 ? pSize : 1);
+  heapCountAlloc(pSize, allocated != NULL);
+  return allocated;
+}
+
+void *operator new[](size_t pSize, const std::nothrow_t &pTag) noexcept {
+  return operator new(pSize, pTag);
+}
+
+void operator delete(void *pPointer) noexcept {
+  release(pPointer);
+}
+
+void operator delete[](void *pPointer) noexcept {
+  release(pPointer);
+}
+
+void operator delete(void *pPointer, size_t) noexcept {
+  release(pPointer);
+}
+
+void operator delete[](void *pPointer, size_t) noexcept {
+  release(pPointer);
+}
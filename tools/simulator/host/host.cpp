@@ -0,0 +1,482 @@
+#include <host.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <deque>
+#include <EEPROM.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+
+namespace {
+  const uint64_t YIELD_MICROS = 100;
+
+  uint64_t clockMicros = 0;
+  int32_t oscillatorPPM = 0;
+  uint32_t rtcReadCount = 0;
+  uint32_t yieldCount = 0;
+  time_t utcBase = 0;
+  uint64_t utcBaseMicros = 0;
+
+  uint8_t pinLevel[32];
+  uint8_t motorPin1 = 255;
+  uint8_t motorPin2 = 255;
+  uint8_t openPin = 255;
+  uint8_t closedPin = 255;
+  uint8_t overridePin = 255;
+  unsigned long doorTravel = 8000;
+  double doorPosition = 0;
+  bool overridePressed = false;
+  int motorWas = 0;
+  uint64_t motorStoppedMicros = 0;
+  uint64_t motorShortestRest = UINT64_MAX;
+
+  std::deque<uint8_t> serialBuffer;
+  std::string serialWritten;
+  //The UART's transmit FIFO, which empties at the baud rate. Writing to a full one waits
+  const int SERIAL_FIFO = 128;
+  uint64_t serialByteMicros = 10000000 / 115200;
+  uint64_t serialIdleAt = 0;
+  rst_info resetInfo = { 0 };
+  uint32_t restartCount = 0;
+  uint32_t heapFree = 40000;
+  uint32_t heapLargest = 30000;
+  uint8_t heapFragmentation = 0;
+}
+
+namespace host {
+  uint64_t clockMicros() {
+    return ::clockMicros;
+  }
+
+  //Move time forward, letting the door travel while the motor is driven
+  void advance(uint64_t pMicros) {
+    int direction = motorDirection();
+    if (direction != 0) {
+      ::doorPosition += direction * (pMicros / 1000.0);
+      if (::doorPosition < 0) {
+        ::doorPosition = 0;
+      }
+      if (::doorPosition > ::doorTravel) {
+        ::doorPosition = ::doorTravel;
+      }
+    }
+    ::clockMicros += pMicros;
+    pumpMqtt();
+  }
+
+  //The ESP's crystal runs pPPM parts per million fast against true time
+  void setOscillatorDrift(int32_t pPPM) {
+    oscillatorPPM = pPPM;
+  }
+
+  uint64_t espMicros() {
+    return ::clockMicros + (int64_t)::clockMicros * oscillatorPPM / 1000000;
+  }
+
+  //True time that passes while the ESP counts pMicros
+  uint64_t trueMicros(uint64_t pMicros) {
+    return pMicros * 1000000 / (1000000 + oscillatorPPM);
+  }
+
+  void countRTCRead() {
+    rtcReadCount++;
+  }
+
+  uint32_t rtcReads() {
+    return rtcReadCount;
+  }
+
+  uint32_t yields() {
+    return yieldCount;
+  }
+
+  void setUTC(time_t pUTC) {
+    utcBase = pUTC;
+    utcBaseMicros = ::clockMicros;
+  }
+
+  time_t utc() {
+    return utcBase + (time_t)((::clockMicros - utcBaseMicros) / 1000000);
+  }
+
+  //True UTC including the fraction of a second the RTC cannot show
+  double utcSeconds() {
+    return utcBase + (::clockMicros - utcBaseMicros) / 1000000.0;
+  }
+
+  void attachDoor(uint8_t pMotorPin1, uint8_t pMotorPin2, uint8_t pOpenPin, uint8_t pClosedPin, uint8_t pOverridePin) {
+    motorPin1 = pMotorPin1;
+    motorPin2 = pMotorPin2;
+    openPin = pOpenPin;
+    closedPin = pClosedPin;
+    overridePin = pOverridePin;
+  }
+
+  void setDoorTravel(unsigned long pMillis) {
+    ::doorTravel = pMillis;
+  }
+
+  void setDoorPosition(unsigned long pMillis) {
+    ::doorPosition = pMillis;
+  }
+
+  unsigned long doorPosition() {
+    return (unsigned long)::doorPosition;
+  }
+
+  unsigned long doorTravel() {
+    return ::doorTravel;
+  }
+
+  //motorForward() opens, motorReverse() closes
+  int motorDirection() {
+    if (motorPin1 > 31 || motorPin2 > 31) {
+      return 0;
+    }
+    if (pinLevel[motorPin1] == LOW && pinLevel[motorPin2] == HIGH) {
+      return 1;
+    }
+    if (pinLevel[motorPin1] == HIGH && pinLevel[motorPin2] == LOW) {
+      return -1;
+    }
+    return 0;
+  }
+
+  uint64_t shortestMotorRest() {
+    return motorShortestRest;
+  }
+
+  void clearMotorRest() {
+    motorShortestRest = UINT64_MAX;
+  }
+
+  void setOverridePressed(bool pPressed) {
+    overridePressed = pPressed;
+  }
+
+  void serialInput(const char *pText) {
+    while (*pText) {
+      serialBuffer.push_back(*pText++);
+    }
+  }
+
+  const std::string &serialOutput() {
+    return serialWritten;
+  }
+
+  void clearSerialOutput() {
+    serialWritten.clear();
+  }
+
+  uint32_t restarts() {
+    return restartCount;
+  }
+
+  void setHeap(uint32_t pFree, uint32_t pLargest, uint8_t pFragmentation) {
+    heapFree = pFree;
+    heapLargest = pLargest;
+    heapFragmentation = pFragmentation;
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < 32 && mode == INPUT_PULLUP) {
+    pinLevel[pin] = HIGH;
+  }
+}
+
+//A motor start is timed from the last stop. Going straight from one direction to the other is no rest at all
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < 32) {
+    pinLevel[pin] = val;
+  }
+  if (pin != motorPin1 && pin != motorPin2) {
+    return;
+  }
+  int direction = host::motorDirection();
+  if (direction == motorWas) {
+    return;
+  }
+  if (direction == 0) {
+    motorStoppedMicros = clockMicros;
+  } else {
+    uint64_t rest = motorWas != 0 ? 0 : clockMicros - motorStoppedMicros;
+    motorShortestRest = std::min(motorShortestRest, rest);
+  }
+  motorWas = direction;
+}
+
+//Switches pull to ground when made
+int digitalRead(uint8_t pin) {
+  if (pin == openPin) {
+    return doorPosition >= doorTravel ? LOW : HIGH;
+  }
+  if (pin == closedPin) {
+    return doorPosition <= 0 ? LOW : HIGH;
+  }
+  if (pin == overridePin) {
+    return overridePressed ? LOW : HIGH;
+  }
+  return pin < 32 ? pinLevel[pin] : LOW;
+}
+
+//GPIO input registers, built from the pin levels
+uint32_t hostGPI() {
+  uint32_t levels = 0;
+  for (uint8_t pin = 0; pin < 16; pin++) {
+    levels |= (uint32_t)digitalRead(pin) << pin;
+  }
+  return levels;
+}
+
+uint32_t hostGP16I() {
+  return digitalRead(16);
+}
+
+unsigned long millis() {
+  return (unsigned long)(host::espMicros() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)host::espMicros();
+}
+
+void delay(unsigned long ms) {
+  host::advance(host::trueMicros((uint64_t)ms * 1000));
+}
+
+void delayMicroseconds(unsigned int us) {
+  host::advance(host::trueMicros(us));
+}
+
+//Busy-wait loops such as Alarm.delay(0) spin on millis(), so each yield costs a little virtual time
+void yield() {
+  yieldCount++;
+  host::advance(YIELD_MICROS);
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  return write((const uint8_t*)buffer, std::min((size_t)n, sizeof(buffer) - 1));
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  serialByteMicros = 10000000 / baud;
+}
+
+int HardwareSerial::available() {
+  return serialBuffer.size();
+}
+
+int HardwareSerial::read() {
+  if (serialBuffer.empty()) {
+    return -1;
+  }
+  int c = serialBuffer.front();
+  serialBuffer.pop_front();
+  return c;
+}
+
+int HardwareSerial::peek() {
+  return serialBuffer.empty() ? -1 : serialBuffer.front();
+}
+
+int HardwareSerial::availableForWrite() {
+  uint64_t now = host::clockMicros();
+  if (serialIdleAt <= now) {
+    return SERIAL_FIFO;
+  }
+  return SERIAL_FIFO - (int)((serialIdleAt - now + serialByteMicros - 1) / serialByteMicros);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (availableForWrite() == 0) {
+    host::advance(serialIdleAt - host::clockMicros() - (SERIAL_FIFO - 1) * serialByteMicros);
+  }
+  serialIdleAt = std::max(serialIdleAt, host::clockMicros()) + serialByteMicros;
+  serialWritten.push_back(c);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+void EspClass::restart() {
+  restartCount++;
+  host::bootSwap();
+  throw host::Restart();
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return heapFree;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  return heapLargest;
+}
+
+uint8_t EspClass::getHeapFragmentation() {
+  return heapFragmentation;
+}
+
+uint32_t EspClass::getChipId() {
+  return 0xC00C;
+}
+
+//Repeatable stand-in for the hardware RNG
+uint32_t EspClass::random() {
+  static uint32_t state = 0x2545F491;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(clockMicros * 80);
+}
+
+rst_info *EspClass::getResetInfoPtr() {
+  return &resetInfo;
+}
+
+String EspClass::getResetReason() {
+  return String("Power on");
+}
+
+void EEPROMClass::begin(size_t size) {
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return _data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  _data[address] = value;
+}
+
+bool EEPROMClass::commit() {
+  _commits++;
+  return true;
+}
+
+uint32_t EEPROMClass::commits() {
+  return _commits;
+}
+
+uint8_t *EEPROMClass::getDataPtr() {
+  return _data;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t m) {
+  _mode = m;
+  return true;
+}
+
+WiFiMode_t ESP8266WiFiClass::getMode() {
+  return _mode;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase) {
+  return WL_CONNECTED;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff) {
+  return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char *ssid, const char *passphrase) {
+  return true;
+}
+
+bool ESP8266WiFiClass::softAPdisconnect(bool wifioff) {
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+  return WL_CONNECTED;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+  return IPAddress(127, 0, 0, 1);
+}
+
+IPAddress ESP8266WiFiClass::softAPIP() {
+  return IPAddress(192, 168, 4, 1);
+}
+
+int32_t ESP8266WiFiClass::RSSI() {
+  return -60;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return 0;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  return 0;
+}
+
+uint8_t WiFiClient::connected() {
+  return 1;
+}
+
+void WiFiClient::stop() {
+}
+
+int WiFiClient::available() {
+  return 0;
+}
+
+int WiFiClient::read() {
+  return -1;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+  output.push_back(c);
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  output.append((const char*)buffer, size);
+  return size;
+}
+
+IPAddress WiFiClient::remoteIP() {
+  return IPAddress(127, 0, 0, 1);
+}
+
+WiFiClient::operator bool() {
+  return true;
+}
+
+bool MDNSResponder::begin(const char *hostname) {
+  return true;
+}
+
+bool MDNSResponder::addService(const char *service, const char *proto, uint16_t port) {
+  return true;
+}
+
+bool MDNSResponder::addServiceTxt(const char *service, const char *proto, const char *key, const char *value) {
+  return true;
+}
+
+void MDNSResponder::update() {
+}
@@ -0,0 +1,90 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+//Virtual clock and hardware shared by the host tools. Nothing here exists on the ESP8266
+
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+namespace host {
+  //Virtual clock. The RTC holds true UTC, millis() counts from power on on the ESP's own crystal
+  uint64_t clockMicros();
+  void advance(uint64_t pMicros);
+  void setOscillatorDrift(int32_t pPPM);
+  uint64_t espMicros();
+  uint64_t trueMicros(uint64_t pMicros);
+  void setUTC(time_t pUTC);
+  time_t utc();
+  double utcSeconds();
+  void countRTCRead();
+  uint32_t rtcReads();
+  //Calls to yield(), each of which feeds the ESP's watchdog
+  uint32_t yields();
+
+  //Door rig: motor H-bridge inputs, limit switches and the override button
+  void attachDoor(uint8_t pMotorPin1, uint8_t pMotorPin2, uint8_t pOpenPin, uint8_t pClosedPin, uint8_t pOverridePin);
+  void setDoorTravel(unsigned long pMillis);
+  void setDoorPosition(unsigned long pMillis);
+  unsigned long doorPosition();
+  unsigned long doorTravel();
+  int motorDirection();
+  //Shortest true time between the motor stopping and starting again, since clearMotorRest()
+  uint64_t shortestMotorRest();
+  void clearMotorRest();
+  void setOverridePressed(bool pPressed);
+
+  //Serial console. What the sketch writes is kept until cleared rather than printed
+  void serialInput(const char *pText);
+  const std::string &serialOutput();
+  void clearSerialOutput();
+
+  //Simulated flash. ESP.restart() runs the boot swap for an image the Updater verified
+  void setSketch(const std::string &pImage);
+  const std::string &sketch();
+  const std::string &filesystem();
+  bool swapPending();
+  void bootSwap();
+
+  //MQTT broker for AsyncMqttClient. Publishes wait for an ack while acks are held, and at most
+  //MQTT_IN_FLIGHT may wait before publish() reports no room, like a full TCP window
+  struct mqttMessage {
+    std::string topic;
+    std::string payload;
+    uint8_t qos;
+    bool retain;
+  };
+  const size_t MQTT_IN_FLIGHT = 4;
+  void setBrokerUp(bool pUp);
+  void holdMqttAcks(bool pHold);
+  const std::vector<mqttMessage> &mqttMessages();
+  std::string mqttRetained(const std::string &pTopic);
+  uint32_t mqttConnects();
+  void clearMqttMessages();
+  void pumpMqtt();
+
+  //UDP. A datagram is from ip:fromPort to our port; a reply is from our port to ip:port
+  struct udpDatagram {
+    IPAddress ip;
+    uint16_t fromPort;
+    uint16_t port;
+    std::string data;
+  };
+  void sendUdp(IPAddress pFrom, uint16_t pFromPort, uint16_t pToPort, const std::string &pData);
+  const std::vector<udpDatagram> &udpReplies();
+  void clearUdpReplies();
+
+  //ESP.restart() does not return; it throws this for the simulator to reboot from
+  struct Restart {};
+  uint32_t restarts();
+
+  //What ESP.getFreeHeap(), getMaxFreeBlockSize() and getHeapFragmentation() report. Allocations are
+  //counted for HeapProfiler by the global operator new, which is all String uses here
+  void setHeap(uint32_t pFree, uint32_t pLargest, uint8_t pFragmentation);
+}
+
+
+#endif // __HOST_H__
@@ -0,0 +1,179 @@
+#include <AsyncMqttClient.h>
+#include <host.h>
+#include <algorithm>
+#include <map>
+
+namespace {
+  bool brokerUp = false;
+  bool holdAcks = false;
+  uint32_t connects = 0;
+  std::vector<host::mqttMessage> messages;
+  std::map<std::string, std::string> retained;
+
+  //Clients are globals in the sketch, so the registry must exist before any other translation unit's statics
+  std::vector<AsyncMqttClient*> &clients() {
+    static std::vector<AsyncMqttClient*> registry;
+    return registry;
+  }
+
+  void keep(const std::string &pTopic, const std::string &pPayload) {
+    if (pPayload.empty()) {
+      retained.erase(pTopic);
+    } else {
+      retained[pTopic] = pPayload;
+    }
+  }
+}
+
+namespace host {
+  void setBrokerUp(bool pUp) {
+    brokerUp = pUp;
+  }
+
+  void holdMqttAcks(bool pHold) {
+    holdAcks = pHold;
+  }
+
+  const std::vector<mqttMessage> &mqttMessages() {
+    return messages;
+  }
+
+  std::string mqttRetained(const std::string &pTopic) {
+    auto found = retained.find(pTopic);
+    return found == retained.end() ? std::string() : found->second;
+  }
+
+  uint32_t mqttConnects() {
+    return connects;
+  }
+
+  void clearMqttMessages() {
+    messages.clear();
+  }
+
+  void pumpMqtt() {
+    for (AsyncMqttClient *client : clients()) {
+      client->pump();
+    }
+  }
+}
+
+AsyncMqttClient::AsyncMqttClient() {
+  _port = 1883;
+  _connecting = false;
+  _connected = false;
+  _closing = false;
+  _nextId = 0;
+  clients().push_back(this);
+}
+
+AsyncMqttClient::~AsyncMqttClient() {
+  clients().erase(std::remove(clients().begin(), clients().end(), this), clients().end());
+}
+
+AsyncMqttClient &AsyncMqttClient::setServer(const char *host, uint16_t port) {
+  _host = host;
+  _port = port;
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setClientId(const char *clientId) {
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setKeepAlive(uint16_t keepAlive) {
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setWill(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length) {
+  _willTopic = topic;
+  _willPayload = payload != nullptr ? payload : "";
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onConnect(AsyncMqttClientInternals_OnConnectUserCallback callback) {
+  _onConnect = callback;
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onDisconnect(AsyncMqttClientInternals_OnDisconnectUserCallback callback) {
+  _onDisconnect = callback;
+  return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onPublish(AsyncMqttClientInternals_OnPublishUserCallback callback) {
+  _onPublish = callback;
+  return *this;
+}
+
+bool AsyncMqttClient::connected() const {
+  return _connected;
+}
+
+void AsyncMqttClient::connect() {
+  if (!_connected) {
+    _connecting = true;
+  }
+}
+
+void AsyncMqttClient::disconnect(bool force) {
+  if (_connected) {
+    _closing = true;
+  }
+}
+
+uint16_t AsyncMqttClient::publish(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length, bool dup, uint16_t message_id) {
+  if (!_connected || (qos > 0 && _inFlight.size() >= host::MQTT_IN_FLIGHT)) {
+    return 0;
+  }
+  std::string body = payload == nullptr ? std::string() : std::string(payload, length > 0 ? length : strlen(payload));
+  messages.push_back({ topic, body, qos, retain });
+  if (retain) {
+    keep(topic, body);
+  }
+  if (qos == 0) {
+    return 1;
+  }
+  _nextId = _nextId == 0xFFFF ? 1 : _nextId + 1;
+  _inFlight.push_back(_nextId);
+  return _nextId;
+}
+
+//Deliver what the network would have by now
+void AsyncMqttClient::pump() {
+  if (_connecting) {
+    _connecting = false;
+    if (brokerUp && _host.length() > 0) {
+      _connected = true;
+      connects++;
+      if (_onConnect) {
+        _onConnect(false);
+      }
+    } else if (_onDisconnect) {
+      _onDisconnect(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+    return;
+  }
+  if (_connected && (!brokerUp || _closing)) {
+    //The broker publishes the will when the connection is lost, not on a clean disconnect
+    if (!_closing && _willTopic.length() > 0) {
+      keep(_willTopic.c_str(), _willPayload.c_str());
+    }
+    _connected = false;
+    _closing = false;
+    _inFlight.clear();
+    if (_onDisconnect) {
+      _onDisconnect(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+    return;
+  }
+  if (_connected && !holdAcks) {
+    std::vector<uint16_t> acked;
+    acked.swap(_inFlight);
+    for (uint16_t id : acked) {
+      if (_onPublish) {
+        _onPublish(id);
+      }
+    }
+  }
+}
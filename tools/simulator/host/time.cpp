@@ -0,0 +1,447 @@
+#include <host.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+#include <TimeAlarms.h>
+#include <RTClib.h>
+
+TimeAlarmsClass Alarm;
+
+//TimeLib: system time counts seconds off millis() and resyncs from the provider
+namespace {
+  uint32_t sysTime = 0;
+  unsigned long prevMillis = 0;
+  uint32_t nextSyncTime = 0;
+  timeStatus_t status = timeNotSet;
+  getExternalTime getTimePtr = NULL;
+  uint32_t syncInterval = 300;
+
+  const uint8_t monthDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+  bool leapYear(int y) {
+    y += 1970;
+    return y > 0 && !(y % 4) && ((y % 100) || !(y % 400));
+  }
+}
+
+time_t now() {
+  while (millis() - prevMillis >= 1000) {
+    sysTime++;
+    prevMillis += 1000;
+  }
+  if (nextSyncTime <= sysTime) {
+    if (getTimePtr != NULL) {
+      time_t t = getTimePtr();
+      if (t != 0) {
+        setTime(t);
+      } else {
+        nextSyncTime = sysTime + syncInterval;
+        status = (status == timeNotSet) ? timeNotSet : timeNeedsSync;
+      }
+    }
+  }
+  return (time_t)sysTime;
+}
+
+void setTime(time_t t) {
+  sysTime = (uint32_t)t;
+  nextSyncTime = (uint32_t)t + syncInterval;
+  status = timeSet;
+  prevMillis = millis();
+}
+
+void adjustTime(long adjustment) {
+  sysTime += adjustment;
+}
+
+timeStatus_t timeStatus() {
+  now();
+  return status;
+}
+
+void setSyncProvider(getExternalTime getTimeFunction) {
+  getTimePtr = getTimeFunction;
+  nextSyncTime = sysTime;
+  now();
+}
+
+void setSyncInterval(time_t interval) {
+  syncInterval = (uint32_t)interval;
+  nextSyncTime = sysTime + syncInterval;
+}
+
+void breakTime(time_t timeInput, tmElements_t &tm) {
+  uint8_t year;
+  uint8_t month;
+  uint8_t monthLength;
+  uint32_t time = (uint32_t)timeInput;
+  unsigned long days;
+
+  tm.Second = time % 60;
+  time /= 60;
+  tm.Minute = time % 60;
+  time /= 60;
+  tm.Hour = time % 24;
+  time /= 24;
+  tm.Wday = ((time + 4) % 7) + 1;
+
+  year = 0;
+  days = 0;
+  while ((unsigned)(days += (leapYear(year) ? 366 : 365)) <= time) {
+    year++;
+  }
+  tm.Year = year;
+  days -= leapYear(year) ? 366 : 365;
+  time -= days;
+
+  days = 0;
+  month = 0;
+  monthLength = 0;
+  for (month = 0; month < 12; month++) {
+    if (month == 1) {
+      monthLength = leapYear(year) ? 29 : 28;
+    } else {
+      monthLength = monthDays[month];
+    }
+    if (time >= monthLength) {
+      time -= monthLength;
+    } else {
+      break;
+    }
+  }
+  tm.Month = month + 1;
+  tm.Day = time + 1;
+}
+
+time_t makeTime(const tmElements_t &tm) {
+  int i;
+  uint32_t seconds;
+
+  seconds = tm.Year * (SECS_PER_DAY * 365);
+  for (i = 0; i < tm.Year; i++) {
+    if (leapYear(i)) {
+      seconds += SECS_PER_DAY;
+    }
+  }
+  for (i = 1; i < tm.Month; i++) {
+    if (i == 2 && leapYear(tm.Year)) {
+      seconds += SECS_PER_DAY * 29;
+    } else {
+      seconds += SECS_PER_DAY * monthDays[i - 1];
+    }
+  }
+  seconds += (tm.Day - 1) * SECS_PER_DAY;
+  seconds += tm.Hour * SECS_PER_HOUR;
+  seconds += tm.Minute * SECS_PER_MIN;
+  seconds += tm.Second;
+  return (time_t)seconds;
+}
+
+int hour(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Hour;
+}
+
+int minute(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Minute;
+}
+
+int second(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Second;
+}
+
+int day(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Day;
+}
+
+int weekday(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Wday;
+}
+
+int month(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Month;
+}
+
+int year(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm.Year + 1970;
+}
+
+//Timezone
+Timezone::Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart) {
+  m_dst = dstStart;
+  m_std = stdStart;
+  m_dstUTC = 0;
+  m_stdUTC = 0;
+  m_dstLoc = 0;
+  m_stdLoc = 0;
+}
+
+time_t Timezone::toLocal(time_t utc) {
+  if (year(utc) != year(m_dstUTC)) {
+    calcTimeChanges(year(utc));
+  }
+  if (utcIsDST(utc)) {
+    return utc + m_dst.offset * SECS_PER_MIN;
+  }
+  return utc + m_std.offset * SECS_PER_MIN;
+}
+
+time_t Timezone::toUTC(time_t local) {
+  if (year(local) != year(m_dstLoc)) {
+    calcTimeChanges(year(local));
+  }
+  if (locIsDST(local)) {
+    return local - m_dst.offset * SECS_PER_MIN;
+  }
+  return local - m_std.offset * SECS_PER_MIN;
+}
+
+bool Timezone::utcIsDST(time_t utc) {
+  if (m_dst.offset == m_std.offset) {
+    return false;
+  }
+  if (year(utc) != year(m_dstUTC)) {
+    calcTimeChanges(year(utc));
+  }
+  if (m_stdUTC == m_dstUTC) {
+    return false;
+  }
+  if (m_stdUTC > m_dstUTC) {
+    return utc >= m_dstUTC && utc < m_stdUTC;
+  }
+  return !(utc >= m_stdUTC && utc < m_dstUTC);
+}
+
+bool Timezone::locIsDST(time_t local) {
+  if (m_dst.offset == m_std.offset) {
+    return false;
+  }
+  if (year(local) != year(m_dstLoc)) {
+    calcTimeChanges(year(local));
+  }
+  if (m_stdLoc == m_dstLoc) {
+    return false;
+  }
+  if (m_stdLoc > m_dstLoc) {
+    return local >= m_dstLoc && local < m_stdLoc;
+  }
+  return !(local >= m_stdLoc && local < m_dstLoc);
+}
+
+void Timezone::calcTimeChanges(int yr) {
+  m_dstLoc = toTime_t(m_dst, yr);
+  m_stdLoc = toTime_t(m_std, yr);
+  m_dstUTC = m_dstLoc - m_std.offset * SECS_PER_MIN;
+  m_stdUTC = m_stdLoc - m_dst.offset * SECS_PER_MIN;
+}
+
+time_t Timezone::toTime_t(TimeChangeRule r, int yr) {
+  uint8_t m = r.month;
+  uint8_t w = r.week;
+  if (w == 0) {
+    if (++m > 12) {
+      m = 1;
+      ++yr;
+    }
+    w = 1;
+  }
+  tmElements_t tm;
+  tm.Hour = r.hour;
+  tm.Minute = 0;
+  tm.Second = 0;
+  tm.Day = 1;
+  tm.Month = m;
+  tm.Year = yr - 1970;
+  time_t t = makeTime(tm);
+  t += ((r.dow - weekday(t) + 7) % 7 + (w - 1) * 7) * SECS_PER_DAY;
+  if (r.week == 0) {
+    t -= 7 * SECS_PER_DAY;
+  }
+  return t;
+}
+
+//TimeAlarms
+TimeAlarmsClass::TimeAlarmsClass() {
+  _isServicing = false;
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+    free(id);
+  }
+}
+
+AlarmID_t TimeAlarmsClass::alarmOnce(const int H, const int M, const int S, OnTick_t onTickHandler) {
+  return create(AlarmHMS(H, M, S), onTickHandler, true, dtDailyAlarm);
+}
+
+AlarmID_t TimeAlarmsClass::alarmRepeat(const int H, const int M, const int S, OnTick_t onTickHandler) {
+  return create(AlarmHMS(H, M, S), onTickHandler, false, dtDailyAlarm);
+}
+
+AlarmID_t TimeAlarmsClass::timerOnce(time_t value, OnTick_t onTickHandler) {
+  return create(value, onTickHandler, true, dtTimer);
+}
+
+AlarmID_t TimeAlarmsClass::timerRepeat(time_t value, OnTick_t onTickHandler) {
+  return create(value, onTickHandler, false, dtTimer);
+}
+
+void TimeAlarmsClass::delay(unsigned long ms) {
+  unsigned long start = millis();
+  do {
+    serviceAlarms();
+    yield();
+  } while (millis() - start <= ms);
+}
+
+void TimeAlarmsClass::enable(AlarmID_t ID) {
+  if (ID < dtNBR_ALARMS && _alarms[ID].alarmType != dtNotAllocated) {
+    _alarms[ID].isEnabled = true;
+    updateNextTrigger(ID);
+  }
+}
+
+void TimeAlarmsClass::disable(AlarmID_t ID) {
+  if (ID < dtNBR_ALARMS) {
+    _alarms[ID].isEnabled = false;
+  }
+}
+
+void TimeAlarmsClass::free(AlarmID_t ID) {
+  if (ID < dtNBR_ALARMS) {
+    _alarms[ID].onTickHandler = NULL;
+    _alarms[ID].value = 0;
+    _alarms[ID].nextTrigger = 0;
+    _alarms[ID].alarmType = dtNotAllocated;
+    _alarms[ID].isOneShot = false;
+    _alarms[ID].isEnabled = false;
+  }
+}
+
+time_t TimeAlarmsClass::read(AlarmID_t ID) {
+  if (ID < dtNBR_ALARMS && _alarms[ID].alarmType != dtNotAllocated) {
+    return _alarms[ID].value;
+  }
+  return dtINVALID_TIME;
+}
+
+uint8_t TimeAlarmsClass::count() {
+  uint8_t c = 0;
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+    if (_alarms[id].alarmType != dtNotAllocated) {
+      c++;
+    }
+  }
+  return c;
+}
+
+time_t TimeAlarmsClass::getNextTrigger() {
+  time_t nextTrigger = (time_t)0xffffffff;
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+    if (_alarms[id].isEnabled && _alarms[id].nextTrigger < nextTrigger) {
+      nextTrigger = _alarms[id].nextTrigger;
+    }
+  }
+  return nextTrigger == (time_t)0xffffffff ? 0 : nextTrigger;
+}
+
+void TimeAlarmsClass::serviceAlarms() {
+  if (!_isServicing && timeStatus() != timeNotSet) {
+    _isServicing = true;
+    for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+      if (_alarms[id].isEnabled && now() >= _alarms[id].nextTrigger) {
+        OnTick_t tickHandler = _alarms[id].onTickHandler;
+        if (_alarms[id].isOneShot) {
+          free(id);
+        } else {
+          updateNextTrigger(id);
+        }
+        if (tickHandler != NULL) {
+          (*tickHandler)();
+        }
+      }
+    }
+    _isServicing = false;
+  }
+}
+
+AlarmID_t TimeAlarmsClass::create(time_t value, OnTick_t onTickHandler, bool isOneShot, dtAlarmPeriod_t alarmType) {
+  //Like the library, alarms need the clock set and a time of day other than midnight
+  if (!((alarmType != dtTimer && now() < SECS_PER_YEAR) || (alarmType != dtTimer && value == 0))) {
+    for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+      if (_alarms[id].alarmType == dtNotAllocated) {
+        _alarms[id].onTickHandler = onTickHandler;
+        _alarms[id].isOneShot = isOneShot;
+        _alarms[id].alarmType = alarmType;
+        _alarms[id].value = value;
+        _alarms[id].nextTrigger = 0;
+        enable(id);
+        return id;
+      }
+    }
+  }
+  return dtINVALID_ALARM_ID;
+}
+
+void TimeAlarmsClass::updateNextTrigger(AlarmID_t ID) {
+  if (!_alarms[ID].isEnabled) {
+    return;
+  }
+  time_t time = now();
+  if (_alarms[ID].alarmType == dtDailyAlarm && _alarms[ID].nextTrigger <= time) {
+    if (_alarms[ID].value + previousMidnight(time) <= time) {
+      _alarms[ID].nextTrigger = _alarms[ID].value + nextMidnight(time);
+    } else {
+      _alarms[ID].nextTrigger = _alarms[ID].value + previousMidnight(time);
+    }
+  } else if (_alarms[ID].alarmType == dtTimer) {
+    _alarms[ID].nextTrigger = time + _alarms[ID].value;
+  }
+}
+
+//DS1307 keeps true UTC from the virtual clock
+DateTime::DateTime(uint32_t t) {
+  _unixtime = t;
+}
+
+DateTime::DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t min, uint8_t sec) {
+  tmElements_t tm;
+  tm.Year = year - 1970;
+  tm.Month = month;
+  tm.Day = day;
+  tm.Hour = hour;
+  tm.Minute = min;
+  tm.Second = sec;
+  _unixtime = (uint32_t)makeTime(tm);
+}
+
+uint32_t DateTime::unixtime() const {
+  return _unixtime;
+}
+
+bool RTC_DS1307::begin() {
+  return true;
+}
+
+bool RTC_DS1307::isrunning() {
+  return true;
+}
+
+void RTC_DS1307::adjust(const DateTime &dt) {
+  host::setUTC(dt.unixtime());
+}
+
+DateTime RTC_DS1307::now() {
+  host::countRTCRead();
+  return DateTime((uint32_t)host::utc());
+}
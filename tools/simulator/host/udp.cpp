@@ -0,0 +1,97 @@
+#include <WiFiUdp.h>
+#include <host.h>
+#include <deque>
+
+namespace {
+  std::deque<host::udpDatagram> inbound;
+  std::vector<host::udpDatagram> replies;
+}
+
+namespace host {
+  void sendUdp(IPAddress pFrom, uint16_t pFromPort, uint16_t pToPort, const std::string &pData) {
+    inbound.push_back({ pFrom, pFromPort, pToPort, pData });
+  }
+
+  const std::vector<udpDatagram> &udpReplies() {
+    return replies;
+  }
+
+  void clearUdpReplies() {
+    replies.clear();
+  }
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  _port = port;
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  _port = 0;
+}
+
+//Next datagram for this port, dropping the rest of the last one
+int WiFiUDP::parsePacket() {
+  _packet.clear();
+  _read = 0;
+  while (!inbound.empty()) {
+    host::udpDatagram datagram = inbound.front();
+    inbound.pop_front();
+    if (_port != 0 && datagram.port == _port) {
+      _packet = datagram.data;
+      _remote = datagram.ip;
+      _remotePort = datagram.fromPort;
+      return _packet.size();
+    }
+  }
+  return 0;
+}
+
+int WiFiUDP::available() {
+  return _packet.size() - _read;
+}
+
+int WiFiUDP::read() {
+  return _read < _packet.size() ? (uint8_t)_packet[_read++] : -1;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t len) {
+  size_t n = std::min(len, _packet.size() - _read);
+  memcpy(buffer, _packet.data() + _read, n);
+  _read += n;
+  return n;
+}
+
+void WiFiUDP::flush() {
+  _read = _packet.size();
+}
+
+IPAddress WiFiUDP::remoteIP() {
+  return _remote;
+}
+
+uint16_t WiFiUDP::remotePort() {
+  return _remotePort;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  _reply.clear();
+  _replyTo = ip;
+  _replyPort = port;
+  return 1;
+}
+
+size_t WiFiUDP::write(uint8_t c) {
+  _reply.push_back(c);
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size) {
+  _reply.append((const char*)buffer, size);
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+  replies.push_back({ _replyTo, _port, _replyPort, _reply });
+  return 1;
+}
@@ -0,0 +1,1089 @@
+//Accelerated virtual-time simulation of the door firmware.
+//
+//The real setup()/loop() run against the host fakes in host/: a virtual clock, the DS1307 holding
+//true UTC, the TimeLib/TimeAlarms/Timezone logic and a door rig whose limit switches follow the
+//motor. The ESP's crystal runs driftPPM fast against the RTC. Idle time is skipped straight to the next
+//alarm, so years of operation take seconds.
+//Every local day should see exactly one opening at sunrise and one closing at sunset.
+//Before that, every door state is driven through the override button and its limit switch.
+//After it, firmware updates are pushed through /update and rolled back, telemetry goes to a broker
+//that comes and goes, and every route is held to its allocation budget.
+//
+//Build from the repository root:
+//  g++ -std=gnu++17 -O2 -Itools/simulator/host -Isrc $(ls -d lib/*/ | sed 's/^/-I/')
+//      tools/simulator/simulate.cpp tools/simulator/host/*.cpp lib/*/*.cpp -o simulate
+//Run:
+//  ./simulate [firstYear] [lastYear] [overrunMillis] [travelMillis] [driftPPM]
+//Exits non-zero if a transition is wrong or any day has a missed or duplicated opening or closing.
+
+#include "../../src/main.cpp"
+#include <host.h>
+#include <MD5Builder.h>
+#include <chrono>
+#include <map>
+
+namespace sim {
+  //Motor steps while the door is moving, and the longest idle skip
+  const uint64_t MOVING_STEP_MICROS = 10000;
+  const time_t MAX_IDLE_SKIP = SECS_PER_HOUR;
+
+  struct dayTally {
+    int opens;
+    int closes;
+    double openStart;
+    double closeStart;
+  };
+
+  struct yearTally {
+    int days;
+    int opens;
+    int closes;
+    int missed;
+    int duplicated;
+    double openOffsetMax;
+    double closeOffsetMax;
+    double openOffsetSum;
+    double closeOffsetSum;
+  };
+
+  time_t localMidnight(int pYear, int pMonth, int pDay) {
+    TimeElements elements;
+    elements.Year = pYear - 1970;
+    elements.Month = pMonth;
+    elements.Day = pDay;
+    elements.Hour = 0;
+    elements.Minute = 0;
+    elements.Second = 0;
+    return makeTime(elements);
+  }
+
+  //The instant in local day pDay (local midnight, as a local time_t) whose UTC time of day matches pSunTime
+  time_t expectedInstant(time_t pDay, time_t pSunTime) {
+    time_t midnightUTC = localTime.toUTC(pDay);
+    long timeOfDay = (long)(pSunTime % SECS_PER_DAY);
+    long fromMidnight = ((timeOfDay - (long)(midnightUTC % SECS_PER_DAY)) % (long)SECS_PER_DAY + SECS_PER_DAY) % SECS_PER_DAY;
+    return midnightUTC + fromMidnight;
+  }
+
+  double offset(double pActual, time_t pExpected) {
+    return pActual - (double)pExpected;
+  }
+
+  //Door inputs the transition check drives
+  const int INPUT_OVERRIDE = 0;
+  const int INPUT_SWITCH_MADE = 1;
+  const int INPUT_SWITCH_CLEAR = 2;
+
+  struct transition {
+    int from;
+    int input;
+    int to;
+    int motor;
+  };
+
+  //Expected behaviour, written out independently of DOOR_STATE_TABLE
+  const transition TRANSITIONS[] = {
+    { DOOR_STATE_UNKNOWN, INPUT_OVERRIDE, DOOR_STATE_OPENING, 1 },
+    { DOOR_STATE_OPEN, INPUT_OVERRIDE, DOOR_STATE_CLOSING, -1 },
+    { DOOR_STATE_CLOSED, INPUT_OVERRIDE, DOOR_STATE_OPENING, 1 },
+    { DOOR_STATE_OPENING, INPUT_OVERRIDE, DOOR_STATE_STOPPED_OPENING, 0 },
+    { DOOR_STATE_CLOSING, INPUT_OVERRIDE, DOOR_STATE_STOPPED_CLOSING, 0 },
+    { DOOR_STATE_STOPPED_OPENING, INPUT_OVERRIDE, DOOR_STATE_CLOSING, -1 },
+    { DOOR_STATE_STOPPED_CLOSING, INPUT_OVERRIDE, DOOR_STATE_OPENING, 1 },
+    { DOOR_STATE_UNKNOWN, INPUT_SWITCH_MADE, DOOR_STATE_OPEN, 0 },
+    { DOOR_STATE_OPEN, INPUT_SWITCH_MADE, DOOR_STATE_OPEN, 0 },
+    { DOOR_STATE_CLOSED, INPUT_SWITCH_MADE, DOOR_STATE_CLOSED, 0 },
+    { DOOR_STATE_OPENING, INPUT_SWITCH_MADE, DOOR_STATE_OPEN, 0 },
+    { DOOR_STATE_CLOSING, INPUT_SWITCH_MADE, DOOR_STATE_CLOSED, 0 },
+    { DOOR_STATE_STOPPED_OPENING, INPUT_SWITCH_MADE, DOOR_STATE_STOPPED_OPENING, 0 },
+    { DOOR_STATE_STOPPED_CLOSING, INPUT_SWITCH_MADE, DOOR_STATE_STOPPED_CLOSING, 0 },
+    { DOOR_STATE_UNKNOWN, INPUT_SWITCH_CLEAR, DOOR_STATE_OPENING, 1 },
+    { DOOR_STATE_OPEN, INPUT_SWITCH_CLEAR, DOOR_STATE_OPEN, 0 },
+    { DOOR_STATE_CLOSED, INPUT_SWITCH_CLEAR, DOOR_STATE_CLOSED, 0 },
+    { DOOR_STATE_OPENING, INPUT_SWITCH_CLEAR, DOOR_STATE_OPENING, 1 },
+    { DOOR_STATE_CLOSING, INPUT_SWITCH_CLEAR, DOOR_STATE_CLOSING, -1 },
+    { DOOR_STATE_STOPPED_OPENING, INPUT_SWITCH_CLEAR, DOOR_STATE_STOPPED_OPENING, 0 },
+    { DOOR_STATE_STOPPED_CLOSING, INPUT_SWITCH_CLEAR, DOOR_STATE_STOPPED_CLOSING, 0 }
+  };
+
+  //Put the door where a state expects it, with the motor already running for the moving states
+  void placeDoor(int pState, int pInput) {
+    unsigned long travel = host::doorTravel();
+    unsigned long position = travel / 2;
+    motorStop();
+    if (pInput == INPUT_SWITCH_MADE) {
+      position = (pState == DOOR_STATE_CLOSING || pState == DOOR_STATE_CLOSED) ? 0 : travel;
+    }
+    host::setDoorPosition(position);
+    switches.begin(readSwitches(), millis());
+    if (pState == DOOR_STATE_OPENING) {
+      motorForward();
+    }
+    if (pState == DOOR_STATE_CLOSING) {
+      motorReverse();
+    }
+    doorState = pState;
+  }
+
+  int checkTransitions() {
+    int failed = 0;
+    setupSwitches();
+    for (const transition &t : TRANSITIONS) {
+      placeDoor(t.from, t.input);
+      if (t.input == INPUT_OVERRIDE) {
+        alterDoorState();
+      } else {
+        //overRun is still 0 before setup(), so an arrival stops on the same pass
+        checkDoorState();
+        serviceOverrun();
+      }
+      if (doorState != t.to || host::motorDirection() != t.motor) {
+        printf("transition %s on input %d: got %s motor %d, want %s motor %d\n", DOOR_STATE_TABLE[t.from].name, t.input,
+          DOOR_STATE_TABLE[doorState].name, host::motorDirection(), DOOR_STATE_TABLE[t.to].name, t.motor);
+        failed++;
+      }
+    }
+    motorStop();
+    host::setDoorPosition(0);
+    doorState = DOOR_STATE_UNKNOWN;
+    printf("transitions: %d checked, %d failed\n", (int)(sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0])), failed);
+    return failed;
+  }
+
+  //Power cycle: TimeAlarms and the scheduler forget everything, then setup() runs again. A restart
+  //from the firmware lands here too, from loop() through runFor() or from setup() itself
+  void reboot() {
+    for (;;) {
+      for (AlarmID_t id = 0; id < dtNBR_ALARMS; id++) {
+        Alarm.free(id);
+      }
+      scheduler.resetStats();
+      try {
+        setup();
+        return;
+      } catch (host::Restart &) {
+      }
+    }
+  }
+
+  void runFor(unsigned long pMillis) {
+    unsigned long start = millis();
+    while (millis() - start < pMillis) {
+      try {
+        loop();
+      } catch (host::Restart &) {
+        reboot();
+      }
+      host::advance(10000);
+    }
+  }
+
+  std::string randomBytes(size_t pSize, uint32_t pSeed) {
+    std::string image(pSize, '\0');
+    for (size_t i = 0; i < pSize; i++) {
+      pSeed = pSeed * 1103515245 + 12345;
+      image[i] = (char)(pSeed >> 16);
+    }
+    image[0] = (char)0xE9;
+    return image;
+  }
+
+  String md5Of(const std::string &pData) {
+    MD5Builder md5;
+    md5.begin();
+    //MD5Builder takes at most 64k at a time
+    for (size_t i = 0; i < pData.size(); i += 4096) {
+      md5.add((const uint8_t*)pData.data() + i, std::min((size_t)4096, pData.size() - i));
+    }
+    md5.calculate();
+    return md5.toString();
+  }
+
+  //The image's tag under pKey, as the uploader gives it
+  String tagOf(const std::string &pImage, const uint8_t *pKey) {
+    uint8_t tag[SIPHASH_TAG_LENGTH];
+    char hex[SIPHASH_TAG_LENGTH * 2 + 1];
+    sipTag(pKey, (const uint8_t*)pImage.data(), pImage.size(), tag);
+    for (uint8_t i = 0; i < SIPHASH_TAG_LENGTH; i++) {
+      snprintf(hex + i * 2, 3, "%02x", tag[i]);
+    }
+    return String(hex);
+  }
+
+  int uploadImage(const std::string &pImage, const char *pType, const String &pMD5, const String &pTag) {
+    return server.request("/update", { { "type", pType }, { "md5", pMD5 }, { "tag", pTag } }, IPAddress(127, 0, 0, 1), HTTP_POST,
+      pImage, 1460).code;
+  }
+
+  int uploadImage(const std::string &pImage, const char *pType, const String &pMD5) {
+    return uploadImage(pImage, pType, pMD5, tagOf(pImage, udpKey));
+  }
+
+  int expect(bool pOK, const char *pCheck, const char *pWhat) {
+    if (!pOK) {
+      printf("%s: %s failed\n", pCheck, pWhat);
+    }
+    return pOK ? 0 : 1;
+  }
+
+  void writeFile(const char *pPath, const std::string &pData) {
+    File file = LittleFS.open(pPath, "w");
+    file.write((const uint8_t*)pData.data(), pData.size());
+    file.close();
+  }
+
+  bool sentGzipped(const AsyncWebServer::hostResponse &pResponse) {
+    bool gzipped = false;
+    for (auto &header : pResponse.headers) {
+      gzipped = gzipped || (header.first == "Content-Encoding" && header.second == "gzip");
+    }
+    return gzipped;
+  }
+
+  //pollo.js comes from RAM once warmed, gzipped when a .gz is on the filesystem, and is kept. The
+  //stylesheet is streamed, precompressed. Small assets missed are loaded from loop(), and the least
+  //recently used go past the budget
+  int checkAssets() {
+    int failed = 0;
+    std::string js = randomBytes(900, 3);
+    std::string css = randomBytes(12000, 1);
+    std::string image = randomBytes(700, 2);
+    writeFile("/pollo.css", randomBytes(20000, 6));
+    writeFile("/pollo.css.gz", css);
+    writeFile("/pollo.js.gz", js);
+    writeFile("/date.png", image);
+    writeFile("/time.png", randomBytes(900, 5));
+    writeFile("/sunset.png", randomBytes(1000, 7));
+    writeFile("/door.png", randomBytes(1000, 8));
+    writeFile("/sunrise.png", randomBytes(ASSET_CACHE_MAX_ASSET + 1, 4));
+    reboot();
+    uint32_t hits = assets.hits();
+    uint32_t misses = assets.misses();
+    size_t used = assets.used();
+
+    AsyncWebServer::hostResponse response = server.request("/pollo.js");
+    if (response.code != 200 || !sentGzipped(response) || std::string(response.body.c_str(), response.body.length()) != js
+      || assets.hits() != hits + 1 || assets.misses() != misses) {
+      printf("assets: warmed /pollo.js not served gzipped from RAM\n");
+      failed++;
+    }
+    response = server.request("/pollo.css");
+    if (response.code != 200 || !sentGzipped(response) || std::string(response.body.c_str(), response.body.length()) != css
+      || assets.hits() != hits + 1 || assets.misses() != misses || assets.used() != used) {
+      printf("assets: /pollo.css not streamed gzipped past the cache\n");
+      failed++;
+    }
+    //A miss is sent from LittleFS and only loaded once loop() gets to it
+    response = server.request("/date.png");
+    if (std::string(response.body.c_str(), response.body.length()) != image || assets.used() != used) {
+      printf("assets: /date.png loaded from the request\n");
+      failed++;
+    }
+    runFor(10);
+    response = server.request("/date.png");
+    if (std::string(response.body.c_str(), response.body.length()) != image || assets.hits() != hits + 2 || assets.misses() != misses + 1) {
+      printf("assets: /date.png not cached after first use\n");
+      failed++;
+    }
+    server.request("/sunrise.png");
+    runFor(10);
+    if (assets.used() != used + image.size()) {
+      printf("assets: /sunrise.png cached past ASSET_CACHE_MAX_ASSET\n");
+      failed++;
+    }
+    const char *IMAGES[] = { "/time.png", "/sunset.png", "/door.png" };
+    for (const char *path : IMAGES) {
+      server.request(path);
+      runFor(10);
+    }
+    server.request("/pollo.js");
+    if (assets.evictions() != 1 || assets.used() > assets.budget() || assets.hits() != hits + 3) {
+      printf("assets: %u of %u bytes after %u evictions, warmed assets not kept\n", (unsigned)assets.used(),
+        (unsigned)assets.budget(), assets.evictions());
+      failed++;
+    }
+    printf("assets: %u hits, %u misses, %u evictions, %u of %u bytes, %d failed\n", assets.hits(), assets.misses(),
+      assets.evictions(), (unsigned)assets.used(), (unsigned)assets.budget(), failed);
+    return failed;
+  }
+
+  //Door buttons with format=json answer with the state the door is headed for instead of a redirect.
+  //Each waits out the motor's rest from the one before
+  int checkActions() {
+    const char *ACTIONS[] = { "/stopclosed", "/override", "/override", "/stopopened" };
+    int failed = 0;
+    for (const char *action : ACTIONS) {
+      AsyncWebServer::hostResponse response = server.request(action, { { "format", "json" } });
+      runFor(MOTOR_REST_MILLIS + 100);
+      String want = String("\"state\":\"") + DOOR_STATE_TABLE[doorState].name + "\"";
+      if (response.code != 200 || response.contentType != "application/json" || response.body.indexOf(want) < 0) {
+        printf("action %s: got %d %s, want %s\n", action, response.code, response.body.c_str(), want.c_str());
+        failed++;
+      }
+    }
+    if (server.request("/stopopened").code != 302) {
+      printf("action /stopopened without format=json did not redirect\n");
+      failed++;
+    }
+    runFor(100);
+    printf("actions: %d checked, %d failed\n", (int)(sizeof(ACTIONS) / sizeof(ACTIONS[0])) + 1, failed);
+    return failed;
+  }
+
+  //Malformed arguments are answered 400 before anything is queued, and paths outside ROUTES fall through
+  int checkArgs() {
+    const std::vector<std::pair<String, String> > BAD[] = {
+      { { "overrun", "abc" } },
+      { { "overrun", "99999" } },
+      { { "overrun", "" } },
+      { { "year", "2017" }, { "month", "2" }, { "day", "30" }, { "hour", "1" }, { "minute", "2" } },
+      { { "year", "2017" }, { "month", "13" }, { "day", "1" }, { "hour", "1" }, { "minute", "2" } },
+      { { "year", "2017" }, { "month", "1" }, { "day", "1" }, { "hour", "1" } },
+      { { "ssid", "chooks" } },
+      { { "ssid", "chooks" }, { "password", "a password far too long" } }
+    };
+    const char *PATHS[] = { "/setoverrun", "/setoverrun", "/setoverrun", "/settime", "/settime", "/settime", "/setwifi", "/setwifi" };
+    int failed = 0;
+    int checks = 0;
+    int original = overRun;
+    uint32_t commits = EEPROM.commits();
+    for (size_t i = 0; i < sizeof(PATHS) / sizeof(PATHS[0]); i++) {
+      //Each from its own address, so none is rate limited
+      AsyncWebServer::hostResponse response = server.request(PATHS[i], BAD[i], IPAddress(10, 0, 0, i + 1));
+      if (response.code != 400 || webCommandCount != 0) {
+        printf("args: %s case %u answered %d with %u queued\n", PATHS[i], (unsigned)i, response.code, webCommandCount);
+        failed++;
+      }
+      checks++;
+    }
+    runFor(100);
+    failed += expect(EEPROM.commits() == commits, "args", "keeping bad arguments out of EEPROM"), checks++;
+    failed += expect(server.request("/setoverrun", { { "overrun", "750" }, { "unused", "x" } }).code == 302, "args", "accepting a good overrun"), checks++;
+    runFor(100);
+    failed += expect(overRun == 750, "args", "setting the overrun"), checks++;
+    server.request("/setoverrun", { { "overrun", String(original) } });
+    runFor(100);
+    //A blank or corrupt EEPROM must not leave the motor running on for minutes
+    EEPROM.put(45, -1);
+    reboot();
+    failed += expect(overRun == OVERRUN_DEFAULT, "args", "ignoring a stored overrun out of range"), checks++;
+    EEPROM.put(45, original);
+    reboot();
+    failed += expect(server.request("/nowhere").code == 404 && server.request("/update").code == 404, "args", "leaving unrouted requests"), checks++;
+    printf("args: %d checked, %d failed\n", checks, failed);
+    return failed;
+  }
+
+  //A client over its budget gets a cheap 429 while others carry on, and a flood of overrides from
+  //many clients never restarts the motor sooner than MOTOR_REST_MILLIS after it stopped
+  int checkLimits() {
+    int failed = 0;
+    int checks = 0;
+    int limited = 0;
+    IPAddress flooder(10, 1, 0, 1);
+    //Long enough for the clients of earlier checks to give up their slots
+    runFor(RATE_CONTROL_BURST * RATE_CONTROL_REFILL);
+    for (int i = 0; i < RATE_CONTROL_BURST + 6; i++) {
+      AsyncWebServer::hostResponse response = server.request("/setoverrun", { { "overrun", "abc" } }, flooder);
+      limited += response.code == 429;
+    }
+    failed += expect(limited == 6, "limits", "limiting a flooding client"), checks++;
+    failed += expect(server.request("/setoverrun", { { "overrun", "abc" } }, IPAddress(10, 1, 0, 2)).code == 400, "limits", "serving other clients"), checks++;
+    failed += expect(server.request("/pollo.js", {}, flooder).code == 200, "limits", "keeping page budgets apart"), checks++;
+    limited = 0;
+    for (int i = 0; i < RATE_READ_BURST + 5; i++) {
+      limited += server.request("/missing.png", {}, IPAddress(10, 1, 0, 3)).code == 429;
+    }
+    failed += expect(limited == 5, "limits", "limiting paths that aren't routed"), checks++;
+    runFor(RATE_CONTROL_REFILL);
+    failed += expect(server.request("/setoverrun", { { "overrun", "abc" } }, flooder).code == 400, "limits", "refilling the budget"), checks++;
+
+    //Rotating addresses fill the table, then share one bucket
+    int admitted = 0;
+    for (int i = 0; i < RATELIMIT_CLIENTS * 4; i++) {
+      for (int j = 0; j < 2; j++) {
+        admitted += server.request("/setoverrun", { { "overrun", "abc" } }, IPAddress(10, 1, 1, i + 1)).code != 429;
+      }
+    }
+    failed += expect(admitted <= (RATELIMIT_CLIENTS + 1) * RATE_CONTROL_BURST && limiter.shared() > 0, "limits",
+      "limiting a flood from many addresses"), checks++;
+    runFor(RATE_CONTROL_BURST * RATE_CONTROL_REFILL);
+    failed += expect(server.request("/setoverrun", { { "overrun", "abc" } }, IPAddress(10, 1, 2, 1)).code == 400, "limits",
+      "taking a quiet client's slot"), checks++;
+
+    host::clearMotorRest();
+    for (int i = 0; i < 6; i++) {
+      server.request("/override", {}, IPAddress(10, 2, 0, i + 1));
+    }
+    runFor(MOTOR_REST_MILLIS * 4);
+    failed += expect(webCommandCount == 0 && host::shortestMotorRest() != UINT64_MAX
+      && host::shortestMotorRest() >= MOTOR_REST_MILLIS * 999, "limits", "resting the motor between overrides"), checks++;
+    server.request("/stopopened", {}, IPAddress(10, 2, 1, 1));
+    //Quiet again, so the clients of later checks get slots of their own
+    runFor(RATE_CONTROL_BURST * RATE_CONTROL_REFILL);
+
+    printf("limits: %u limited, %u clients, shortest motor rest %.0f ms, %d checked, %d failed\n", limiter.limited(RATE_READ)
+      + limiter.limited(RATE_CONTROL), limiter.clients(), host::shortestMotorRest() / 1000.0, checks, failed);
+    return failed;
+  }
+
+  //Send one tagged request to the UDP port and return the reply it got, if any
+  bool udpPoll(uint8_t pType, uint32_t pSeq, bool pTamper, udpStatus &pReply) {
+    udpRequest request;
+    memcpy(request.magic, UDP_MAGIC, sizeof(UDP_MAGIC));
+    request.version = UDP_VERSION;
+    request.type = pType;
+    request.seq = pSeq;
+    sipTag(udpKey, (const uint8_t*)&request, offsetof(udpRequest, tag), request.tag);
+    request.tag[0] ^= pTamper;
+    host::clearUdpReplies();
+    host::sendUdp(IPAddress(10, 3, 0, 1), 5000, UDP_PORT, std::string((const char*)&request, sizeof(request)));
+    runFor(10);
+    if (host::udpReplies().size() != 1 || host::udpReplies()[0].data.size() != sizeof(pReply) || host::udpReplies()[0].port != 5000) {
+      return false;
+    }
+    memcpy(&pReply, host::udpReplies()[0].data.data(), sizeof(pReply));
+    return sipVerify(udpKey, (const uint8_t*)&pReply, offsetof(udpStatus, tag), pReply.tag) && pReply.seq == pSeq
+      && pReply.type == (pType | UDP_REPLY);
+  }
+
+  //Tagged polls get the door's status in one datagram, untagged ones get nothing, and commands
+  //are idempotent and refuse replays
+  int checkUdp() {
+    int failed = 0;
+    int checks = 0;
+    udpStatus reply;
+    uint8_t key[SIPHASH_KEY_LENGTH];
+    uint8_t message[15];
+    for (uint8_t i = 0; i < sizeof(key); i++) {
+      key[i] = i;
+    }
+    for (uint8_t i = 0; i < sizeof(message); i++) {
+      message[i] = i;
+    }
+    failed += expect(sipHash(key, message, sizeof(message)) == 0xa129ca6149be45e5ULL, "udp", "matching the SipHash-2-4 test vector"), checks++;
+
+    failed += expect(!udpKeySet() && !udpPoll(UDP_STATUS, 1, false, reply), "udp", "staying quiet without a key"), checks++;
+    server.request("/newudpkey");
+    runFor(100);
+    failed += expect(udpKeySet(), "udp", "making a key"), checks++;
+    failed += expect(udpPoll(UDP_STATUS, 7, false, reply) && reply.result == UDP_OK && reply.doorState == doorState
+      && reply.overRun == overRun && reply.openAt == openAtUTC && reply.closeAt == closeAtUTC && reply.time == (uint32_t)now(),
+      "udp", "answering a status poll"), checks++;
+    failed += expect(!udpPoll(UDP_STATUS, 8, true, reply), "udp", "ignoring a bad tag"), checks++;
+
+    int before = doorState;
+    failed += expect(udpPoll(UDP_OPEN, 100, false, reply) && reply.result == UDP_OK && webCommandCount == 0 && doorState == before,
+      "udp", "acknowledging an open door's open"), checks++;
+    failed += expect(udpPoll(UDP_CLOSE, 101, false, reply) && reply.result == UDP_OK && reply.doorState == DOOR_STATE_CLOSING,
+      "udp", "accepting a close"), checks++;
+    runFor(MOTOR_REST_MILLIS + 100);
+    failed += expect(doorState == DOOR_STATE_CLOSING, "udp", "closing"), checks++;
+    failed += expect(udpPoll(UDP_STOP, 101, false, reply) && reply.result == UDP_STALE, "udp", "refusing a replayed command"), checks++;
+    failed += expect(udpPoll(UDP_STOP, 102, false, reply) && reply.result == UDP_OK, "udp", "accepting a stop"), checks++;
+    runFor(100);
+    failed += expect(doorState == DOOR_STATE_STOPPED_CLOSING, "udp", "stopping"), checks++;
+    reboot();
+    runFor(RATE_CONTROL_REFILL);
+    failed += expect(udpPoll(UDP_CLOSE, 101, false, reply) && reply.result == UDP_STALE && webCommandCount == 0,
+      "udp", "refusing a replay after a restart"), checks++;
+    AsyncWebServer::hostResponse response = server.request("/settings", {}, IPAddress(10, 3, 1, 1));
+    std::string settings(response.body.c_str(), response.body.length());
+    failed += expect(settings.find("Set, see dump config") != std::string::npos, "udp", "keeping the key off /settings"), checks++;
+    server.request("/stopopened", {}, IPAddress(10, 3, 1, 1));
+    runFor(100);
+
+    printf("udp: %u answered, %u rejected, %d checked, %d failed\n", udpAnswered, udpRejected, checks, failed);
+    return failed;
+  }
+
+  //Type a line at the serial console and return what it answered
+  std::string consoleLine(const char *pLine, unsigned long pMillis = 100) {
+    host::clearSerialOutput();
+    host::serialInput(pLine);
+    runFor(pMillis);
+    return host::serialOutput();
+  }
+
+  //Console commands are parsed as they arrive, checked against the web pages' argument tables and
+  //queued like web commands
+  int checkConsole() {
+    int failed = 0;
+    int checks = 0;
+    int original = overRun;
+    uint32_t commits = EEPROM.commits();
+    std::string out;
+    char want[32];
+
+    snprintf(want, sizeof(want), "door %s\r\n", DOOR_STATE_TABLE[doorState].name);
+    out = consoleLine("status\r\n");
+    failed += expect(out.find(want) != std::string::npos && out.find("OK status\r\n") != std::string::npos, "console", "showing status"), checks++;
+    host::serialInput("setover");
+    runFor(10);
+    out = consoleLine("run 600\n");
+    failed += expect(out == "OK " + std::string(DOOR_STATE_TABLE[doorState].name) + "\r\n" && overRun == 600, "console", "setting the overrun across reads"), checks++;
+    commits = EEPROM.commits();
+    out = consoleLine("setoverrun 99999\r\n");
+    failed += expect(out == "ERR overrun must be a number from 0 to 10000\r\n", "console", "range checking"), checks++;
+    out = consoleLine("settime 2017 2 30 1 2\r\n");
+    failed += expect(out == "ERR day is past the end of the month\r\n", "console", "checking the day of the month"), checks++;
+    out = consoleLine("setwifi chooks\r\n");
+    failed += expect(out == "ERR password is required\r\n", "console", "requiring arguments"), checks++;
+    failed += expect(EEPROM.commits() == commits && webCommandCount == 0, "console", "keeping bad arguments out of EEPROM"), checks++;
+    out = consoleLine("fly away\r\n");
+    failed += expect(out.find("ERR unknown command fly") == 0, "console", "refusing unknown commands"), checks++;
+    out = consoleLine((std::string(CONSOLE_LINE_LENGTH + 10, 'x') + "\r\nstatus\r\n").c_str());
+    failed += expect(out.find("ERR line too long\r\n") == 0 && out.find("OK status\r\n") != std::string::npos, "console", "dropping an overlong line"), checks++;
+
+    placeDoor(DOOR_STATE_OPEN, INPUT_SWITCH_MADE);
+    out = consoleLine("close\r\n", MOTOR_REST_MILLIS + 100);
+    failed += expect(out == "OK Closing\r\n" && doorState == DOOR_STATE_CLOSING, "console", "closing"), checks++;
+    out = consoleLine("stop\r\n");
+    failed += expect(out == "OK Stopped-Closing\r\n" && doorState == DOOR_STATE_STOPPED_CLOSING, "console", "stopping"), checks++;
+    server.request("/stopopened", {}, IPAddress(10, 4, 1, 1));
+    runFor(100);
+
+    out = consoleLine("dump config\r\n");
+    failed += expect(out.find("overrun 600\r\n") != std::string::npos && out.find("OK config\r\n") != std::string::npos, "console", "dumping config"), checks++;
+    out = consoleLine("dump metrics\r\n");
+    failed += expect(out.find("heap ") != std::string::npos && out.find("OK metrics\r\n") != std::string::npos, "console", "dumping metrics"), checks++;
+    //Long replies go out as the UART empties rather than holding up the door
+    scheduler.resetStats();
+    out = consoleLine("help\r\ndump tasks\r\n", 500);
+    uint32_t longest = 0;
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+      if (strcmp(scheduler.task(i).name, "console") == 0) {
+        longest = scheduler.stats(i).longest;
+      }
+    }
+    failed += expect(out.size() > CONSOLE_TX_LENGTH / 2 && out.find("OK tasks\r\n") != std::string::npos && console.dropped() == 0
+      && longest < 2000 && scheduler.stats(0).worstGap <= DOOR_PERIOD + 2000, "console", "sending long replies without blocking"), checks++;
+    snprintf(want, sizeof(want), "setoverrun %d\r\n", original);
+    consoleLine(want);
+    failed += expect(overRun == original, "console", "restoring the overrun"), checks++;
+
+    printf("console: %u lines, %u errors, %d checked, %d failed\n", console.lines(), console.errors(), checks, failed);
+    return failed;
+  }
+
+  //Sequence numbers are given as events are logged, so those published straight away match what
+  //reaches flash. Records dropped from a full buffer leave a gap that reads skip over
+  int checkEventLog() {
+    int failed = 0;
+    int checks = 0;
+    fs::FS scratch;
+    EventLog log;
+    eventRecord records[8];
+    uint32_t last = 0;
+
+    log.begin(scratch);
+    for (uint32_t i = 0; i < 10; i++) {
+      log.append(i, EVENT_CONFIG, 0, 0, i);
+    }
+    log.flush(millis());
+    for (uint32_t i = 10; i < 50; i++) {
+      last = log.append(i, EVENT_CONFIG, 0, 0, i);
+    }
+    failed += expect(last == 49 && log.nextSeq() == 50 && log.dropped() == 50 - 10 - EVENTLOG_RAM_RECORDS, "eventlog",
+      "numbering dropped records"), checks++;
+    log.flush(millis());
+    failed += expect(log.read(12, records, 8) == 8 && records[0].seq == 18 && records[0].time == 18, "eventlog",
+      "skipping the gap"), checks++;
+    failed += expect(log.read(45, records, 8) == 5 && records[4].seq == last && records[4].value == 49, "eventlog",
+      "keeping the published number on flash"), checks++;
+
+    EventLog reopened;
+    reopened.begin(scratch);
+    failed += expect(reopened.nextSeq() == 50 && reopened.firstSeq() == 0 && reopened.read(0, records, 8) == 8
+      && reopened.read(9, records, 8) == 1 && reopened.read(10, records, 8) == 8 && records[0].seq == 18, "eventlog",
+      "finding the gap after a restart"), checks++;
+
+    printf("eventlog: %u dropped, %d checked, %d failed\n", log.dropped(), checks, failed);
+    return failed;
+  }
+
+  //The whole ring comes back from /trace, and reading it to the end lets a frozen ring record again
+  int checkTrace() {
+    int failed = 0;
+    uint32_t spans = tracer.nextSeq() - tracer.firstSeq();
+    AsyncWebServer::hostResponse response = server.request("/trace");
+    int events = 0;
+    for (int at = response.body.indexOf("{\"name\""); at >= 0; at = response.body.indexOf("{\"name\"", at + 1)) {
+      events++;
+    }
+    if (response.code != 200 || !response.body.startsWith("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[")
+      || !response.body.endsWith("]}\n") || events != (int)spans) {
+      printf("trace: got %d with %d of %u spans\n", response.code, events, spans);
+      failed++;
+    }
+    if (tracer.frozen()) {
+      printf("trace: still frozen after reading\n");
+      failed++;
+    }
+    printf("trace: %u stalls, longest span %.1f ms, %d events served\n", tracer.stalls(), tracer.longest() / 1000.0, events);
+    return failed;
+  }
+
+  //OTA through /update against the simulated flash: a bad hash, a tag under another key and a client
+  //over its budget are refused, a good image swaps in on restart, a firmware that never lasts
+  //OTA_CONFIRM_MILLIS is rolled back, and one that does is kept
+  int checkUpdate() {
+    int failed = 0;
+    int checks = 0;
+    std::string original = host::sketch();
+    std::string update = randomBytes(300000, 42);
+    uint32_t restarts;
+    uint32_t yields = 0;
+
+    runFor(10000);
+    failed += expect(rollbackReady, "update", "saving the running sketch"), checks++;
+    failed += expect(uploadImage(update, "firmware", md5Of(original)) == 400 && !host::swapPending(), "update", "refusing a bad md5"), checks++;
+    failed += expect(uploadImage(update, "firmware", "") == 400, "update", "refusing a missing md5"), checks++;
+    uint8_t otherKey[SIPHASH_KEY_LENGTH] = { 1 };
+    failed += expect(uploadImage(update, "firmware", md5Of(update), tagOf(update, otherKey)) == 400 && !host::swapPending(),
+      "update", "refusing an image tagged with another key"), checks++;
+    failed += expect(uploadImage(update, "firmware", md5Of(update), "") == 400, "update", "refusing a missing tag"), checks++;
+    failed += expect(uploadImage(update, "firmware", md5Of(update), "") == 429, "update", "limiting uploads"), checks++;
+    runFor(RATE_CONTROL_BURST * RATE_CONTROL_REFILL);
+
+    restarts = host::restarts();
+    failed += expect(uploadImage(update, "firmware", md5Of(update)) == 200, "update", "accepting a good image"), checks++;
+    runFor(100);
+    failed += expect(host::restarts() == restarts + 1 && host::sketch() == update, "update", "swapping in the new sketch"), checks++;
+
+    //The new firmware keeps dying before it is confirmed
+    restarts = host::restarts();
+    for (int boot = 0; boot <= OTA_TRIAL_BOOTS && host::restarts() == restarts; boot++) {
+      yields = host::yields();
+      reboot();
+      yields = host::yields() - yields;
+      runFor(1000);
+    }
+    failed += expect(host::sketch() == original, "update", "rolling back after failed boots"), checks++;
+    failed += expect(yields >= original.size() / OTA_COPY_CHUNK, "update", "feeding the watchdog while rolling back"), checks++;
+    reboot();
+    runFor(1000);
+    failed += expect(ota.phase == OTA_CONFIRMED, "update", "settling after the rollback"), checks++;
+
+    //This time it lasts
+    uploadImage(update, "firmware", md5Of(update));
+    runFor(OTA_CONFIRM_MILLIS + 10000);
+    failed += expect(host::sketch() == update && ota.phase == OTA_CONFIRMED, "update", "confirming a good boot"), checks++;
+    runFor(10000);
+    File saved = LittleFS.open(OTA_ROLLBACK_PATH, "r");
+    failed += expect(rollbackReady && saved.size() == update.size(), "update", "saving the new sketch for rollback"), checks++;
+    saved.close();
+    failed += expect(server.request(OTA_ROLLBACK_PATH).code == 404 && server.request(String("/") + OTA_ROLLBACK_PATH).code == 404
+      && server.request("/log/0.bin").code == 404, "update", "keeping the rollback image and event log off the web"), checks++;
+
+    printf("update: %d checked, %d failed\n", checks, failed);
+    return failed;
+  }
+
+  //Event batches on the broker's events topic, and how many events they carried
+  int eventBatches(int &pEvents, int &pLargest) {
+    std::string topic = std::string(telemetryPrefix) + "/events";
+    int batches = 0;
+    pEvents = 0;
+    pLargest = 0;
+    for (const host::mqttMessage &message : host::mqttMessages()) {
+      if (message.topic != topic) {
+        continue;
+      }
+      int events = 0;
+      for (size_t at = message.payload.find("{\"seq\""); at != std::string::npos; at = message.payload.find("{\"seq\"", at + 1)) {
+        events++;
+      }
+      batches++;
+      pEvents += events;
+      pLargest = std::max(pLargest, events);
+    }
+    return batches;
+  }
+
+  //Telemetry backs off while the broker is away, then publishes retained status and acked event
+  //batches. Unacked batches hold the queue, which drops new events rather than growing
+  int checkTelemetry() {
+    int failed = 0;
+    int checks = 0;
+    int events;
+    int largest;
+    std::string prefix = telemetryPrefix;
+
+    host::setBrokerUp(false);
+    server.request("/setmqtt", { { "host", "broker.local" }, { "port", "1883" } });
+    runFor(20000);
+    failed += expect(telemetry.enabled() && !telemetry.connected(), "telemetry", "configuring an absent broker"), checks++;
+    failed += expect(telemetry.attempts() >= 3 && telemetry.attempts() <= 6 && telemetry.backoff() > TELEMETRY_BACKOFF_MIN,
+      "telemetry", "backing off"), checks++;
+
+    host::setBrokerUp(true);
+    runFor(telemetry.backoff() + 1000);
+    failed += expect(telemetry.connected() && host::mqttRetained(prefix + "/online") == "true", "telemetry", "connecting"), checks++;
+    failed += expect(host::mqttRetained(prefix + "/state") == DOOR_STATE_TABLE[doorState].name
+      && host::mqttRetained(prefix + "/alarms").find("\"open\":") != std::string::npos, "telemetry", "retaining status"), checks++;
+
+    host::clearMqttMessages();
+    uint32_t published = telemetry.published();
+    for (int i = 0; i < 20; i++) {
+      logEvent(EVENT_OVERRIDE, OVERRIDE_WEB, 0, i);
+    }
+    runFor(TELEMETRY_BATCH_MILLIS + 100);
+    eventBatches(events, largest);
+    failed += expect(telemetry.queued() == 0 && events == 20 && largest == TELEMETRY_BATCH && telemetry.published() == published + 20,
+      "telemetry", "batching events"), checks++;
+
+    host::holdMqttAcks(true);
+    uint32_t dropped = telemetry.dropped();
+    for (int i = 0; i < 50; i++) {
+      logEvent(EVENT_OVERRIDE, OVERRIDE_WEB, 0, i);
+      runFor(100);
+    }
+    failed += expect(telemetry.queued() == TELEMETRY_QUEUE && telemetry.dropped() == dropped + 50 - TELEMETRY_QUEUE,
+      "telemetry", "bounding the queue"), checks++;
+    host::holdMqttAcks(false);
+    runFor(TELEMETRY_BATCH_MILLIS + 100);
+    failed += expect(telemetry.queued() == 0, "telemetry", "draining the queue"), checks++;
+
+    //Every field at its widest still makes whole batches
+    host::clearMqttMessages();
+    for (int i = 0; i < TELEMETRY_BATCH; i++) {
+      telemetry.queueEvent({ UINT32_MAX, UINT32_MAX, EVENT_OVERRIDE, UINT8_MAX, UINT8_MAX, 0, INT32_MIN });
+    }
+    runFor(TELEMETRY_BATCH_MILLIS + 100);
+    bool whole = eventBatches(events, largest) > 0;
+    for (const host::mqttMessage &message : host::mqttMessages()) {
+      if (message.topic == prefix + "/events") {
+        whole = whole && message.payload.front() == '[' && message.payload.back() == ']'
+          && message.payload.find('\0') == std::string::npos && message.payload.find("}{") == std::string::npos;
+      }
+    }
+    failed += expect(whole && events == TELEMETRY_BATCH && telemetry.queued() == 0, "telemetry", "batching the widest events"), checks++;
+
+    host::setBrokerUp(false);
+    runFor(100);
+    failed += expect(host::mqttRetained(prefix + "/online") == "false", "telemetry", "leaving a will"), checks++;
+    host::setBrokerUp(true);
+    runFor(TELEMETRY_BACKOFF_MIN * 3);
+    failed += expect(host::mqttRetained(prefix + "/online") == "true", "telemetry", "reconnecting"), checks++;
+
+    //Changing broker drops the connection on purpose, which is no reason to back off
+    server.request("/setmqtt", { { "host", "broker.local" }, { "port", "1883" } });
+    runFor(500);
+    failed += expect(telemetry.connected() && telemetry.backoff() == TELEMETRY_BACKOFF_MIN, "telemetry", "moving broker without backing off"), checks++;
+
+    printf("telemetry: %u published, %u dropped, %u connects, %d checked, %d failed\n", telemetry.published(),
+      telemetry.dropped(), host::mqttConnects(), checks, failed);
+    return failed;
+  }
+
+  //What each route and HEAP_SCOPE allocated over the whole run, held to HEAP_BUDGETS. /heap serves the
+  //same numbers, and a dip in the heap shows in the low water marks and the window it fell in
+  int checkHeap() {
+    int failed = 0;
+    int checks = 0;
+    IPAddress reader(10, 5, 0, 1);
+    AsyncWebServer::hostResponse response;
+    const heapSite *loopSite = NULL;
+    const heapSite *telemetrySite = NULL;
+    int sites = 0;
+    int samples = 0;
+
+    server.request("/", {}, reader);
+    server.request("/", { { "message", "Function: AlterDoorState" } }, reader);
+    server.request("/settings", {}, reader);
+    server.request("/stopopened", {}, reader);
+    runFor(100);
+    response = server.request("/heap", {}, reader);
+    for (int at = response.body.indexOf("{\"name\""); at >= 0; at = response.body.indexOf("{\"name\"", at + 1)) {
+      sites++;
+    }
+    int samplesAt = response.body.indexOf(",\"samples\":[");
+    for (int at = samplesAt < 0 ? -1 : response.body.indexOf('[', samplesAt + 12); at >= 0; at = response.body.indexOf('[', at + 1)) {
+      samples++;
+    }
+    failed += expect(response.code == 200 && response.body.startsWith("{\"free\":") && response.body.endsWith("]}\n")
+      && sites == (int)heapProfiler.sites() && samples == (int)heapProfiler.samples(), "heap", "serving /heap"), checks++;
+    failed += expect(heapProfiler.samples() == HEAP_SAMPLES, "heap", "filling a day of samples"), checks++;
+
+    printf("%-14s %7s %8s %6s %9s %7s %6s %s\n", "site", "calls", "allocs", "max", "bytes", "max", "kept", "budget");
+    for (size_t i = 0; i < heapProfiler.sites(); i++) {
+      const heapSite &site = heapProfiler.site(i);
+      printf("%-14s %7u %8.1f %6u %9.0f %7u %6u %u/%u%s\n", site.name, site.calls, site.calls ? (double)site.allocs / site.calls : 0.0,
+        site.maxAllocs, site.calls ? (double)site.bytes / site.calls : 0.0, site.maxBytes, site.kept, site.budgetAllocs,
+        site.budgetBytes, site.overBudget > 0 ? " OVER" : "");
+      if (strcmp(site.name, "loop") == 0) {
+        loopSite = &site;
+      }
+      if (strcmp(site.name, "serviceTelemetry") == 0) {
+        telemetrySite = &site;
+      }
+    }
+    failed += expect(heapProfiler.overBudget() == 0 && heapProfiler.untracked() == 0, "heap", "keeping to the allocation budgets"), checks++;
+    //Only the MQTT client's own traffic allocates between health reports
+    if (loopSite != NULL && telemetrySite != NULL) {
+      uint32_t loopAllocs = loopSite->allocs - telemetrySite->allocs;
+      uint32_t loopCalls = loopSite->calls;
+      telemetryHealthAt = millis();
+      runFor(TELEMETRY_HEALTH_INTERVAL / 2);
+      failed += expect(loopSite->calls > loopCalls && loopSite->allocs - telemetrySite->allocs == loopAllocs, "heap",
+        "leaving idle loops alone"), checks++;
+    } else {
+      failed += expect(false, "heap", "profiling loop()"), checks++;
+    }
+
+    host::setHeap(12000, 3000, 40);
+    runFor(HEAP_CHECK_INTERVAL * 2);
+    host::setHeap(40000, 30000, 0);
+    runFor(HEAP_SAMPLE_INTERVAL);
+    const heapSample &newest = heapProfiler.sample(heapProfiler.samples() - 1);
+    const heapSample &before = heapProfiler.sample(heapProfiler.samples() - 2);
+    failed += expect(heapProfiler.minFree() == 12000 && heapProfiler.minLargest() == 3000 && heapProfiler.maxFragmentation() == 40,
+      "heap", "keeping low water marks"), checks++;
+    failed += expect((newest.free == 12000 && newest.largest == 3000) || (before.free == 12000 && before.largest == 3000),
+      "heap", "keeping the worst of a window"), checks++;
+
+    printf("heap: %u sites, %u over budget, lowest %u free, %u largest, %d checked, %d failed\n", (unsigned)heapProfiler.sites(),
+      heapProfiler.overBudget(), heapProfiler.minFree(), heapProfiler.minLargest(), checks, failed);
+
+    heapProfiler.setBudget("/heap", 1, 0);
+    server.request("/heap", {}, reader);
+    failed += expect(heapProfiler.overBudget() == 1, "heap", "counting a call over budget");
+    for (const heapBudget &budget : HEAP_BUDGETS) {
+      heapProfiler.setBudget(budget.site, budget.allocs, budget.bytes);
+    }
+    return failed;
+  }
+
+  //What the test tasks in checkTasks ran, in order: C critical, H high, L and M low
+  std::string taskOrder;
+
+  void testCritical() {
+    taskOrder += 'C';
+    delayMicroseconds(100);
+  }
+
+  void testHigh() {
+    taskOrder += 'H';
+    delayMicroseconds(1500);
+  }
+
+  void testLow() {
+    taskOrder += 'L';
+    delayMicroseconds(3000);
+  }
+
+  void testLast() {
+    taskOrder += 'M';
+    delayMicroseconds(3000);
+  }
+
+  //Door control runs every tick and never waits longer than its period plus the longest single run
+  //of anything else. A scheduler of test tasks shows the order: priority first, the critical task
+  //again between slow tasks, the tick budget stopping the rest, and a starved task going first
+  int checkTasks() {
+    int failed = 0;
+    int checks = 0;
+    const schedulerTask tests[] = {
+      { "critical", TASK_CRITICAL, 2000, 200, testCritical },
+      { "low", 3, 0, 5000, testLow },
+      { "high", 1, 0, 1000, testHigh },
+      { "last", 3, 0, 5000, testLast }
+    };
+    Scheduler bench(tests, sizeof(tests) / sizeof(tests[0]), 4000);
+    uint32_t longest = 0;
+    int ticks = 0;
+
+    taskOrder.clear();
+    bench.tick();
+    failed += expect(taskOrder == "CHLC", "tasks", "running by priority within the tick budget"), checks++;
+    failed += expect(bench.stats(2).overruns == 1 && bench.stats(1).overruns == 0, "tasks", "counting overruns"), checks++;
+    while (bench.stats(3).runs == 0 && ticks++ < 2 * SCHEDULER_MAX_SKIPS) {
+      taskOrder.clear();
+      bench.tick();
+    }
+    failed += expect(ticks == SCHEDULER_MAX_SKIPS && taskOrder.find("CM") == 0, "tasks", "running a starved task first"), checks++;
+    for (uint8_t i = 1; i < bench.count(); i++) {
+      longest = bench.stats(i).longest > longest ? bench.stats(i).longest : longest;
+    }
+    failed += expect(bench.stats(0).worstGap <= tests[0].period + longest, "tasks", "bounding the critical task's wait"), checks++;
+
+    scheduler.resetStats();
+    placeDoor(DOOR_STATE_OPEN, INPUT_SWITCH_MADE);
+    server.request("/override", {}, IPAddress(10, 6, 0, 1));
+    runFor(MOTOR_REST_MILLIS + 2000);
+    longest = 0;
+    printf("%-12s %4s %8s %8s %7s %7s %9s\n", "task", "prio", "runs", "avg us", "max us", "overrun", "worst gap");
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+      const taskStats &stats = scheduler.stats(i);
+      printf("%-12s %4u %8u %8.1f %7u %7u %9u\n", scheduler.task(i).name, scheduler.task(i).priority, stats.runs,
+        stats.runs ? (double)stats.micros / stats.runs : 0.0, stats.longest, stats.overruns, stats.worstGap);
+      if (i > 0 && stats.longest > longest) {
+        longest = stats.longest;
+      }
+    }
+    const taskStats &door = scheduler.stats(0);
+    failed += expect(door.runs >= scheduler.ticks() && scheduler.ticks() > 0, "tasks", "running door control every tick"), checks++;
+    failed += expect(door.worstGap <= DOOR_PERIOD + longest, "tasks", "bounding door control's wait"), checks++;
+    failed += expect(doorState == DOOR_STATE_CLOSING || doorState == DOOR_STATE_CLOSED, "tasks", "driving the door"), checks++;
+
+    //The longest overrun runs on between ticks rather than inside one
+    int original = overRun;
+    overRun = OVERRUN_MAX;
+    scheduler.resetStats();
+    placeDoor(DOOR_STATE_CLOSING, INPUT_SWITCH_MADE);
+    runFor(OVERRUN_MAX - 500);
+    bool running = doorState == DOOR_STATE_CLOSING && host::motorDirection() == -1;
+    runFor(1000);
+    failed += expect(running && doorState == DOOR_STATE_CLOSED && host::motorDirection() == 0
+      && scheduler.stats(0).worstGap <= DOOR_PERIOD + longest, "tasks", "running on without blocking"), checks++;
+    overRun = original;
+
+    AsyncWebServer::hostResponse response = server.request("/tasks", {}, IPAddress(10, 6, 0, 1));
+    int listed = 0;
+    for (int at = response.body.indexOf("{\"name\""); at >= 0; at = response.body.indexOf("{\"name\"", at + 1)) {
+      listed++;
+    }
+    failed += expect(response.code == 200 && response.body.startsWith("{\"ticks\":") && response.body.endsWith("]}\n")
+      && listed == scheduler.count(), "tasks", "serving /tasks"), checks++;
+    std::string out = consoleLine("dump tasks\r\n");
+    failed += expect(out.find("door p0 runs ") == 0 && out.find("OK tasks\r\n") != std::string::npos, "tasks", "dumping tasks"), checks++;
+
+    printf("tasks: %u ticks, door worst gap %u us, %d checked, %d failed\n", scheduler.ticks(), door.worstGap, checks, failed);
+    return failed;
+  }
+
+  //Advance to the next thing the firmware cares about
+  void step() {
+    if (host::motorDirection() != 0) {
+      host::advance(MOVING_STEP_MICROS);
+      return;
+    }
+    time_t current = now();
+    time_t next = Alarm.getNextTrigger();
+    time_t skip = MAX_IDLE_SKIP;
+    if (next > current && next - current < skip) {
+      skip = next - current;
+    }
+    if (skip < 1) {
+      skip = 1;
+    }
+    host::advance((uint64_t)skip * 1000000);
+  }
+}
+
+int main(int argc, char **argv) {
+  int firstYear = argc > 1 ? atoi(argv[1]) : 2017;
+  int lastYear = argc > 2 ? atoi(argv[2]) : firstYear;
+  int overRunMillis = argc > 3 ? atoi(argv[3]) : 500;
+  unsigned long travelMillis = argc > 4 ? strtoul(argv[4], NULL, 10) : 8000;
+  int driftPPM = argc > 5 ? atoi(argv[5]) : 40;
+  std::map<time_t, sim::dayTally> days;
+  int previousState;
+  uint8_t maxAlarms = 0;
+
+  //Boot at local noon the day before the first simulated day, door shut, state unknown
+  time_t first = sim::localMidnight(firstYear, 1, 1);
+  time_t last = sim::localMidnight(lastYear + 1, 1, 1);
+  host::attachDoor(MOTOR_INPUT_1, MOTOR_INPUT_2, DOOR_OPEN_PIN, DOOR_CLOSED_PIN, MANUAL_OVERIDE_PIN);
+  host::setDoorTravel(travelMillis);
+  int failedTransitions = sim::checkTransitions();
+  host::setDoorPosition(0);
+  host::setUTC(localTime.toUTC(first - SECS_PER_DAY / 2));
+  EEPROM.put(45, overRunMillis);
+  host::setOscillatorDrift(driftPPM);
+  //Idle steps are whole seconds, so boot mid-way through an RTC second: the average case for its truncation
+  host::advance(500000);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  setup();
+  previousState = doorState;
+  while (localTime.toLocal(host::utc()) < last) {
+    loop();
+    if (doorState != previousState) {
+      time_t local = localTime.toLocal(host::utc());
+      sim::dayTally &tally = days[previousMidnight(local)];
+      if (doorState == DOOR_STATE_OPENING || (doorState == DOOR_STATE_OPEN && previousState != DOOR_STATE_OPENING)) {
+        if (tally.opens == 0) {
+          tally.openStart = host::utcSeconds();
+        }
+        tally.opens++;
+      }
+      if (doorState == DOOR_STATE_CLOSING || (doorState == DOOR_STATE_CLOSED && previousState != DOOR_STATE_CLOSING)) {
+        if (tally.closes == 0) {
+          tally.closeStart = host::utcSeconds();
+        }
+        tally.closes++;
+      }
+      previousState = doorState;
+    }
+    if (Alarm.count() > maxAlarms) {
+      maxAlarms = Alarm.count();
+    }
+    sim::step();
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  //Score each local day against the firmware's own sun calculation
+  std::map<int, sim::yearTally> years;
+  sim::yearTally total = {};
+  for (time_t day = first; day < last; day += SECS_PER_DAY) {
+    sim::dayTally tally = days.count(day) ? days[day] : sim::dayTally();
+    sim::yearTally &yearly = years[year(day)];
+    time_t sunrise = sim::expectedInstant(day, getSunTimes(SUNCALC_SUNRISE, day + SECS_PER_DAY / 2, ZENITH_DEFAULT));
+    time_t sunset = sim::expectedInstant(day, getSunTimes(SUNCALC_SUNSET, day + SECS_PER_DAY / 2, ZENITH_NAUTICAL));
+    yearly.days++;
+    yearly.opens += tally.opens;
+    yearly.closes += tally.closes;
+    yearly.missed += (tally.opens == 0) + (tally.closes == 0);
+    yearly.duplicated += (tally.opens > 1) + (tally.closes > 1);
+    if (tally.opens > 0) {
+      double openOffset = sim::offset(tally.openStart, sunrise);
+      yearly.openOffsetSum += openOffset;
+      if (fabs(openOffset) > fabs(yearly.openOffsetMax)) {
+        yearly.openOffsetMax = openOffset;
+      }
+    }
+    if (tally.closes > 0) {
+      double closeOffset = sim::offset(tally.closeStart, sunset);
+      yearly.closeOffsetSum += closeOffset;
+      if (fabs(closeOffset) > fabs(yearly.closeOffsetMax)) {
+        yearly.closeOffsetMax = closeOffset;
+      }
+    }
+  }
+
+  printf("%-6s %5s %6s %6s %7s %10s %16s %17s\n", "year", "days", "opens", "closes", "missed", "duplicated", "open offset (s)", "close offset (s)");
+  for (auto &entry : years) {
+    sim::yearTally &yearly = entry.second;
+    printf("%-6d %5d %6d %6d %7d %10d %7.1f / %-6.1f %8.1f / %-6.1f\n", entry.first, yearly.days, yearly.opens, yearly.closes,
+      yearly.missed, yearly.duplicated, yearly.opens ? yearly.openOffsetSum / yearly.opens : 0.0, yearly.openOffsetMax,
+      yearly.closes ? yearly.closeOffsetSum / yearly.closes : 0.0, yearly.closeOffsetMax);
+    total.days += yearly.days;
+    total.opens += yearly.opens;
+    total.closes += yearly.closes;
+    total.missed += yearly.missed;
+    total.duplicated += yearly.duplicated;
+  }
+  printf("%-6s %5d %6d %6d %7d %10d\n", "total", total.days, total.opens, total.closes, total.missed, total.duplicated);
+  printf("offsets are mean / worst motor start against the computed sunrise and nautical sunset\n");
+  printf("clock: %d ppm crystal, estimated %.1f +/- %.1f ppm, %u RTC reads (%.2f per day)\n", driftPPM,
+    -rtcClock.drift() / 1000.0, rtcClock.uncertainty() / 1000.0, host::rtcReads(), (double)host::rtcReads() / total.days);
+  printf("alarm slots in use: %u of %u\n", maxAlarms, dtNBR_ALARMS);
+  printf("event log: %u records, %u dropped\n", eventLog.nextSeq(), eventLog.dropped());
+  printf("simulated %d days in %.2f s (%.0f days/s)\n", total.days, wallSeconds, total.days / wallSeconds);
+  int failedEventLog = sim::checkEventLog();
+  int failedTrace = sim::checkTrace();
+  int failedAssets = sim::checkAssets();
+  int failedActions = sim::checkActions();
+  int failedArgs = sim::checkArgs();
+  int failedLimits = sim::checkLimits();
+  int failedUdp = sim::checkUdp();
+  int failedConsole = sim::checkConsole();
+  int failedUpdates = sim::checkUpdate();
+  int failedTelemetry = sim::checkTelemetry();
+  int failedHeap = sim::checkHeap();
+  int failedTasks = sim::checkTasks();
+  return failedTransitions == 0 && failedEventLog == 0 && failedTrace == 0 && failedAssets == 0 && failedActions == 0 && failedArgs == 0 && failedLimits == 0 && failedUdp == 0 && failedConsole == 0 && failedUpdates == 0
+    && failedTelemetry == 0 && failedHeap == 0 && failedTasks == 0 && total.missed == 0 && total.duplicated == 0 ? 0 : 1;
+}